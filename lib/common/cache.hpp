@@ -1,37 +1,224 @@
 #pragma once
 
-#include <common/singleton.hpp>
+#include <list>
+#include <algorithm>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <unordered_map>
 
 namespace Construction {
     namespace Common {
 
-        template<typename K, typename V>
-        class Cache : public Singleton<Cache> {
+        /**
+            \brief Default estimate of the memory of a cached value in bytes
+
+            Specialize it, or pass a different functor to the cache, for
+            values that own heap memory.
+         */
+        template<typename V>
+        struct CacheWeight {
+            size_t operator()(const V&) const {
+                return sizeof(V);
+            }
+        };
+
+        template<typename T>
+        struct CacheWeight<std::vector<T>> {
+            size_t operator()(const std::vector<T>& values) const {
+                size_t result = sizeof(std::vector<T>);
+                for (auto& value : values) result += CacheWeight<T>()(value);
+                return result;
+            }
+        };
+
+        /**
+            \class Cache
+
+            \brief Thread-safe memoisation cache with a memory budget
+
+            The entries are distributed over several shards by the hash
+            of their key, each with its own lock, s.t. threads working
+            on different keys rarely wait for each other. Every shard
+            gets an equal part of the budget and evicts its least
+            recently used entries once it exceeds it. Entries larger
+            than the budget of a shard are not cached at all.
+
+            The values are returned as copies, so the cached values
+            cannot be changed from outside. The cache shall only be used
+            for pure functions, as a value is never recalculated.
+         */
+        template<typename K, typename V, typename Hash = std::hash<K>, typename Weight = CacheWeight<V>, typename Equal = std::equal_to<K>>
+        class Cache {
         public:
-            Cache() { }
+            struct Statistics {
+                size_t hits;
+                size_t misses;
+                size_t evictions;
+                size_t entries;
+                size_t bytes;
+            };
+        public:
+            Cache(size_t budget = 64*1024*1024, unsigned numShards = 16, const Hash& hash = Hash(), const Weight& weight = Weight())
+                : budget(budget), hash(hash), weight(weight), hits(0), misses(0), evictions(0)
+            {
+                for (unsigned i=0; i<std::max(1u, numShards); i++) {
+                    shards.emplace_back(new Shard(hash));
+                }
+            }
+
+            Cache(const Cache&) = delete;
+            Cache& operator=(const Cache&) = delete;
         public:
             bool Contains(const K& key) const {
-                auto it = data.find(key);
-                if (it == data.end()) return false;
+                auto& shard = GetShard(key);
+                std::unique_lock<std::mutex> lock(shard.mutex);
+
+                return shard.map.find(key) != shard.map.end();
+            }
+
+            /**
+                \brief Looks up the value of the key
+
+                Returns false if there is none. A hit makes the entry
+                the most recently used one in its shard.
+             */
+            bool Get(const K& key, V& value) {
+                auto& shard = GetShard(key);
+                std::unique_lock<std::mutex> lock(shard.mutex);
+
+                auto it = shard.map.find(key);
+                if (it == shard.map.end()) {
+                    misses++;
+                    return false;
+                }
+
+                shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+                value = it->second->value;
+
+                hits++;
                 return true;
             }
 
-            V Get(const K& key) const {
-                auto it = data.find(key);
-                if (it == data.end()) return V();
-                return it->second;
+            void Set(const K& key, const V& value) {
+                Set(key, value, weight(value));
+            }
+
+            /**
+                \brief Caches the value with its weight computed beforehand
+
+                Allows callers to weigh expensive values outside of their
+                own locks.
+             */
+            void Set(const K& key, const V& value, size_t size) {
+                size_t shardBudget = budget / shards.size();
+
+                auto& shard = GetShard(key);
+                std::unique_lock<std::mutex> lock(shard.mutex);
+
+                // Replace an older value
+                auto it = shard.map.find(key);
+                if (it != shard.map.end()) {
+                    shard.bytes -= it->second->size;
+                    shard.entries.erase(it->second);
+                    shard.map.erase(it);
+                }
+
+                if (size > shardBudget) return;
+
+                // Evict the least recently used entries
+                while (shard.bytes + size > shardBudget && !shard.entries.empty()) {
+                    auto& last = shard.entries.back();
+
+                    shard.bytes -= last.size;
+                    shard.map.erase(last.key);
+                    shard.entries.pop_back();
+
+                    evictions++;
+                }
+
+                shard.entries.push_front({ key, value, size });
+                shard.map.insert({ key, shard.entries.begin() });
+                shard.bytes += size;
+            }
+
+            /**
+                \brief Returns the cached value or calculates and caches it
+
+                The calculation runs without holding a lock, so two
+                threads missing the same key at once both calculate it.
+             */
+            template<typename F>
+            V GetOrCalculate(const K& key, F fn) {
+                V value;
+                if (Get(key, value)) return value;
+
+                value = fn();
+                Set(key, value);
+
+                return value;
             }
 
-            V& Get(const K& key) {
-                return data[key];
+            void Clear() {
+                for (auto& shard : shards) {
+                    std::unique_lock<std::mutex> lock(shard->mutex);
+
+                    shard->map.clear();
+                    shard->entries.clear();
+                    shard->bytes = 0;
+                }
             }
+        public:
+            Statistics GetStatistics() const {
+                Statistics result = { hits, misses, evictions, 0, 0 };
 
-            void Set(const K& key, const V& value) {
-                data[key] = value;
+                for (auto& shard : shards) {
+                    std::unique_lock<std::mutex> lock(shard->mutex);
+
+                    result.entries += shard->map.size();
+                    result.bytes += shard->bytes;
+                }
+
+                return result;
             }
+
+            size_t GetBudget() const { return budget; }
         private:
-            std::map<K, V> data;
+            struct Entry {
+                K key;
+                V value;
+                size_t size;
+            };
+
+            struct Shard {
+                Shard(const Hash& hash) : map(16, hash), bytes(0) { }
+
+                mutable std::mutex mutex;
+
+                // Most recently used first
+                std::list<Entry> entries;
+                std::unordered_map<K, typename std::list<Entry>::iterator, Hash, Equal> map;
+
+                size_t bytes;
+            };
+
+            Shard& GetShard(const K& key) const {
+                return *shards[hash(key) % shards.size()];
+            }
+        private:
+            size_t budget;
+
+            Hash hash;
+            Weight weight;
+
+            std::vector<std::unique_ptr<Shard>> shards;
+
+            std::atomic<size_t> hits;
+            std::atomic<size_t> misses;
+            std::atomic<size_t> evictions;
         };
 
     }
-}
\ No newline at end of file
+}
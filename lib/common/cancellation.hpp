@@ -0,0 +1,223 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <fstream>
+
+#include <unistd.h>
+
+#include <common/error.hpp>
+
+namespace Construction {
+
+    /**
+        \class CancelledException
+
+        Thrown at the next check point once the computation was cancelled,
+        e.g. by pressing Ctrl-C in the REPL.
+     */
+    class CancelledException : public Exception {
+    public:
+        CancelledException() : Exception("The computation was cancelled") { }
+        CancelledException(const std::string& message) : Exception(message) { }
+    };
+
+    /**
+        \class DeadlineExceededException
+
+        Thrown at the next check point if the computation took longer or
+        needed more memory than allowed.
+     */
+    class DeadlineExceededException : public CancelledException {
+    public:
+        DeadlineExceededException(const std::string& message) : CancelledException(message) { }
+    };
+
+    /**
+        \class MemoryLimitExceededException
+
+        Thrown at the next check point if the process needed more memory
+        than allowed.
+     */
+    class MemoryLimitExceededException : public DeadlineExceededException {
+    public:
+        MemoryLimitExceededException() : DeadlineExceededException("The computation needed more memory than allowed") { }
+    };
+
+    namespace Common {
+
+        /**
+            \class CancellationToken
+
+            Cooperative cancellation of long running computations. A token
+            is handed to a computation which polls it at its check points
+            (chunk boundaries, rows of an elimination, ...) and stops by
+            throwing a CancelledException. Copies of a token share the
+            same state, so cancelling one of them cancels all.
+
+            Instead of passing the token through every call, it is
+            installed for the current thread with a CancellationScope.
+            Tasks forked on the executor inherit the token of the thread
+            that forked them, so a single check in the algorithms covers
+            all of their parallel parts.
+
+            Optionally a token has a deadline in time and a limit for the
+            resident memory of the process. Both are only checked at the
+            check points, the memory at most every few milliseconds.
+
+            Besides that, every interruptible token is cancelled by
+            Interrupt, which is safe to call from a signal handler.
+         */
+        class CancellationToken {
+        public:
+            typedef std::chrono::steady_clock   Clock;
+        public:
+            CancellationToken(bool interruptible = true) : state(std::make_shared<State>(interruptible)) { }
+        public:
+            /**
+                \brief Returns the token of the current thread
+
+                If no token was installed, an empty token that is never
+                cancelled is returned.
+             */
+            static CancellationToken& Current() {
+                static thread_local CancellationToken current ((std::shared_ptr<State>()));
+                return current;
+            }
+
+            /**
+                \brief Cancels all the interruptible tokens that exist right now
+
+                This only increments an atomic counter and thus can be
+                called from a signal handler.
+             */
+            static void Interrupt() {
+                ++Interrupts();
+            }
+        public:
+            void Cancel() {
+                if (state) state->cancelled = true;
+            }
+
+            /**
+                \brief Sets the time limit relative to now, zero disables it
+             */
+            void SetTimeout(std::chrono::milliseconds timeout) {
+                if (!state) return;
+                state->hasDeadline = timeout.count() > 0;
+                state->deadline = Clock::now() + timeout;
+            }
+
+            /**
+                \brief Sets the limit for the resident memory in bytes, zero disables it
+             */
+            void SetMemoryLimit(size_t bytes) {
+                if (!state) return;
+                state->memoryLimit = bytes;
+            }
+
+            bool IsCancelled() const {
+                if (!state) return false;
+                return state->cancelled || (state->interruptible && state->interrupts != Interrupts());
+            }
+
+            /**
+                \brief Checks the token and throws if the computation has to stop
+
+                \throws CancelledException
+                \throws DeadlineExceededException
+                \throws MemoryLimitExceededException
+             */
+            void Check() const {
+                if (!state) return;
+
+                if (IsCancelled()) throw CancelledException();
+
+                if (state->hasDeadline && Clock::now() > state->deadline) {
+                    throw DeadlineExceededException("The computation took longer than allowed");
+                }
+
+                if (state->memoryLimit > 0) {
+                    // Reading the memory usage is rather expensive, do it only every now and then
+                    auto now = Clock::now().time_since_epoch().count();
+                    auto last = state->lastMemoryCheck.load();
+
+                    if (now - last > std::chrono::duration_cast<Clock::duration>(std::chrono::milliseconds(10)).count() &&
+                        state->lastMemoryCheck.compare_exchange_strong(last, now)) {
+                        if (GetResidentMemory() > state->memoryLimit) {
+                            throw MemoryLimitExceededException();
+                        }
+                    }
+                }
+            }
+        public:
+            /**
+                \brief Returns the resident memory of the process in bytes
+             */
+            static size_t GetResidentMemory() {
+                std::ifstream file ("/proc/self/statm");
+                size_t pages, resident;
+                if (!(file >> pages >> resident)) return 0;
+
+                return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+            }
+        private:
+            struct State {
+                State(bool interruptible) : interruptible(interruptible), cancelled(false), hasDeadline(false), memoryLimit(0), lastMemoryCheck(0), interrupts(Interrupts().load()) { }
+
+                bool interruptible;
+                std::atomic<bool> cancelled;
+
+                bool hasDeadline;
+                Clock::time_point deadline;
+
+                size_t memoryLimit;
+                std::atomic<Clock::rep> lastMemoryCheck;
+
+                unsigned interrupts;
+            };
+
+            CancellationToken(const std::shared_ptr<State>& state) : state(state) { }
+
+            static std::atomic<unsigned>& Interrupts() {
+                static std::atomic<unsigned> interrupts (0);
+                return interrupts;
+            }
+        private:
+            std::shared_ptr<State> state;
+        };
+
+        /**
+            \class CancellationScope
+
+            Installs a token as the current one of the thread for the
+            lifetime of the scope and restores the previous one afterwards.
+         */
+        class CancellationScope {
+        public:
+            CancellationScope(const CancellationToken& token) : previous(CancellationToken::Current()) {
+                CancellationToken::Current() = token;
+            }
+
+            ~CancellationScope() {
+                CancellationToken::Current() = previous;
+            }
+
+            CancellationScope(const CancellationScope&) = delete;
+            CancellationScope& operator=(const CancellationScope&) = delete;
+        private:
+            CancellationToken previous;
+        };
+
+        /**
+            \brief Checks the token of the current thread
+
+            \throws CancelledException
+         */
+        inline void CheckCancellation() {
+            CancellationToken::Current().Check();
+        }
+
+    }
+}
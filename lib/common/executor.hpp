@@ -0,0 +1,366 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <memory>
+#include <deque>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <stdexcept>
+
+#include <common/cancellation.hpp>
+
+namespace Construction {
+    namespace Common {
+
+        class TaskGroup;
+
+        /**
+            \class Executor
+
+            Process-wide work-stealing scheduler. Every worker owns a
+            deque of tasks: it pushes and pops new work at the back,
+            while idle workers steal from the front of the others. Tasks
+            spawned from threads that are not workers of the executor
+            (e.g. the main thread) go into a shared injection queue.
+
+            The executor is not used directly but through a TaskGroup
+            which forks tasks and joins them again. Joining never blocks
+            a worker as long as there is work left: the waiting thread
+            executes pending tasks itself until all its children are
+            finished. Hence nested parallelism, e.g. a parallel
+            symmetrization that calls a parallel simplification, is
+            safe and does not spawn any additional threads.
+
+            Example:
+                TaskGroup group;
+                for (auto& summand : summands) {
+                    group.Run([&]() { ... });
+                }
+                group.Wait();
+         */
+        class Executor {
+        public:
+            typedef std::function<void()>   Task;
+        public:
+            Executor(unsigned threads = std::thread::hardware_concurrency()) : terminate(false), sleeping(0), queued(0), queuedBackground(0) {
+                if (threads == 0) threads = 1;
+
+                workers.reserve(threads);
+                for (unsigned i=0; i<threads; ++i) {
+                    workers.emplace_back(new Worker());
+                }
+
+                threadPool.reserve(threads);
+                for (unsigned i=0; i<threads; ++i) {
+                    threadPool.emplace_back([this, i]() { Run(i); });
+                }
+            }
+
+            Executor(const Executor&) = delete;
+            Executor& operator=(const Executor&) = delete;
+            Executor(Executor&&) = delete;
+            Executor& operator=(Executor&&) = delete;
+
+            ~Executor() {
+                {
+                    std::unique_lock<std::mutex> lock(sleepMutex);
+                    terminate = true;
+                }
+
+                sleepCondition.notify_all();
+
+                for (auto& thread : threadPool) {
+                    thread.join();
+                }
+            }
+        public:
+            /**
+                \brief Returns the process-wide executor
+
+                The executor is created on first use with one worker per
+                hardware thread and lives until the process terminates.
+             */
+            static Executor* Instance() {
+                static Executor* instance = new Executor();
+                return instance;
+            }
+        public:
+            inline unsigned GetNumberOfWorkers() const {
+                return static_cast<unsigned>(workers.size());
+            }
+
+            /**
+                \brief Checks if the calling thread is a worker of this executor
+             */
+            inline bool IsWorkerThread() const {
+                return CurrentExecutor() == this;
+            }
+        public:
+            /**
+                \brief Schedules a task
+
+                Workers push the task onto their own deque, other threads
+                into the injection queue. A sleeping worker is only woken
+                up if there is one, so spawning on a busy executor costs
+                a single uncontended lock.
+             */
+            void Spawn(Task task) {
+                Worker* target = IsWorkerThread() ? workers[CurrentIndex()].get() : &injection;
+
+                // Count first, so that the counter never drops below zero
+                ++queued;
+
+                {
+                    std::unique_lock<std::mutex> lock(target->mutex);
+                    target->tasks.push_back(std::move(task));
+                }
+
+                if (sleeping > 0) {
+                    std::unique_lock<std::mutex> lock(sleepMutex);
+                    sleepCondition.notify_one();
+                }
+            }
+
+            /**
+                \brief Schedules a long running task, e.g. a background job
+
+                Background tasks are only taken by idle workers, in the
+                order they were spawned, and never by threads that help
+                out while they join. Otherwise a short join could end up
+                in a task that runs for hours.
+             */
+            void SpawnBackground(Task task) {
+                ++queuedBackground;
+
+                {
+                    std::unique_lock<std::mutex> lock(background.mutex);
+                    background.tasks.push_back(std::move(task));
+                }
+
+                if (sleeping > 0) {
+                    std::unique_lock<std::mutex> lock(sleepMutex);
+                    sleepCondition.notify_one();
+                }
+            }
+
+            /**
+                \brief Runs one pending task on the calling thread
+
+                This is used by joining threads to help out instead of
+                blocking. Returns false if there was nothing to do.
+             */
+            bool RunPendingTask() {
+                Task task;
+                if (!Take(task)) return false;
+
+                task();
+                return true;
+            }
+        private:
+            struct Worker {
+                std::mutex mutex;
+                std::deque<Task> tasks;
+            };
+
+            static const Executor*& CurrentExecutor() {
+                static thread_local const Executor* executor = nullptr;
+                return executor;
+            }
+
+            static unsigned& CurrentIndex() {
+                static thread_local unsigned index = 0;
+                return index;
+            }
+
+            bool PopBack(Worker& worker, Task& task) {
+                std::unique_lock<std::mutex> lock(worker.mutex);
+                if (worker.tasks.empty()) return false;
+
+                task = std::move(worker.tasks.back());
+                worker.tasks.pop_back();
+                --queued;
+                return true;
+            }
+
+            bool PopFront(Worker& worker, Task& task) {
+                return PopFront(worker, task, queued);
+            }
+
+            bool PopFront(Worker& worker, Task& task, std::atomic<size_t>& counter) {
+                std::unique_lock<std::mutex> lock(worker.mutex);
+                if (worker.tasks.empty()) return false;
+
+                task = std::move(worker.tasks.front());
+                worker.tasks.pop_front();
+                --counter;
+                return true;
+            }
+
+            /**
+                Takes the next task for the calling thread. Workers first
+                look at their own deque (LIFO, keeps the data hot), then at
+                the injection queue and finally try to steal the oldest
+                task of another worker.
+             */
+            bool Take(Task& task) {
+                if (queued == 0) return false;
+
+                unsigned self = 0;
+                if (IsWorkerThread()) {
+                    self = CurrentIndex();
+                    if (PopBack(*workers[self], task)) return true;
+                }
+
+                if (PopFront(injection, task)) return true;
+
+                for (unsigned i=1; i<=workers.size(); ++i) {
+                    if (PopFront(*workers[(self + i) % workers.size()], task)) return true;
+                }
+
+                return false;
+            }
+
+            void Run(unsigned index) {
+                CurrentExecutor() = this;
+                CurrentIndex() = index;
+
+                while (true) {
+                    Task task;
+
+                    if (Take(task)) {
+                        task();
+                        continue;
+                    }
+
+                    // Only start long running tasks if there is nothing else to do
+                    if (queuedBackground > 0 && PopFront(background, task, queuedBackground)) {
+                        task();
+                        continue;
+                    }
+
+                    std::unique_lock<std::mutex> lock(sleepMutex);
+
+                    ++sleeping;
+                    sleepCondition.wait(lock, [this]() {
+                        return terminate || queued > 0 || queuedBackground > 0;
+                    });
+                    --sleeping;
+
+                    if (terminate) return;
+                }
+            }
+        private:
+            std::vector<std::unique_ptr<Worker>> workers;
+            std::vector<std::thread> threadPool;
+            Worker injection;
+
+            // Long running tasks, see SpawnBackground
+            Worker background;
+
+            std::mutex sleepMutex;
+            std::condition_variable sleepCondition;
+
+            bool terminate;
+            std::atomic<unsigned> sleeping;
+            std::atomic<size_t> queued;
+            std::atomic<size_t> queuedBackground;
+        };
+
+        /**
+            \class TaskGroup
+
+            Fork-join scope on top of the executor. Run forks a child
+            task, Wait joins all of them. While waiting, the calling
+            thread executes pending tasks of the executor, so it is safe
+            to wait inside of a task.
+
+            Children run with the cancellation token of the thread that
+            forked them. Once it is cancelled, children that did not start
+            yet are skipped.
+
+            The first exception thrown by a child is rethrown in Wait.
+         */
+        class TaskGroup {
+        public:
+            TaskGroup(Executor* executor = Executor::Instance()) : executor(executor), pending(0) { }
+
+            TaskGroup(const TaskGroup&) = delete;
+            TaskGroup& operator=(const TaskGroup&) = delete;
+
+            ~TaskGroup() {
+                try {
+                    Wait();
+                } catch (...) {
+                    // Errors have to be collected by an explicit Wait
+                }
+            }
+        public:
+            /**
+                \brief Forks a child task
+             */
+            template<class F>
+            void Run(F&& f) {
+                ++pending;
+
+                CancellationToken token = CancellationToken::Current();
+
+                executor->Spawn([this, f, token]() {
+                    try {
+                        CancellationScope scope(token);
+                        token.Check();
+
+                        f();
+                    } catch (...) {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        if (!error) error = std::current_exception();
+                    }
+
+                    // Decrease under the lock, otherwise the group might be
+                    // destroyed while we still notify
+                    std::unique_lock<std::mutex> lock(mutex);
+                    if (--pending == 0) condition.notify_all();
+                });
+            }
+
+            /**
+                \brief Joins all children
+
+                \throws The first exception that was thrown by a child
+             */
+            void Wait() {
+                while (pending > 0) {
+                    if (executor->RunPendingTask()) continue;
+
+                    // All our children are running on other threads,
+                    // wait a moment and see if new work came up
+                    std::unique_lock<std::mutex> lock(mutex);
+                    condition.wait_for(lock, std::chrono::microseconds(500), [this]() {
+                        return pending == 0;
+                    });
+                }
+
+                std::exception_ptr e;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    std::swap(e, error);
+                }
+
+                if (e) std::rethrow_exception(e);
+            }
+        private:
+            Executor* executor;
+            std::atomic<size_t> pending;
+
+            std::mutex mutex;
+            std::condition_variable condition;
+            std::exception_ptr error;
+        };
+
+    }
+
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <string>
+#include <sstream>
+#include <ostream>
+#include <iomanip>
+#include <limits>
+#include <cmath>
+
+namespace Construction {
+    namespace Common {
+
+        /**
+            \class JsonRecord
+
+            \brief A flat JSON object written on a single line
+
+            Used for the machine-readable output of the programs, one
+            record per line, s.t. other programs can consume the records
+            while they are still written.
+
+            Example:
+                JsonRecord record;
+                record.Add("variable", "x").Add("seconds", 1.5);
+                std::cout << record << std::endl;
+         */
+        class JsonRecord {
+        public:
+            JsonRecord() : empty(true) { }
+        public:
+            JsonRecord& Add(const std::string& key, const std::string& value) {
+                Key(key);
+                ss << Escape(value);
+                return *this;
+            }
+
+            JsonRecord& Add(const std::string& key, const char* value) {
+                return Add(key, std::string(value));
+            }
+
+            JsonRecord& Add(const std::string& key, bool value) {
+                Key(key);
+                ss << (value ? "true" : "false");
+                return *this;
+            }
+
+            /**
+                Writes null for nan and infinity, since JSON has no
+                literals for them
+             */
+            JsonRecord& Add(const std::string& key, double value) {
+                Key(key);
+
+                if (std::isfinite(value)) {
+                    ss << std::setprecision(std::numeric_limits<double>::digits10) << value;
+                } else {
+                    ss << "null";
+                }
+
+                return *this;
+            }
+
+            JsonRecord& Add(const std::string& key, size_t value) {
+                Key(key);
+                ss << value;
+                return *this;
+            }
+
+            JsonRecord& Add(const std::string& key, int value) {
+                Key(key);
+                ss << value;
+                return *this;
+            }
+        public:
+            std::string ToString() const {
+                return "{" + ss.str() + "}";
+            }
+
+            friend std::ostream& operator<<(std::ostream& os, const JsonRecord& record) {
+                os << record.ToString();
+                return os;
+            }
+        public:
+            /**
+                \brief Returns the string as JSON string literal including the quotes
+             */
+            static std::string Escape(const std::string& text) {
+                std::stringstream result;
+                result << "\"";
+
+                for (auto c : text) {
+                    switch (c) {
+                        case '"':   result << "\\\""; break;
+                        case '\\':  result << "\\\\"; break;
+                        case '\n':  result << "\\n"; break;
+                        case '\r':  result << "\\r"; break;
+                        case '\t':  result << "\\t"; break;
+                        default:
+                            if (static_cast<unsigned char>(c) < 0x20) {
+                                result << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec;
+                            } else {
+                                result << c;
+                            }
+                    }
+                }
+
+                result << "\"";
+                return result.str();
+            }
+        private:
+            void Key(const std::string& key) {
+                if (!empty) ss << ",";
+                empty = false;
+
+                ss << Escape(key) << ":";
+            }
+        private:
+            std::stringstream ss;
+            bool empty;
+        };
+
+    }
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <utility>
+
+#include <common/executor.hpp>
+
+namespace Construction {
+    namespace Parallel {
+
+        /**
+            \brief Calculates the number of elements per task
+
+            If no grain size is given, the range is split into about four
+            chunks per worker of the executor. This is enough to balance
+            uneven work by stealing while keeping the number of tasks small.
+         */
+        inline size_t GrainSize(size_t size, size_t grain = 0) {
+            if (grain > 0) return grain;
+
+            size_t chunks = 4 * Common::Executor::Instance()->GetNumberOfWorkers();
+            return std::max<size_t>(1, (size + chunks - 1) / chunks);
+        }
+
+        /**
+            \brief Calls fn(i) for every i in [begin, end) in parallel
+
+            The range is split into chunks of grain elements that are
+            executed as tasks on the executor. The last chunk runs on the
+            calling thread. Since joining helps the executor, For can be
+            called from within other parallel algorithms.
+
+            The cancellation token is checked at every chunk boundary.
+
+            \throws The first exception that was thrown by fn
+            \throws CancelledException
+         */
+        template<typename F>
+        void For(size_t begin, size_t end, F fn, size_t grain = 0) {
+            if (begin >= end) return;
+
+            grain = GrainSize(end - begin, grain);
+
+            // Nothing to split
+            if (end - begin <= grain) {
+                for (size_t i=begin; i<end; ++i) fn(i);
+                return;
+            }
+
+            Common::TaskGroup group;
+
+            size_t first = begin;
+            for (; first + grain < end; first += grain) {
+                size_t last = first + grain;
+                group.Run([&fn, first, last]() {
+                    for (size_t i=first; i<last; ++i) fn(i);
+                });
+            }
+
+            // Do the remaining part ourselves
+            Common::CheckCancellation();
+            for (size_t i=first; i<end; ++i) fn(i);
+
+            group.Wait();
+        }
+
+        /**
+            \brief Maps every i in [begin, end) with fn and combines the results
+
+            Every chunk is reduced into its own preallocated slot starting
+            from identity. The partial results are combined in the order of
+            the chunks, so the result is deterministic even if combine is
+            not commutative.
+
+            \throws The first exception that was thrown by fn or combine
+         */
+        template<typename T, typename F, typename C>
+        T Reduce(size_t begin, size_t end, T identity, F fn, C combine, size_t grain = 0) {
+            if (begin >= end) return identity;
+
+            grain = GrainSize(end - begin, grain);
+            size_t chunks = (end - begin + grain - 1) / grain;
+
+            std::vector<T> partial (chunks, identity);
+
+            For(0, chunks, [&](size_t chunk) {
+                size_t first = begin + chunk * grain;
+                size_t last = std::min(end, first + grain);
+
+                T current = identity;
+                for (size_t i=first; i<last; ++i) {
+                    current = combine(std::move(current), fn(i));
+                }
+                partial[chunk] = std::move(current);
+            }, 1);
+
+            T result = std::move(identity);
+            for (auto& p : partial) {
+                result = combine(std::move(result), std::move(p));
+            }
+            return result;
+        }
+
+        /**
+            \brief Applies fn to all the elements and returns the results in order
+
+            The result vector is allocated once up front and every task
+            writes directly into its own slots, so no locking is necessary.
+
+            \throws The first exception that was thrown by fn
+         */
+        template<typename S, typename T, typename F>
+        std::vector<S> Transform(const std::vector<T>& elements, F fn, size_t grain = 0) {
+            std::vector<S> result (elements.size());
+
+            For(0, elements.size(), [&](size_t i) {
+                result[i] = fn(elements[i]);
+            }, grain);
+
+            return result;
+        }
+
+    }
+}
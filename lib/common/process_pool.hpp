@@ -0,0 +1,362 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <algorithm>
+#include <cstdint>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <new>
+
+#include <unistd.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <common/error.hpp>
+#include <common/cancellation.hpp>
+
+namespace Construction {
+    namespace Common {
+
+        class CannotStartWorkerException : public Exception {
+        public:
+            CannotStartWorkerException() : Exception("Cannot start a worker process") { }
+        };
+
+        /**
+            \class ProcessPool
+
+            Runs jobs in forked worker processes. A crash of a worker, e.g.
+            because the kernel killed it when running out of memory, only
+            loses the job it was working on instead of the whole program.
+
+            The coordinator hands out one job at a time to every worker
+            over a pipe and reads the serialized result back from another
+            one. If a worker dies or runs out of memory, i.e. throws
+            std::bad_alloc or exceeds the memory limit of its cancellation
+            token, its job is queued again and the number of concurrent
+            workers is halved, which leaves more memory for every single
+            job. A job that still does so with a single worker, or that
+            throws any other exception, is given up and reported through
+            the failure callback.
+
+            Since fork only copies the calling thread, the coordinator must
+            not have used the Executor before: the workers would inherit
+            an executor without threads. The workers themselves are free
+            to use it. Inside the worker function, GetConcurrency returns
+            the number of workers at the time the worker was started.
+
+            Example:
+                ProcessPool pool (4, [](const std::string& job) {
+                    return Compute(job);
+                });
+
+                pool.Run(jobs, [](size_t i, const std::string& result) {
+                    ...
+                });
+         */
+        class ProcessPool {
+        public:
+            typedef std::function<std::string(const std::string&)>          WorkerFunction;
+            typedef std::function<void(size_t, const std::string&)>         ResultFunction;
+            typedef std::function<void(size_t, const std::string&)>         FailureFunction;
+        public:
+            ProcessPool(unsigned concurrency, WorkerFunction work) : concurrency(std::max(1u, concurrency)), work(work) { }
+
+            ProcessPool(const ProcessPool&) = delete;
+            ProcessPool& operator=(const ProcessPool&) = delete;
+        public:
+            unsigned GetConcurrency() const { return concurrency; }
+        public:
+            /**
+                \brief Runs all the jobs and returns once every one either succeeded or was given up
+
+                The callbacks are called on the calling thread in the order
+                in which the results arrive.
+
+                \throws CannotStartWorkerException
+             */
+            void Run(const std::vector<std::string>& jobs, ResultFunction onResult, FailureFunction onFailure = FailureFunction()) {
+                // Writing to a crashed worker must not kill the coordinator
+                auto previousHandler = std::signal(SIGPIPE, SIG_IGN);
+
+                std::deque<size_t> queue;
+                for (size_t i=0; i<jobs.size(); ++i) queue.push_back(i);
+
+                std::vector<Worker> workers;
+                size_t remaining = jobs.size();
+
+                while (remaining > 0) {
+                    // Shut down idle workers above the limit and start new ones below
+                    for (auto it = workers.begin(); it != workers.end() && workers.size() > concurrency; ) {
+                        if (it->busy) { ++it; continue; }
+                        Stop(*it);
+                        it = workers.erase(it);
+                    }
+
+                    while (workers.size() < std::min<size_t>(concurrency, queue.size() + Busy(workers))) {
+                        workers.push_back(Start(workers));
+                    }
+
+                    // Hand out jobs to idle workers
+                    for (auto& worker : workers) {
+                        if (worker.busy || queue.empty()) continue;
+
+                        worker.job = queue.front();
+                        queue.pop_front();
+                        worker.busy = true;
+
+                        if (!WriteMessage(worker.input, SUCCESS, jobs[worker.job])) {
+                            worker.crashed = true;
+                        }
+                    }
+
+                    // Wait for the next result
+                    std::vector<pollfd> fds;
+                    for (auto& worker : workers) {
+                        pollfd fd;
+                        fd.fd = worker.output;
+                        fd.events = POLLIN;
+                        fd.revents = 0;
+                        fds.push_back(fd);
+                    }
+
+                    bool crashed = std::any_of(workers.begin(), workers.end(), [](const Worker& w) { return w.crashed; });
+
+                    if (!crashed && poll(fds.data(), fds.size(), -1) < 0) {
+                        if (errno == EINTR) continue;
+
+                        // No result can arrive anymore, give up all the remaining jobs
+                        std::string message = std::string("Cannot wait for the workers: ") + std::strerror(errno);
+
+                        for (auto& worker : workers) {
+                            if (worker.busy && onFailure) onFailure(worker.job, message);
+
+                            worker.busy = false;
+                            worker.crashed = true;
+                        }
+
+                        for (auto job : queue) {
+                            if (onFailure) onFailure(job, message);
+                        }
+
+                        queue.clear();
+                        remaining = 0;
+                        break;
+                    }
+
+                    for (size_t i=0; i<workers.size(); ++i) {
+                        auto& worker = workers[i];
+
+                        // An idle worker should not go away on its own
+                        if (!worker.busy) {
+                            if (fds[i].revents & (POLLHUP | POLLERR)) worker.crashed = true;
+                            continue;
+                        }
+                        if (!worker.crashed && !(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+
+                        char status = FAILURE;
+                        std::string message = "The worker process died";
+
+                        if (worker.crashed || !ReadMessage(worker.output, status, message)) {
+                            status = CRASHED;
+                            worker.crashed = true;
+                        }
+
+                        worker.busy = false;
+
+                        if (status == SUCCESS) {
+                            --remaining;
+                            onResult(worker.job, message);
+                            continue;
+                        }
+
+                        // Retry with less concurrent workers if the memory was the
+                        // problem, or give up
+                        if ((status == CRASHED || status == OUT_OF_MEMORY) && concurrency > 1) {
+                            concurrency = std::max(1u, concurrency / 2);
+                            queue.push_front(worker.job);
+                        } else {
+                            --remaining;
+                            if (onFailure) onFailure(worker.job, message);
+                        }
+                    }
+
+                    // Clean up the crashed workers
+                    for (auto it = workers.begin(); it != workers.end(); ) {
+                        if (!it->crashed) { ++it; continue; }
+                        Stop(*it);
+                        it = workers.erase(it);
+                    }
+                }
+
+                for (auto& worker : workers) {
+                    Stop(worker);
+                }
+
+                std::signal(SIGPIPE, previousHandler);
+            }
+        private:
+            enum Status {
+                SUCCESS = 0,
+                FAILURE = 1,
+                CRASHED = 2,
+                OUT_OF_MEMORY = 3
+            };
+
+            struct Worker {
+                pid_t pid;
+                int input;
+                int output;
+
+                bool busy;
+                bool crashed;
+                size_t job;
+            };
+
+            static size_t Busy(const std::vector<Worker>& workers) {
+                return std::count_if(workers.begin(), workers.end(), [](const Worker& w) { return w.busy; });
+            }
+
+            Worker Start(const std::vector<Worker>& others) {
+                int input[2], output[2];
+
+                if (pipe(input) != 0) throw CannotStartWorkerException();
+                if (pipe(output) != 0) {
+                    close(input[0]); close(input[1]);
+                    throw CannotStartWorkerException();
+                }
+
+                pid_t pid = fork();
+                if (pid < 0) {
+                    close(input[0]); close(input[1]);
+                    close(output[0]); close(output[1]);
+                    throw CannotStartWorkerException();
+                }
+
+                if (pid == 0) {
+                    // The pipes of the other workers must not stay open here,
+                    // otherwise they would never see the end of their input
+                    for (auto& worker : others) {
+                        close(worker.input);
+                        close(worker.output);
+                    }
+
+                    close(input[1]);
+                    close(output[0]);
+
+                    RunWorker(input[0], output[1]);
+                }
+
+                close(input[0]);
+                close(output[1]);
+
+                Worker worker;
+                worker.pid = pid;
+                worker.input = input[1];
+                worker.output = output[0];
+                worker.busy = false;
+                worker.crashed = false;
+                worker.job = 0;
+                return worker;
+            }
+
+            void Stop(Worker& worker) {
+                // Closing the input lets an idle worker terminate on its own
+                close(worker.input);
+                close(worker.output);
+
+                if (worker.crashed) kill(worker.pid, SIGKILL);
+
+                int status;
+                while (waitpid(worker.pid, &status, 0) < 0 && errno == EINTR);
+            }
+
+            /**
+                Main loop of the worker processes. Never returns.
+             */
+            void RunWorker(int input, int output) {
+                char status;
+                std::string job;
+
+                while (ReadMessage(input, status, job)) {
+                    std::string result;
+
+                    try {
+                        result = work(job);
+                        status = SUCCESS;
+                    } catch (const std::bad_alloc& e) {
+                        result = "Out of memory";
+                        status = OUT_OF_MEMORY;
+                    } catch (const MemoryLimitExceededException& e) {
+                        result = e.what();
+                        status = OUT_OF_MEMORY;
+                    } catch (std::exception& e) {
+                        result = e.what();
+                        status = FAILURE;
+                    } catch (...) {
+                        result = "Unknown error";
+                        status = FAILURE;
+                    }
+
+                    if (!WriteMessage(output, status, result)) break;
+                }
+
+                _exit(0);
+            }
+        private:
+            /**
+                Messages are a status byte, the length of the payload and the payload itself
+             */
+            static bool WriteMessage(int fd, char status, const std::string& payload) {
+                uint64_t size = payload.size();
+
+                return WriteAll(fd, &status, 1) &&
+                       WriteAll(fd, reinterpret_cast<const char*>(&size), sizeof(size)) &&
+                       WriteAll(fd, payload.data(), payload.size());
+            }
+
+            static bool ReadMessage(int fd, char& status, std::string& payload) {
+                uint64_t size;
+
+                if (!ReadAll(fd, &status, 1)) return false;
+                if (!ReadAll(fd, reinterpret_cast<char*>(&size), sizeof(size))) return false;
+
+                payload.assign(size, ' ');
+                return ReadAll(fd, &payload[0], size);
+            }
+
+            static bool WriteAll(int fd, const char* data, size_t size) {
+                while (size > 0) {
+                    auto n = write(fd, data, size);
+                    if (n < 0 && errno == EINTR) continue;
+                    if (n <= 0) return false;
+
+                    data += n;
+                    size -= n;
+                }
+                return true;
+            }
+
+            static bool ReadAll(int fd, char* data, size_t size) {
+                while (size > 0) {
+                    auto n = read(fd, data, size);
+                    if (n < 0 && errno == EINTR) continue;
+                    if (n <= 0) return false;
+
+                    data += n;
+                    size -= n;
+                }
+                return true;
+            }
+        private:
+            unsigned concurrency;
+            WorkerFunction work;
+        };
+
+    }
+}
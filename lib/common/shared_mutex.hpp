@@ -0,0 +1,85 @@
+#pragma once
+
+#include <mutex>
+#include <condition_variable>
+
+namespace Construction {
+    namespace Common {
+
+        /**
+            \class SharedMutex
+
+            Readers-writer lock. Any number of readers can hold the lock
+            at the same time, a writer holds it exclusively. Waiting
+            writers are preferred, so a steady stream of readers cannot
+            starve them.
+
+            It can be used with std::unique_lock for exclusive and with
+            SharedLock for shared access.
+         */
+        class SharedMutex {
+        public:
+            SharedMutex() : readers(0), writersWaiting(0), writing(false) { }
+
+            SharedMutex(const SharedMutex&) = delete;
+            SharedMutex& operator=(const SharedMutex&) = delete;
+        public:
+            void lock() {
+                std::unique_lock<std::mutex> guard(mutex);
+
+                writersWaiting++;
+                condition.wait(guard, [this]() { return !writing && readers == 0; });
+                writersWaiting--;
+
+                writing = true;
+            }
+
+            void unlock() {
+                std::unique_lock<std::mutex> guard(mutex);
+                writing = false;
+                condition.notify_all();
+            }
+
+            void lock_shared() {
+                std::unique_lock<std::mutex> guard(mutex);
+                condition.wait(guard, [this]() { return !writing && writersWaiting == 0; });
+                readers++;
+            }
+
+            void unlock_shared() {
+                std::unique_lock<std::mutex> guard(mutex);
+                readers--;
+                if (readers == 0) condition.notify_all();
+            }
+        private:
+            std::mutex mutex;
+            std::condition_variable condition;
+
+            unsigned readers;
+            unsigned writersWaiting;
+            bool writing;
+        };
+
+        /**
+            \class SharedLock
+
+            Scope based shared locking of a SharedMutex
+         */
+        class SharedLock {
+        public:
+            SharedLock(SharedMutex& mutex) : mutex(mutex) {
+                mutex.lock_shared();
+            }
+
+            ~SharedLock() {
+                mutex.unlock_shared();
+            }
+
+            SharedLock(const SharedLock&) = delete;
+            SharedLock& operator=(const SharedLock&) = delete;
+        private:
+            SharedMutex& mutex;
+        };
+
+    }
+}
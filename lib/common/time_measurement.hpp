@@ -28,6 +28,14 @@ namespace Construction {
                 return stopped;
             }
 
+            /**
+                \brief Returns the measured time, or the time until now if still running
+             */
+            double Seconds() const {
+                auto end = stopped ? end_time : std::chrono::high_resolution_clock::now();
+                return std::chrono::duration<double>(end - start_time).count();
+            }
+
             friend std::ostream& operator<<(std::ostream& os, const TimeMeasurement& time) {
                 if (time.stopped) {
                     auto millisecs = std::chrono::duration_cast<std::chrono::milliseconds>(time.end_time-time.start_time).count();
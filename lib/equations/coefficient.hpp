@@ -6,12 +6,22 @@
 #include <functional>
 #include <random>
 #include <memory>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <condition_variable>
+#include <unordered_set>
+#include <atomic>
+#include <set>
+
+#include <unistd.h>
 
 #include <common/uuid.hpp>
 #include <language/session.hpp>
 #include <tensor/index.hpp>
 #include <tensor/tensor.hpp>
 #include <language/api.hpp>
+#include <equations/coefficient_store.hpp>
 
 using Construction::Common::Unique;
 using Construction::Language::Session;
@@ -21,6 +31,115 @@ using Construction::Tensor::Indices;
 namespace Construction {
     namespace Equations {
 
+        /**
+            \class CoefficientShape
+
+            \brief The calculation shared by all coefficients with the same block sizes
+
+            Coefficients with the same index blocks but different ids,
+            e.g. #<lambda:2:0:2:0> and #<mu:2:0:2:0>, are identical up to
+            the names of their variables. The simplified tensor is thus
+            calculated once per shape and each coefficient only renames
+            its variables.
+         */
+        class CoefficientShape {
+        public:
+            CoefficientShape(unsigned l, unsigned ld, unsigned r, unsigned rd, const std::shared_ptr<CoefficientStore>& store = nullptr)
+                : l(l), ld(ld), r(r), rd(rd), store(store) { }
+        public:
+            // Is the simplified tensor available?
+            bool IsFinished() const {
+                std::unique_lock<std::mutex> lock(resultMutex);
+                return result != nullptr;
+            }
+        public:
+            /**
+                \brief Returns the simplified tensor
+
+                The first call calculates the tensor, or takes it from the
+                coefficient store, every other call blocks until it is
+                available. If the calculation throws, the exception is
+                passed on and the next call tries again.
+             */
+            Tensor::Tensor Get() {
+                std::unique_lock<std::mutex> lock(mutex);
+
+                {
+                    std::unique_lock<std::mutex> resultLock(resultMutex);
+                    if (result) return *result;
+                }
+
+                auto simplified = Calculate();
+
+                {
+                    std::unique_lock<std::mutex> resultLock(resultMutex);
+                    result = std::make_shared<Tensor::Tensor>(simplified);
+                }
+
+                return simplified;
+            }
+        private:
+            /**
+                Calculates the tensor with the correct symmetries
+             */
+            Tensor::Tensor Calculate() const {
+                // Look for the result of an earlier run
+                auto key = CoefficientStore::Key("apple", { l, ld, r, rd });
+                Tensor::Tensor simplified;
+
+                if (store && store->Lookup(key, simplified)) return simplified;
+
+                // Get index blocks
+                auto block1 = Construction::Tensor::Indices::GetRomanSeries(l, {1,3});
+                auto block2 = Construction::Tensor::Indices::GetRomanSeries(ld, {1,3}, l);
+                auto block3 = Construction::Tensor::Indices::GetRomanSeries(r, {1,3}, l+ld);
+                auto block4 = Construction::Tensor::Indices::GetRomanSeries(rd, {1,3}, l+ld+r);
+
+                // Generate all the indices
+                auto indices = block1;
+                indices.Append(block2);
+                indices.Append(block3);
+                indices.Append(block4);
+
+                // Generate the tensors
+                Tensor::Tensor tensor = Construction::Language::API::Arbitrary(indices);
+
+                // Symmetrize the blocks if necessary
+                if (block1.Size() > 1) tensor = tensor.Symmetrize(block1);
+                if (block2.Size() > 1) tensor = tensor.Symmetrize(block2);
+                if (block3.Size() > 1) tensor = tensor.Symmetrize(block3);
+                if (block4.Size() > 1) tensor = tensor.Symmetrize(block4);
+
+                // Do the block exchange
+                auto exchanged = block3;
+                exchanged.Append(block4);
+                exchanged.Append(block1);
+                exchanged.Append(block2);
+
+                tensor = tensor.ExchangeSymmetrize(indices, exchanged);
+
+                // Simplify
+                simplified = tensor.Simplify();
+
+                if (store) store->Store(key, simplified);
+
+                return simplified;
+            }
+        private:
+            unsigned l, ld, r, rd;
+
+            // Results of earlier runs, might be empty
+            std::shared_ptr<CoefficientStore> store;
+
+            // Held during the calculation
+            std::mutex mutex;
+
+            mutable std::mutex resultMutex;
+            std::shared_ptr<Tensor::Tensor> result;
+        };
+
+        typedef std::shared_ptr<CoefficientShape>   CoefficientShapeReference;
+
         /**
             \class Coefficient
 
@@ -41,12 +160,13 @@ namespace Construction {
                 DEFERRED = 1,
                 CALCULATING = 2,
                 FINISHED = 3,
-                ABORTED = 4
+                ABORTED = 4,
+                SCHEDULED = 5
             };
         public:
             // Constructor
-            Coefficient(unsigned l, unsigned ld, unsigned r, unsigned rd, const std::string& id)
-                : l(l), ld(ld), r(r), rd(rd), id(id), state(DEFERRED)
+            Coefficient(unsigned l, unsigned ld, unsigned r, unsigned rd, const std::string& id, const std::shared_ptr<Session>& session, const CoefficientShapeReference& shape)
+                : state(DEFERRED), session(session), shape(shape), l(l), ld(ld), r(r), rd(rd), id(id)
             {
                 // Generate random name
                 name = id + GetRandomString(4);
@@ -68,6 +188,9 @@ namespace Construction {
 
             // Is the coefficient calculation aborted due to an error?
             bool IsAborted() const { return state == ABORTED; }
+
+            // Is the coefficient waiting in the scheduler?
+            bool IsScheduled() const { return state == SCHEDULED; }
         public:
             // Return a pointer to the coefficient
             std::shared_ptr<Coefficient> GetReference() {
@@ -81,6 +204,8 @@ namespace Construction {
                 state of the tensor changes
              */
             void RegisterObserver(ObserverFunction observer) {
+                // Do not change the observers while they are notified
+                std::unique_lock<std::mutex> lock(mutex);
                 observers.push_back(observer);
             }
         private:
@@ -99,11 +224,12 @@ namespace Construction {
             }
         public:
             /**
-                Start the calculation of the coefficient in a new thread
+                Mark the coefficient as queued for calculation. The
+                calculation itself is started by the Scheduler.
              */
-            void Start() {
-                // Start calculation in thread
-                thread = std::thread(&Coefficient::Calculate, this);
+            void Schedule() {
+                std::unique_lock<std::mutex> lock(mutex);
+                if (state == DEFERRED) state = SCHEDULED;
             }
 
             /**
@@ -114,11 +240,71 @@ namespace Construction {
                 std::unique_lock<std::mutex> lock(mutex);
 
                 variable.wait(lock, [&]() {
-                    return state != CALCULATING;
+                    return state != CALCULATING && state != SCHEDULED;
                 });
             }
+        public:
+            /**
+                \brief Estimates the relative cost of the calculation
+
+                The dominant steps are the symmetrizations, which touch
+                every basis tensor once per permutation of a block, and
+                the simplification, which evaluates every basis tensor for
+                all 3^N index combinations.
+             */
+            double GetCost() const {
+                // Only the variables have to be renamed
+                if (shape->IsFinished()) return 0;
+
+                unsigned N = l + ld + r + rd;
+
+                double permutations = Factorial(l) + Factorial(ld) + Factorial(r) + Factorial(rd) + 2;
+                return NumberOfBaseTensors(N) * (permutations + std::pow(3.0, N));
+            }
+
+            /**
+                \brief Estimates the peak memory of the calculation in bytes
+
+                This is the size of the (dense) matrix in the simplification,
+                which is an upper bound for its sparse representation.
+             */
+            size_t GetMemoryEstimate() const {
+                // Only the variables have to be renamed
+                if (shape->IsFinished()) return 0;
+
+                unsigned N = l + ld + r + rd;
+                return static_cast<size_t>(NumberOfBaseTensors(N) * std::pow(3.0, N) * sizeof(float));
+            }
+        private:
+            static double Factorial(unsigned n) {
+                double result = 1;
+                for (unsigned i=2; i<=n; i++) result *= i;
+                return result;
+            }
+
+            static double DoubleFactorial(int n) {
+                double result = 1;
+                for (int i=n; i>1; i-=2) result *= i;
+                return result;
+            }
+
+            /**
+                Number of epsilon gamma tensors with N indices, i.e. the
+                number of summands of Arbitrary
+             */
+            static double NumberOfBaseTensors(unsigned N) {
+                if (N == 0) return 1;
+                if (N % 2 == 0) return DoubleFactorial(N - 1);
+                if (N < 3) return 0;
+
+                // Choose the indices of the epsilon, pair up the rest
+                return Factorial(N) / (Factorial(3) * Factorial(N-3)) * DoubleFactorial(N - 4);
+            }
         public:
             std::string GetName() const { return name; }
+
+            // The calculation shared with the other coefficients of the same block sizes
+            const CoefficientShapeReference& GetShape() const { return shape; }
         public:
             /**
                 Returns the tensor if it was calculated, otherwise it blocks
@@ -129,7 +315,7 @@ namespace Construction {
                 // Wait to be finished
                 Wait();
 
-                return (state == FINISHED) ? tensor : nullptr;
+                return GetAsync();
             }
 
             /**
@@ -137,11 +323,17 @@ namespace Construction {
                 without blocking the main thread
              */
             std::shared_ptr<Tensor::Tensor> GetAsync() {
-                return (state == FINISHED) ? tensor : nullptr;
+                if (state != FINISHED) return nullptr;
+
+                std::unique_lock<std::mutex> lock(tensorMutex);
+                return tensor;
             }
 
             inline void SetTensor(Tensor::Tensor tensor) {
-                this->tensor = std::make_shared<Tensor::Tensor>(tensor);
+                auto result = std::make_shared<Tensor::Tensor>(tensor);
+
+                std::unique_lock<std::mutex> lock(tensorMutex);
+                this->tensor = result;
             }
 
             void Lock() {
@@ -151,18 +343,20 @@ namespace Construction {
             void Unlock() {
                 readMutex.unlock();
             }
-        private:
+        public:
             /**
                 \brief Calculates the actual tensor with the correct symmetries
 
-                Calculates the actual tensor with the correct symmetries. It
-                shall not be used outside of the Start method, since this will
-                generate the thread in the correct fashion and garantuees the
-                deferred calculation to work.
+                Calculates the actual tensor with the correct symmetries on
+                the calling thread. It shall not be used outside of the
+                Scheduler, which decides when there are enough resources for
+                the calculation.
 
-                In between steps, the tensor will be stored on disk s.t. a
-                new start of the program does not require us to calculate this
-                coefficient again.
+                The simplified tensor is shared with all coefficients of the
+                same shape and kept in the coefficient store, s.t. a new start
+                of the program does not require us to calculate this
+                coefficient again. Only the variables get new names, since
+                several coefficients of the same shape are independent.
              */
             void Calculate() {
                 // Lock the mutex
@@ -172,75 +366,18 @@ namespace Construction {
                     // Set the state to calculating
                     state = CALCULATING;
 
-                    // Get index blocks
-                    auto block1 = Construction::Tensor::Indices::GetRomanSeries(l, {1,3});
-                    auto block2 = Construction::Tensor::Indices::GetRomanSeries(ld, {1,3}, l);
-                    auto block3 = Construction::Tensor::Indices::GetRomanSeries(r, {1,3}, l+ld);
-                    auto block4 = Construction::Tensor::Indices::GetRomanSeries(rd, {1,3}, l+ld+r);
-
-                    // Generate all the indices
-                    auto indices = block1;
-                    indices.Append(block2);
-                    indices.Append(block3);
-                    indices.Append(block4);
-
-                    // Generate current string
-                    std::string currentCmd = "Arbitrary({" + indices.ToString().substr(1) + ")";
-
-                    // Generate the tensors
-                    tensor = std::make_shared<Construction::Tensor::Tensor>(Construction::Language::API::Arbitrary(indices));
-
-                    // Update the session of the coefficient
-                    //session.SetCurrent(currentCmd, *tensor);
-
-                    // Symmetrize first block if necessary
-                    if (block1.Size() > 1) {
-                        currentCmd = "Symmetrize(%, " + block1.ToString().substr(1) + "})";
-                        tensor = std::make_shared<Construction::Tensor::Tensor>(tensor->Symmetrize(block1));
-
-                        //session.SetCurrent(currentCmd, *tensor);
-                    }
-
-                    // Symmetrize second block if necessary
-                    if (block2.Size() > 1) {
-                        currentCmd = "Symmetrize(%, " + block2.ToString().substr(1) + "})";
-                        tensor = std::make_shared<Construction::Tensor::Tensor>(tensor->Symmetrize(block2));
-
-                        //session.SetCurrent(currentCmd, *tensor);
-                    }
-
-                    // Symmetrize first block if necessary
-                    if (block3.Size() > 1) {
-                        currentCmd = "Symmetrize(%, " + block3.ToString().substr(1) + "})";
-                        tensor = std::make_shared<Construction::Tensor::Tensor>(tensor->Symmetrize(block3));
-
-                        //session.SetCurrent(currentCmd, *tensor);
-                    }
+                    // Calculate the shape or wait for another coefficient of it
+                    auto simplified = shape->Get();
 
-                    // Symmetrize first block if necessary
-                    if (block4.Size() > 1) {
-                        currentCmd = "Symmetrize(%, " + block4.ToString().substr(1) + "})";
-                        tensor = std::make_shared<Construction::Tensor::Tensor>(tensor->Symmetrize(block4));
+                    // Redefine variables
+                    auto result = std::make_shared<Construction::Tensor::Tensor>(simplified.RedefineVariables(GetRandomString()));
 
-                        //session.SetCurrent(currentCmd, *tensor);
+                    {
+                        std::unique_lock<std::mutex> tensorLock(tensorMutex);
+                        tensor = result;
                     }
 
-                    // Do the block exchange
-                    auto exchanged = block3;
-                    exchanged.Append(block4);
-                    exchanged.Append(block1);
-                    exchanged.Append(block2);
-
-                    currentCmd = "ExchangeSymmetrize(%, " + indices.ToString().substr(1) + "}, " + exchanged.ToString().substr(1) +"})";
-                    tensor = std::make_shared<Construction::Tensor::Tensor>(tensor->ExchangeSymmetrize(indices, exchanged));
-
-                    //session.SetCurrent(currentCmd, *tensor);
-
-                    // Simplify and redefine variables
-                    currentCmd = "LinearIndependent(%)";
-                    tensor = std::make_shared<Construction::Tensor::Tensor>(tensor->Simplify().RedefineVariables(GetRandomString()));
-
-                    Session::Instance()->Get(name) = *tensor;
+                    session->Set(name, *result);
                     //session.SetCurrent(currentCmd, *tensor);
                 } catch(...) {
                     // In case of exception, just set the calculation to aborted
@@ -290,6 +427,7 @@ namespace Construction {
                 ss << "#<" << id << ":" << l << ":" << ld << ":" << ":" << r << ":" << rd << ">";
 
                 if (state == FINISHED) {
+                    std::unique_lock<std::mutex> lock(tensorMutex);
                     ss << " = " << tensor->ToString();
                 }
 
@@ -300,10 +438,15 @@ namespace Construction {
             std::mutex readMutex;
 
             std::condition_variable variable;
-            std::thread thread;
 
-            //Session session;
-            State state;
+            // Read without the mutex, which is held during the calculation
+            std::atomic<State> state;
+
+            // The session the result is published to
+            std::shared_ptr<Session> session;
+
+            // The calculation shared with other coefficients
+            CoefficientShapeReference shape;
 
             std::vector<ObserverFunction> observers;
 
@@ -311,20 +454,177 @@ namespace Construction {
             std::string id;
             std::string name;
 
+            mutable std::mutex tensorMutex;
             std::shared_ptr<Tensor::Tensor> tensor;
         };
 
         typedef std::shared_ptr<Coefficient>   CoefficientReference;
 
+        /**
+            \class Scheduler
+
+            \brief Runs the calculation of coefficients on a bounded set of threads
+
+            The coefficients are ordered by their estimated cost and the
+            most expensive ones are started first, since they determine
+            the total runtime. At most one calculation per core runs at
+            the same time and the estimated memory of all running
+            calculations has to fit into the memory budget. If the next
+            large coefficient does not fit, smaller ones that do are
+            started in the meantime. A coefficient that exceeds the
+            budget on its own is only started when nothing else runs.
+
+            The calculations themselves use the process-wide executor
+            for their parallel parts.
+         */
+        class Scheduler {
+        public:
+            Scheduler(unsigned workers = std::thread::hardware_concurrency(), size_t memoryBudget = GetDefaultMemoryBudget())
+                : workers(std::max(1u, workers)), memoryBudget(memoryBudget), memoryUsed(0), running(0), alive(0) { }
+
+            ~Scheduler() {
+                for (auto& thread : threads) {
+                    if (thread.joinable()) thread.join();
+                }
+            }
+        public:
+            /**
+                \brief Queues the coefficients and returns immediately
+             */
+            void Schedule(const std::vector<CoefficientReference>& coefficients) {
+                std::unique_lock<std::mutex> lock(mutex);
+
+                for (auto& coefficient : coefficients) {
+                    coefficient->Schedule();
+                    pending.push_back(coefficient);
+                }
+
+                // Most expensive first. The costs change once a shape is
+                // finished on a worker, so they are taken beforehand.
+                std::vector<std::pair<double, CoefficientReference>> costs;
+                for (auto& coefficient : pending) {
+                    costs.push_back({ coefficient->GetCost(), coefficient });
+                }
+
+                std::stable_sort(costs.begin(), costs.end(), [](const std::pair<double, CoefficientReference>& a, const std::pair<double, CoefficientReference>& b) {
+                    return a.first > b.first;
+                });
+
+                for (int i=0; i<costs.size(); i++) {
+                    pending[i] = costs[i].second;
+                }
+
+                // Join the workers that ran out of work
+                for (auto it = threads.begin(); it != threads.end(); ) {
+                    if (finished.count(it->get_id()) > 0) {
+                        finished.erase(it->get_id());
+                        it->join();
+                        it = threads.erase(it);
+                    } else ++it;
+                }
+
+                // Start as many threads as useful
+                while (alive < workers && alive < pending.size() + running) {
+                    alive++;
+                    threads.emplace_back(&Scheduler::Work, this);
+                }
+
+                condition.notify_all();
+            }
+
+            /**
+                \brief Returns 3/4 of the physical memory
+             */
+            static size_t GetDefaultMemoryBudget() {
+                return static_cast<size_t>(sysconf(_SC_PHYS_PAGES)) * static_cast<size_t>(sysconf(_SC_PAGESIZE)) / 4 * 3;
+            }
+        private:
+            /**
+                Returns the position of the largest pending coefficient
+                that fits into the remaining memory, or -1 if none does.
+                Coefficients whose shape is currently calculated wait for
+                it, they are cheap afterwards.
+             */
+            int Next() const {
+                for (int i=0; i<pending.size(); i++) {
+                    // Do not block a worker on a shape another one calculates
+                    if (shapes.count(pending[i]->GetShape().get()) > 0) continue;
+
+                    if (memoryUsed + pending[i]->GetMemoryEstimate() <= memoryBudget) return i;
+                }
+
+                // If nothing runs, the largest one has to go on its own
+                if (running == 0 && pending.size() > 0) return 0;
+
+                return -1;
+            }
+
+            void Work() {
+                std::unique_lock<std::mutex> lock(mutex);
+
+                while (pending.size() > 0) {
+                    int next = Next();
+
+                    // Wait for a running calculation to free its memory
+                    if (next < 0) {
+                        condition.wait(lock);
+                        continue;
+                    }
+
+                    auto coefficient = pending[next];
+                    pending.erase(pending.begin() + next);
+
+                    size_t memory = coefficient->GetMemoryEstimate();
+                    memoryUsed += memory;
+                    running++;
+                    shapes.insert(coefficient->GetShape().get());
+
+                    lock.unlock();
+                    coefficient->Calculate();
+                    lock.lock();
+
+                    memoryUsed -= memory;
+                    running--;
+                    shapes.erase(coefficient->GetShape().get());
+
+                    condition.notify_all();
+                }
+
+                alive--;
+                finished.insert(std::this_thread::get_id());
+            }
+        private:
+            unsigned workers;
+            size_t memoryBudget;
+            size_t memoryUsed;
+            unsigned running;
+            unsigned alive;
+
+            std::vector<CoefficientReference> pending;
+            std::vector<std::thread> threads;
+
+            // The workers that left Work and can be joined
+            std::set<std::thread::id> finished;
+
+            // The shapes of the running calculations
+            std::unordered_set<CoefficientShape*> shapes;
+
+            std::mutex mutex;
+            std::condition_variable condition;
+        };
+
         /**
             \class Coefficients
 
             \brief Singleton class that stores all coefficients
 
             Singleton class that stores all coefficients with a given index
-            structure.
+            structure. Coefficients with the same block sizes but
+            different ids share their calculation.
          */
         class Coefficients : public Singleton<Coefficients> {
+        public:
+            Coefficients() : session(std::make_shared<Session>()), store(std::make_shared<CoefficientStore>()) { }
         public:
             struct Definition {
                 unsigned l;
@@ -354,26 +654,57 @@ namespace Construction {
                 if (it != map.end()) {
                     return it->second;
                 } else {
-                    CoefficientReference ref = std::make_shared<Coefficient>(l, ld, r, rd, id);
+                    CoefficientReference ref = std::make_shared<Coefficient>(l, ld, r, rd, id, session, GetShape(l, ld, r, rd));
                     map.insert({ d, ref });
                     return ref;
                 }
             }
+        private:
+            /**
+                Returns the calculation shared by all coefficients with
+                the given block sizes
+             */
+            CoefficientShapeReference GetShape(unsigned l, unsigned ld, unsigned r, unsigned rd) {
+                Definition d;
+                d.l = l; d.ld = ld; d.r = r; d.rd = rd;
+
+                auto it = shapes.find(d);
+                if (it != shapes.end()) return it->second;
+
+                auto shape = std::make_shared<CoefficientShape>(l, ld, r, rd, store);
+                shapes.insert({ d, shape });
+                return shape;
+            }
+        public:
 
             /**
                 Start the calculation of all coefficients that were not
-                started yet.
+                started yet. The scheduler decides about the order.
              */
             void StartAll() {
+                std::vector<CoefficientReference> deferred;
+
                 for (auto& it : map) {
                     if (it.second->IsDeferred()) {
-                        // Start
-                        it.second->Start();
+                        deferred.push_back(it.second);
                     }
                 }
+
+                scheduler.Schedule(deferred);
             }
 
             size_t Size() const { return map.size(); }
+
+            /**
+                Returns the session that contains all the calculated
+                coefficients under their names
+             */
+            Session& GetSession() { return *session; }
+
+            /**
+                \brief Sets the store for the results of the following coefficients, nullptr disables it
+             */
+            void SetStore(const std::shared_ptr<CoefficientStore>& store) { this->store = store; }
         public:
             std::unordered_map<Definition, CoefficientReference, DefinitionHasher>::iterator begin() { return map.begin(); }
             std::unordered_map<Definition, CoefficientReference, DefinitionHasher>::iterator end() { return map.end(); }
@@ -382,6 +713,11 @@ namespace Construction {
             std::unordered_map<Definition, CoefficientReference, DefinitionHasher>::const_iterator end() const { return map.end(); }
         private:
             std::unordered_map<Definition, CoefficientReference, DefinitionHasher> map;
+            std::unordered_map<Definition, CoefficientShapeReference, DefinitionHasher> shapes;
+            std::shared_ptr<Session> session;
+            std::shared_ptr<CoefficientStore> store;
+
+            Scheduler scheduler;
         };
 
     }
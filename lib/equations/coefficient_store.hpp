@@ -0,0 +1,150 @@
+#pragma once
+
+#include <string>
+#include <sstream>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+
+#include <tensor/tensor.hpp>
+#include <tensor/tensor_database.hpp>
+
+using Construction::Tensor::TensorDatabase;
+using Construction::Tensor::TensorContainer;
+
+namespace Construction {
+    namespace Equations {
+
+        /**
+            \class CoefficientStore
+
+            \brief Keeps calculated coefficients on disk for later runs
+
+            The coefficients only depend on the sizes of their index
+            blocks, so once calculated they can be reused by every later
+            run and every other system of equations. The store is a
+            tensor database whose keys name the program, the algorithm
+            version and the block sizes, e.g.
+
+                apple:1:2,0,2,0
+
+            and optionally a stage of the calculation. Increase
+            AlgorithmVersion whenever a change in the algorithms changes
+            the results, older entries are then ignored.
+
+            Several threads and processes can use the same store at once.
+            Reading takes a shared lock on a lock file next to the
+            database, storing an exclusive one. Storing appends the entry
+            to the database, see TensorDatabase::Append, so it neither
+            rewrites the other entries nor loses the ones written by
+            other processes in the meantime.
+
+            Errors while reading or writing are not reported, the store is
+            only an optimization.
+         */
+        class CoefficientStore {
+        public:
+            static const unsigned AlgorithmVersion = 1;
+        public:
+            CoefficientStore(const std::string& filename = "coefficients.db") : filename(filename) { }
+        public:
+            /**
+                \brief Returns the key for the given block sizes and stage
+             */
+            static std::string Key(const std::string& program, const std::vector<unsigned>& blocks, const std::string& stage = "") {
+                std::stringstream ss;
+                ss << program << ":" << AlgorithmVersion << ":";
+
+                for (unsigned i=0; i<blocks.size(); i++) {
+                    if (i > 0) ss << ",";
+                    ss << blocks[i];
+                }
+
+                if (stage != "") ss << ":" << stage;
+
+                return ss.str();
+            }
+        public:
+            /**
+                \brief Looks up the tensor stored under the key
+
+                Returns false if there is none.
+             */
+            bool Lookup(const std::string& key, Tensor::Tensor& result) const {
+                FileLock fileLock (filename + ".lock", LOCK_SH);
+
+                try {
+                    TensorDatabase database;
+                    database.Open(filename);
+
+                    if (!database.Contains(key)) return false;
+
+                    const TensorDatabase& constDatabase = database;
+                    auto container = constDatabase[key];
+                    if (container.Size() != 1) return false;
+
+                    result = container[0];
+                    return true;
+                } catch (...) {
+                    return false;
+                }
+            }
+
+            /**
+                \brief Stores the tensor under the key
+             */
+            void Store(const std::string& key, const Tensor::Tensor& tensor) {
+                FileLock fileLock (filename + ".lock", LOCK_EX);
+
+                try {
+                    TensorDatabase database;
+
+                    TensorContainer container;
+                    container.Insert(tensor);
+
+                    bool exists = true;
+
+                    try {
+                        database.Open(filename);
+                    } catch (...) {
+                        exists = false;
+                    }
+
+                    if (exists) {
+                        database.Append(key, container);
+                    } else {
+                        database[key] = container;
+                        database.SaveToFile(filename);
+                    }
+                } catch (...) {
+                    // The store is only an optimization
+                }
+            }
+        private:
+            /**
+                Holds an advisory lock on a file for its lifetime
+             */
+            class FileLock {
+            public:
+                FileLock(const std::string& filename, int operation) {
+                    fd = open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+                    if (fd >= 0) flock(fd, operation);
+                }
+
+                ~FileLock() {
+                    if (fd < 0) return;
+
+                    flock(fd, LOCK_UN);
+                    close(fd);
+                }
+            private:
+                int fd;
+            };
+        private:
+            std::string filename;
+        };
+
+    }
+}
@@ -2,6 +2,10 @@
 
 #include <memory>
 #include <vector>
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <functional>
 
 #include <language/cli.hpp>
 #include <equations/coefficient.hpp>
@@ -37,30 +41,39 @@ namespace Construction {
             with the right symmetries for lambda.
 
             Once all the coefficients in the equation are calculated, the
-            equation is solved in a separate thread.
+            tensor of the equation is evaluated in a separate thread. The
+            equations are then solved by the System they belong to.
          */
         class Equation {
         public:
             enum State {
                 WAITING,
-                SOLVING,
-                SOLVED
+                EVALUATING,
+                EVALUATED
             };
         public:
             // Constructor
-            Equation(const std::string& code) : state(WAITING) {
+            Equation(const std::string& code) : state(WAITING), started(false) {
                 // Parse the code
                 Parse(code);
             }
 
             ~Equation() {
                 // Join the thread of the calculation
-                thread.join();
+                if (thread.joinable()) thread.join();
             }
         public:
             bool IsWaiting() const { return state == WAITING; }
-            bool IsSolving() const { return state == SOLVING; }
-            bool IsSolved() const { return state == SOLVED; }
+            bool IsEvaluating() const { return state == EVALUATING; }
+            bool IsEvaluated() const { return state == EVALUATED; }
+        public:
+            /**
+                Returns the tensor that has to vanish. Only valid once
+                the equation is evaluated.
+             */
+            const Tensor::Tensor& GetTensor() const { return tensor; }
+
+            const std::vector<CoefficientReference>& GetCoefficients() const { return coefficients; }
         public:
             /**
                 \brief Parses the expression
@@ -153,7 +166,7 @@ namespace Construction {
                     temp += c;
                 }
 
-                eq = "subst = HomogeneousSystem(" + current + "):";
+                eq = current + ":";
             }
         public:
             /**
@@ -162,6 +175,17 @@ namespace Construction {
                 Callback that is called by finished coefficients
              */
             void OnCoefficientCalculated(const CoefficientReference& coefficient) {
+                TryEvaluate();
+            }
+
+            /**
+                \brief Starts the evaluation if all coefficients are calculated
+
+                This has to be called for equations whose coefficients
+                were already calculated before the equation was created,
+                since no coefficient will notify them anymore.
+             */
+            void TryEvaluate() {
                 // Check if all coefficients are calculated
                 for (auto& c : coefficients) {
                     // If not finished, do nothing
@@ -170,52 +194,40 @@ namespace Construction {
                     }
                 }
 
-                // Solve the equation in a new thread#
-                this->thread = std::thread(&Equation::Solve, this);
+                // Only start once
+                bool expected = false;
+                if (!started.compare_exchange_strong(expected, true)) return;
+
+                // Evaluate the equation in a new thread
+                this->thread = std::thread(&Equation::Evaluate, this);
             }
 
-            void Solve() {
+            /**
+                \brief Evaluates the tensor of the equation
+
+                The coefficients are copied into a session of the equation,
+                s.t. all equations can be evaluated at the same time.
+             */
+            void Evaluate() {
                 std::unique_lock<std::mutex> lock(mutex);
 
-                // Set the state to solving
-                state = SOLVING;
+                // Set the state to evaluating
+                state = EVALUATING;
+
+                auto session = std::make_shared<Session>();
 
-                //   I. Lock the coefficients, so that no other equation can
-                //      change it in the meantime
-                // -=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
                 for (auto& coeff : coefficients) {
-                    coeff->Lock();
+                    session->Set(coeff->GetName(), *coeff->GetAsync());
                 }
 
-                //  II. Use the CLI to parse the equation and execute it
-                //      to obtain the substitution
-                // -=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-                CLI cli;
-
-                // Set the coefficient of the session
+                // Use the CLI to parse the equation and execute it
+                CLI cli (session);
                 cli(eq);
 
-                // III. Convert the output into a substitution
-                // -=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-                auto subst = Session::Instance()->GetCurrent().As<Tensor::Substitution>();
+                tensor = session->GetCurrent().As<Tensor::Tensor>();
 
-                //  IV. Substitute the result into the coefficients
-                // -=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-                for (auto& coeff : coefficients) {
-                    coeff->SetTensor(subst(*coeff->GetAsync()));
-
-                    // Overwrite the tensor in the session
-                    Session::Instance()->Get(coeff->GetName()) = *coeff->GetAsync();
-                }
-
-                //   V. Release locks
-                // -=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-                for (auto& coeff : coefficients) {
-                    coeff->Unlock();
-                }
-
-                // Set the state to solved
-                state = SOLVED;
+                // Set the state to evaluated
+                state = EVALUATED;
 
                 variable.notify_all();
                 Notify();
@@ -237,7 +249,7 @@ namespace Construction {
                 std::unique_lock<std::mutex> lock(mutex);
 
                 variable.wait(lock, [&]() {
-                    return state == SOLVED;
+                    return state == EVALUATED;
                 });
             }
         private:
@@ -248,9 +260,172 @@ namespace Construction {
             std::string eq;
             std::vector<CoefficientReference> coefficients;
 
+            Tensor::Tensor tensor;
+
             std::vector<ObserverFunction> observers;
 
             State state;
+            std::atomic<bool> started;
+        };
+
+
+        /**
+            \class System
+
+            \brief The graph of equations and the coefficients they contain
+
+            Two equations depend on each other if they share a coefficient,
+            directly or through other equations. The connected components
+            of this bipartite graph are independent of each other: each one
+            is solved in one sparse homogeneous system, and all components
+            are solved in parallel.
+
+            Equations can be inserted at any time. Solve only touches the
+            components with new equations. Since the coefficients of a
+            solved component already fulfill its old equations, it
+            suffices to solve the new ones and substitute the result into
+            all the coefficients of the (possibly merged) component.
+         */
+        class System {
+        public:
+            typedef std::function<void(const std::vector<CoefficientReference>&)>  ComponentObserver;
+        public:
+            /**
+                \brief Inserts the equation and connects its coefficients
+             */
+            Equation& Insert(std::unique_ptr<Equation> equation) {
+                std::unique_lock<std::mutex> lock(mutex);
+
+                auto& coefficients = equation->GetCoefficients();
+
+                for (auto& coeff : coefficients) {
+                    Find(coeff.get());
+                    if (members.find(coeff.get()) == members.end()) {
+                        members.insert({ coeff.get(), coeff });
+                    }
+                }
+
+                for (int i=1; i<coefficients.size(); ++i) {
+                    Union(coefficients[0].get(), coefficients[i].get());
+                }
+
+                equations.push_back(std::move(equation));
+                solved.push_back(false);
+
+                return *equations.back();
+            }
+
+            size_t Size() const { return equations.size(); }
+
+            std::vector<std::unique_ptr<Equation>>::iterator begin() { return equations.begin(); }
+            std::vector<std::unique_ptr<Equation>>::iterator end() { return equations.end(); }
+        public:
+            /**
+                \brief Solves all the components with new equations
+
+                Waits for the new equations to be evaluated, solves every
+                affected component and returns the coefficients whose
+                tensors changed.
+
+                If an observer is given, it gets the coefficients of every
+                component as soon as the component is solved. It may be
+                called from several threads at once.
+             */
+            std::vector<CoefficientReference> Solve(const ComponentObserver& observer = nullptr) {
+                std::unique_lock<std::mutex> lock(mutex);
+
+                // Group the new equations by their component
+                std::map<Coefficient*, std::vector<unsigned>> components;
+
+                for (unsigned i=0; i<equations.size(); ++i) {
+                    if (solved[i]) continue;
+
+                    auto& coefficients = equations[i]->GetCoefficients();
+                    Coefficient* root = coefficients.size() > 0 ? Find(coefficients[0].get()) : nullptr;
+
+                    components[root].push_back(i);
+                }
+
+                // Collect the coefficients of the components
+                std::map<Coefficient*, std::vector<CoefficientReference>> affected;
+                for (auto& pair : components) affected[pair.first];
+
+                for (auto& pair : members) {
+                    auto root = Find(pair.first);
+                    if (components.find(root) != components.end()) {
+                        affected[root].push_back(pair.second);
+                    }
+                }
+
+                std::vector<std::pair<Coefficient*, std::vector<unsigned>>> work (components.begin(), components.end());
+
+                // The equations are evaluated on their own threads, wait for
+                // them here instead of blocking the workers of the executor
+                for (auto& pair : work) {
+                    for (auto& i : pair.second) equations[i]->Wait();
+                }
+
+                // Solve all components in parallel
+                Parallel::For(0, work.size(), [&](size_t k) {
+                    std::vector<Tensor::Tensor> tensors;
+
+                    for (auto& i : work[k].second) {
+                        tensors.push_back(equations[i]->GetTensor());
+                    }
+
+                    auto substitution = Language::API::HomogeneousSystem(tensors);
+
+                    for (auto& coeff : affected.at(work[k].first)) {
+                        coeff->Lock();
+
+                        coeff->SetTensor(substitution(*coeff->GetAsync()));
+                        Coefficients::Instance()->GetSession().Set(coeff->GetName(), *coeff->GetAsync());
+
+                        coeff->Unlock();
+                    }
+
+                    if (observer) observer(affected.at(work[k].first));
+                }, 1);
+
+                std::vector<CoefficientReference> result;
+                for (auto& pair : work) {
+                    for (auto& i : pair.second) solved[i] = true;
+
+                    auto& coeffs = affected.at(pair.first);
+                    result.insert(result.end(), coeffs.begin(), coeffs.end());
+                }
+
+                return result;
+            }
+        private:
+            Coefficient* Find(Coefficient* coefficient) {
+                auto it = parent.find(coefficient);
+                if (it == parent.end()) {
+                    parent.insert({ coefficient, coefficient });
+                    return coefficient;
+                }
+
+                if (it->second == coefficient) return coefficient;
+
+                // Path compression
+                auto root = Find(it->second);
+                parent[coefficient] = root;
+                return root;
+            }
+
+            void Union(Coefficient* a, Coefficient* b) {
+                auto rootA = Find(a);
+                auto rootB = Find(b);
+                if (rootA != rootB) parent[rootB] = rootA;
+            }
+        private:
+            std::vector<std::unique_ptr<Equation>> equations;
+            std::vector<bool> solved;
+
+            std::map<Coefficient*, Coefficient*> parent;
+            std::map<Coefficient*, CoefficientReference> members;
+
+            std::mutex mutex;
         };
 
     }
@@ -0,0 +1,260 @@
+#pragma once
+
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <common/singleton.hpp>
+#include <generator/base_tensor.hpp>
+
+#include <boost/filesystem/operations.hpp>
+
+namespace Construction {
+    namespace Generator {
+
+        /**
+            \class BasisTable
+
+            \brief Precomputed epsilon gamma bases of Arbitrary by rank
+
+            The summands of Arbitrary only depend on the rank, the given
+            indices merely name the positions. For every rank the table
+            stores which position goes into which slot of the epsilon
+            gamma tensor of each summand, s.t. Arbitrary only has to
+            relabel the indices instead of enumerating all the pairings
+            again.
+
+            The tables are files in the cache directory, one per rank,
+
+                basis.<rank>.table
+
+            which consist of the magic "BASIS", a version byte, the rank,
+            the number of summands and then one byte per position for
+            every summand. They are mapped into memory on first use and
+            created if they are missing, so they can be shipped with the
+            program or built on the first run. A missing or broken table
+            that cannot be written falls back to the generator.
+
+            The cache directory is $CONSTRUCT_CACHE_DIR if set, otherwise
+            construct/ in $XDG_CACHE_HOME or ~/.cache, see
+            GetDefaultDirectory.
+         */
+        class BasisTable : public Singleton<BasisTable> {
+        public:
+            static const uint8_t Version = 1;
+        public:
+            BasisTable(const std::string& directory = GetDefaultDirectory()) : directory(directory) { }
+
+            ~BasisTable() {
+                for (auto& pair : tables) {
+                    munmap(pair.second.data, pair.second.size);
+                }
+            }
+        public:
+            /**
+                \brief Returns the directory for the tables of this user
+             */
+            static std::string GetDefaultDirectory() {
+                if (auto path = std::getenv("CONSTRUCT_CACHE_DIR")) return path;
+                if (auto path = std::getenv("XDG_CACHE_HOME")) return std::string(path) + "/construct";
+                if (auto path = std::getenv("HOME")) return std::string(path) + "/.cache/construct";
+
+                return (boost::filesystem::temp_directory_path() / "construct").string();
+            }
+
+            std::string GetDirectory() const { return directory; }
+        public:
+            /**
+                \brief Generates the arbitrary tensor with the given indices
+             */
+            Tensor::Tensor Generate(const Indices& indices) {
+                unsigned N = indices.Size();
+
+                // Too small for a table or too large for one byte per position
+                if (N < 2 || N > 255) {
+                    BaseTensorGenerator generator;
+                    return generator.Generate(indices);
+                }
+
+                const uint8_t* positions = nullptr;
+                unsigned count = 0;
+
+                if (!Get(N, positions, count)) {
+                    BaseTensorGenerator generator;
+                    return generator.Generate(indices);
+                }
+
+                unsigned numEpsilon = (N % 2 == 0) ? 0 : 1;
+                unsigned numGammas  = (N % 2 == 0) ? N/2  : (N-3)/2;
+
+                Tensor::Tensor result = Tensor::Tensor::Zero();
+
+                for (unsigned i=0; i<count; i++) {
+                    // Relabel the positions
+                    Indices newIndices;
+                    for (unsigned j=0; j<N; j++) {
+                        newIndices.Insert(indices[positions[i*N + j]]);
+                    }
+
+                    Tensor::Scalar variable ("e", i+1);
+                    result += variable * Tensor::Tensor::EpsilonGamma(numEpsilon, numGammas, newIndices);
+                }
+
+                return result;
+            }
+        private:
+            struct Table {
+                void* data;
+                size_t size;
+                unsigned count;
+            };
+
+            static const size_t HeaderSize = 5 + 1 + 2 * sizeof(uint32_t);
+
+            std::string GetFilename(unsigned N) const {
+                std::stringstream ss;
+                ss << directory << "/basis." << N << ".table";
+                return ss.str();
+            }
+
+            /**
+                Returns the positions of all summands for rank N, maps
+                the table and builds it first if necessary
+             */
+            bool Get(unsigned N, const uint8_t*& positions, unsigned& count) {
+                std::unique_lock<std::mutex> lock(mutex);
+
+                auto it = tables.find(N);
+                if (it == tables.end()) {
+                    Table table;
+
+                    if (!Map(N, table)) {
+                        Build(N);
+                        if (!Map(N, table)) return false;
+                    }
+
+                    it = tables.insert({ N, table }).first;
+                }
+
+                positions = static_cast<const uint8_t*>(it->second.data) + HeaderSize;
+                count = it->second.count;
+                return true;
+            }
+
+            /**
+                Maps the table for rank N into memory and checks the header
+                and that every position is smaller than N
+             */
+            bool Map(unsigned N, Table& table) const {
+                int fd = open(GetFilename(N).c_str(), O_RDONLY);
+                if (fd < 0) return false;
+
+                struct stat info;
+                if (fstat(fd, &info) < 0 || static_cast<size_t>(info.st_size) < HeaderSize) {
+                    close(fd);
+                    return false;
+                }
+
+                void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                close(fd);
+
+                if (data == MAP_FAILED) return false;
+
+                const char* bytes = static_cast<const char*>(data);
+
+                uint32_t rank, count;
+                std::memcpy(&rank, bytes + 6, sizeof(uint32_t));
+                std::memcpy(&count, bytes + 6 + sizeof(uint32_t), sizeof(uint32_t));
+
+                if (std::memcmp(bytes, "BASIS", 5) != 0 || static_cast<uint8_t>(bytes[5]) != Version || rank != N ||
+                    static_cast<size_t>(info.st_size) != HeaderSize + static_cast<size_t>(count) * N) {
+                    munmap(data, info.st_size);
+                    return false;
+                }
+
+                // Generate uses the positions as offsets into the indices
+                const uint8_t* positions = reinterpret_cast<const uint8_t*>(bytes) + HeaderSize;
+                for (size_t i=0; i<static_cast<size_t>(count) * N; i++) {
+                    if (positions[i] >= N) {
+                        munmap(data, info.st_size);
+                        return false;
+                    }
+                }
+
+                table.data = data;
+                table.size = info.st_size;
+                table.count = count;
+                return true;
+            }
+
+            /**
+                Enumerates the summands for rank N and writes the table.
+                The file is written under a temporary name first, s.t.
+                other processes never map a half written table.
+             */
+            void Build(unsigned N) const {
+                auto indices = Indices::GetRomanSeries(N, {1,3});
+
+                BaseTensorGenerator generator;
+                auto summands = (N % 2 == 0) ? generator.GenerateEvenRank(indices) : generator.GenerateOddRank(indices);
+
+                std::vector<uint8_t> positions;
+                positions.reserve(summands.size() * N);
+
+                for (auto& summand : summands) {
+                    for (auto& index : summand) {
+                        positions.push_back(static_cast<uint8_t>(indices.IndexOf(index)));
+                    }
+                }
+
+                std::stringstream ss;
+                ss << GetFilename(N) << "." << getpid() << ".tmp";
+                std::string temporary = ss.str();
+
+                boost::system::error_code error;
+                boost::filesystem::create_directories(directory, error);
+
+                {
+                    std::ofstream file (temporary, std::ios::binary);
+                    if (!file) return;
+
+                    uint8_t version = Version;
+                    uint32_t rank = N;
+                    uint32_t count = summands.size();
+
+                    file.write("BASIS", 5);
+                    file.write(reinterpret_cast<const char*>(&version), 1);
+                    file.write(reinterpret_cast<const char*>(&rank), sizeof(uint32_t));
+                    file.write(reinterpret_cast<const char*>(&count), sizeof(uint32_t));
+                    file.write(reinterpret_cast<const char*>(positions.data()), positions.size());
+
+                    if (!file) {
+                        file.close();
+                        std::remove(temporary.c_str());
+                        return;
+                    }
+                }
+
+                std::rename(temporary.c_str(), GetFilename(N).c_str());
+            }
+        private:
+            std::string directory;
+
+            std::mutex mutex;
+            std::map<unsigned, Table> tables;
+        };
+
+    }
+}
@@ -1,12 +1,21 @@
 #pragma once
 
+#include <map>
+#include <memory>
+#include <cmath>
+#include <sstream>
+#include <algorithm>
+
 #include <tensor/index.hpp>
 #include <tensor/tensor.hpp>
 #include <tensor/substitution.hpp>
 
 #include <common/time_measurement.hpp>
+#include <common/parallel.hpp>
+#include <common/cache.hpp>
 
 #include <generator/base_tensor.hpp>
+#include <generator/basis_table.hpp>
 
 using Construction::Tensor::Tensor;
 using Construction::Tensor::Scalar;
@@ -61,6 +70,7 @@ namespace Construction {
             std::vector<std::pair<Tensor::Tensor,Tensor::Tensor>> LinearDependent(const std::vector<Tensor::Tensor>& tensors);
 
             Substitution HomogeneousSystem(const Tensor::Tensor& tensor);
+            Substitution HomogeneousSystem(const std::vector<Tensor::Tensor>& tensors);
 
             Tensor::Tensor Substitute(const Tensor::Tensor& tensor, const Substitution& substitution);
 
@@ -69,9 +79,23 @@ namespace Construction {
             /**
                 Implementation
              */
+            /**
+                Estimates the memory of a sum of epsilon gamma tensors
+             */
+            struct ArbitraryWeight {
+                size_t operator()(const Tensor::Tensor& tensor) const {
+                    size_t summands = tensor.IsAdded() ? tensor.As<Tensor::AddedTensor>()->Size() : 1;
+                    return summands * (128 + tensor.GetIndices().Size() * sizeof(Tensor::Index));
+                }
+            };
+
             Tensor::Tensor Arbitrary(const Indices& indices) {
-                Generator::BaseTensorGenerator generator;
-                return generator.Generate(indices);
+                // The coefficients ask for the same indices over and over again
+                static Common::Cache<Indices, Tensor::Tensor, Tensor::IndicesHasher, ArbitraryWeight, Tensor::IndicesEqual> cache (64*1024*1024);
+
+                return cache.GetOrCalculate(indices, [&]() {
+                    return Generator::BasisTable::Instance()->Generate(indices);
+                });
             }
 
             Tensor::Tensor Epsilon(const Indices& indices) {
@@ -284,6 +308,77 @@ namespace Construction {
                 return result;
             }
 
+            /**
+                Rounds an entry of a reduced float system to a fraction with
+                a denominator of at most `maxDenominator`. The reduction only
+                works in float precision, so entries that are meant to be 0,
+                1 or a simple fraction are off by the accumulated rounding
+                error. Returns false if no such fraction is within the
+                tolerance, or if more than one is, since then the entry
+                cannot be told apart from a nearby fraction.
+             */
+            bool ToFraction(double value, int& numerator, unsigned& denominator, unsigned maxDenominator=1000, double tolerance=1e-5) {
+                long long h0 = 0, h1 = 1, k0 = 1, k1 = 0;
+                double x = value;
+                double epsilon = tolerance * std::max(1.0, std::abs(value));
+
+                // The continued fraction expansion yields the fraction with the
+                // smallest denominator inside the tolerance first
+                bool found = false;
+                for (int n=0; n<32; n++) {
+                    double a = std::floor(x);
+
+                    long long h2 = static_cast<long long>(a) * h1 + h0;
+                    long long k2 = static_cast<long long>(a) * k1 + k0;
+                    if (k2 > maxDenominator) break;
+
+                    h0 = h1; h1 = h2;
+                    k0 = k1; k1 = k2;
+
+                    if (std::abs(value - static_cast<double>(h1) / k1) <= epsilon) {
+                        found = true;
+                        break;
+                    }
+
+                    double remainder = x - a;
+                    if (remainder < 1e-12) break;
+                    x = 1 / remainder;
+                }
+
+                if (!found) return false;
+
+                // Two fractions p/q and p'/q' differ by at least 1/(q*q'), so if
+                // the window is smaller than that there is no other candidate
+                if (2 * epsilon * k1 * maxDenominator >= 1) {
+                    for (long long q=1; q<=maxDenominator; q++) {
+                        long long p = std::llround(value * q);
+                        if (std::abs(value - static_cast<double>(p) / q) > epsilon) continue;
+                        if (p * k1 != h1 * q) return false;
+                    }
+                }
+
+                numerator = static_cast<int>(h1);
+                denominator = static_cast<unsigned>(k1);
+                return true;
+            }
+
+            /**
+                Rounds an entry of a reduced float system, see ToFraction,
+                and throws if this is not possible.
+             */
+            Scalar ToExactScalar(double value) {
+                int numerator;
+                unsigned denominator;
+
+                if (!ToFraction(value, numerator, denominator)) {
+                    std::stringstream ss;
+                    ss << "Cannot read off the exact value of " << value << " from the reduced system";
+                    throw Exception(ss.str());
+                }
+
+                return Scalar(numerator, denominator);
+            }
+
             Substitution HomogeneousSystem(const Tensor::Tensor& tensor) {
                 auto system = tensor.ToHomogeneousLinearSystem();
 
@@ -321,6 +416,108 @@ namespace Construction {
                 return result;
             }
 
+            /**
+                Solves the equations tensor_i = 0 for all i at once. Every
+                system is first reduced on its own (in parallel), then the
+                non-zero rows are stacked into one sparse system over all
+                the variables that occur, which is reduced once more. The
+                entries are rounded to exact fractions after every
+                reduction, and an exception is thrown if one of them is
+                ambiguous, see ToFraction.
+             */
+            Substitution HomogeneousSystem(const std::vector<Tensor::Tensor>& tensors) {
+                typedef std::pair<Vector::Matrix, std::vector<Scalar>> System;
+
+                // Reduce every system on its own
+                auto systems = Parallel::Transform<std::shared_ptr<System>>(tensors, [](const Tensor::Tensor& tensor) {
+                    auto system = std::make_shared<System>(tensor.ToHomogeneousLinearSystem());
+                    system->first.ToRowEchelonForm();
+                    return system;
+                }, 1);
+
+                // Assign a column to every variable and count the rows with information
+                std::map<std::string, unsigned> columns;
+                std::vector<Scalar> variables;
+                std::vector<unsigned> ranks;
+                unsigned numberOfRows = 0;
+
+                for (auto& system : systems) {
+                    for (auto& variable : system->second) {
+                        if (columns.insert({ variable.ToString(), variables.size() }).second) {
+                            variables.push_back(variable);
+                        }
+                    }
+
+                    unsigned rank = 0;
+                    while (rank < system->first.GetNumberOfRows()) {
+                        auto vec = system->first.GetRowVector(rank);
+                        if (vec * vec == 0) break;
+                        rank++;
+                    }
+
+                    ranks.push_back(rank);
+                    numberOfRows += rank;
+                }
+
+                if (numberOfRows == 0 || variables.size() == 0) return Substitution();
+
+                // Stack the reduced rows into the joint system
+                Vector::Matrix M (numberOfRows, variables.size());
+
+                unsigned row = 0;
+                for (unsigned k=0; k<systems.size(); k++) {
+                    auto& system = *systems[k];
+
+                    for (unsigned i=0; i<ranks[k]; i++, row++) {
+                        for (unsigned j=0; j<system.second.size(); j++) {
+                            float value = system.first(i,j);
+                            if (value == 0) continue;
+
+                            // Drop the rounding errors of the first reduction
+                            M(row, columns[system.second[j].ToString()]) = ToExactScalar(value).ToDouble();
+                        }
+                    }
+                }
+
+                M.ToRowEchelonForm();
+
+                Substitution result;
+
+                // Extract the results
+                for (int i=0; i<M.GetNumberOfRows(); i++) {
+                    auto vec = M.GetRowVector(i);
+
+                    bool isZero = true;
+                    Scalar lhs = 0;
+                    Scalar rhs = 0;
+
+                    // Iterate over all the components
+                    for (int j=0; j<vec.GetDimension(); j++) {
+                        if (vec[j] == 0) continue;
+
+                        Scalar value = ToExactScalar(vec[j]);
+                        if (value == 0) continue;
+
+                        if (isZero) {
+                            if (value != 1) throw Exception("The reduced system has a row without leading one");
+
+                            lhs = variables[j];
+                            isZero = false;
+                        } else {
+                            rhs += (-variables[j] * value);
+                        }
+                    }
+
+                    // If the vector is zero, we get no further information => quit
+                    if (isZero) break;
+
+                    // Add to the result
+                    result.Insert(lhs, rhs);
+                }
+
+                return result;
+            }
+
             Tensor::Tensor Substitute(const Tensor::Tensor& tensor, const Substitution& substitution) {
                 return substitution(tensor);
             }
@@ -173,19 +173,24 @@ namespace Construction {
 
         class TensorArgument : public BaseArgument {
         public:
-            TensorArgument() : BaseArgument(ArgumentType::TENSOR) { }
+            TensorArgument() : BaseArgument(ArgumentType::TENSOR), result(std::make_shared<Tensor::Tensor>()) { }
         public:
             inline void SetTensor(const Tensor::Tensor& container) {
+                result = std::make_shared<Tensor::Tensor>(container);
+            }
+
+            // Shares the tensor, e.g. of a variable, instead of copying it
+            inline void SetTensor(const std::shared_ptr<const Tensor::Tensor>& container) {
                 result = container;
             }
 
-            inline Tensor::Tensor GetTensor() const {
-                return result;
+            inline const Tensor::Tensor& GetTensor() const {
+                return *result;
             }
         public:
             virtual void Parse(const std::string& code) { }
         private:
-            Tensor::Tensor result;
+            std::shared_ptr<const Tensor::Tensor> result;
         };
 
         class NumericArgument : public BaseArgument {
@@ -219,17 +224,22 @@ namespace Construction {
 
         class SubstitutionArgument : public BaseArgument {
         public:
-            SubstitutionArgument() : BaseArgument(ArgumentType::SUBSTITUTION) { }
+            SubstitutionArgument() : BaseArgument(ArgumentType::SUBSTITUTION), substitution(std::make_shared<Tensor::Substitution>()) { }
         public:
             inline void SetSubstitution(const Tensor::Substitution& substitution) {
+                this->substitution = std::make_shared<Tensor::Substitution>(substitution);
+            }
+
+            // Shares the substitution instead of copying it
+            inline void SetSubstitution(const std::shared_ptr<const Tensor::Substitution>& substitution) {
                 this->substitution = substitution;
             }
 
-            inline Tensor::Substitution GetSubstitution() const { return substitution; }
+            inline const Tensor::Substitution& GetSubstitution() const { return *substitution; }
         public:
             virtual void Parse(const std::string& code) { }
         private:
-            Tensor::Substitution substitution;
+            std::shared_ptr<const Tensor::Substitution> substitution;
         };
 
     }
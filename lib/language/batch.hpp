@@ -0,0 +1,151 @@
+#pragma once
+
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <ostream>
+#include <streambuf>
+
+#include <common/error.hpp>
+#include <common/json.hpp>
+#include <common/time_measurement.hpp>
+#include <language/cli.hpp>
+
+namespace Construction {
+    namespace Language {
+
+        class CannotOpenScriptException : public Exception {
+        public:
+            CannotOpenScriptException(const std::string& filename) : Exception("Cannot open " + filename) { }
+        };
+
+        /**
+            \class Batch
+
+            \brief Runs scripts without a terminal and writes their results as JSON lines
+
+            Every line of the script gives one record as soon as it and
+            the lines before are done, e.g.
+
+                {"line":2,"code":"a = Arbitrary({a b})","variable":"a","type":"Tensor","seconds":0.002,"size":312,"summands":2,"result":"..."}
+                {"line":3,"code":"Foo(a)","error":"I do not know this command","seconds":0}
+
+            and the run ends with a summary
+
+                {"finished":true,"lines":2,"errors":1,"seconds":0.003}
+
+            The size is the number of bytes of the serialized result and
+            the summands are only given for tensors. Like in the REPL,
+            tensors show at most as many summands as the preview of the
+            session allows. The output is
+            flushed after every record, s.t. other programs can process
+            the results while the script is still running.
+         */
+        class Batch {
+        public:
+            Batch(std::ostream& os) : os(os) { }
+        public:
+            /**
+                \brief Runs the script on a fresh CLI
+
+                \throws CannotOpenScriptException
+             */
+            void Run(const std::string& filename) {
+                CLI cli;
+                Run(cli, filename);
+            }
+
+            /**
+                \brief Runs the script on the given CLI
+
+                \throws CannotOpenScriptException
+             */
+            void Run(CLI& cli, const std::string& filename) {
+                if (!std::ifstream(filename).good()) throw CannotOpenScriptException(filename);
+
+                Common::TimeMeasurement time;
+
+                size_t lines = 0;
+                size_t errors = 0;
+
+                cli.ExecuteScript(filename, [&](const CLI::ScriptResult& result) {
+                    lines++;
+                    if (result.error != "") errors++;
+
+                    os << ToRecord(result, cli.GetSession().GetPreview()) << std::endl;
+                });
+
+                time.Stop();
+
+                Common::JsonRecord summary;
+                summary.Add("finished", true).Add("lines", lines).Add("errors", errors).Add("seconds", time.Seconds());
+
+                os << summary << std::endl;
+            }
+        public:
+            static Common::JsonRecord ToRecord(const CLI::ScriptResult& result, size_t preview = 0) {
+                Common::JsonRecord record;
+                record.Add("line", result.line).Add("code", result.code);
+
+                if (result.variable != "") record.Add("variable", result.variable);
+
+                if (result.error != "") {
+                    record.Add("error", result.error).Add("seconds", result.seconds);
+                    return record;
+                }
+
+                // Only count the bytes instead of keeping a copy
+                CountingBuffer counter;
+                std::ostream counting (&counter);
+                result.result.Serialize(counting);
+
+                record.Add("type", result.result.TypeToString());
+                record.Add("seconds", result.seconds);
+                record.Add("size", counter.GetCount());
+
+                if (result.result.IsTensor()) {
+                    auto tensor = result.result.Share<Tensor::Tensor>();
+                    record.Add("summands", tensor->IsZeroTensor() ? static_cast<size_t>(0) : tensor->GetNumberOfSummands());
+
+                    // One summand per line, without the line break at the end
+                    std::stringstream ss;
+                    bool newline = tensor->Write(ss, preview);
+
+                    auto text = ss.str();
+                    if (newline && !text.empty()) text.pop_back();
+
+                    record.Add("result", text);
+                } else {
+                    record.Add("result", result.result.ToString());
+                }
+
+                return record;
+            }
+        private:
+            /**
+                Counts the bytes written into it without storing them
+             */
+            class CountingBuffer : public std::streambuf {
+            public:
+                CountingBuffer() : count(0) { }
+            public:
+                size_t GetCount() const { return count; }
+            protected:
+                virtual int_type overflow(int_type c) override {
+                    if (!traits_type::eq_int_type(c, traits_type::eof())) count++;
+                    return traits_type::not_eof(c);
+                }
+
+                virtual std::streamsize xsputn(const char*, std::streamsize n) override {
+                    count += n;
+                    return n;
+                }
+            private:
+                size_t count;
+            };
+        private:
+            std::ostream& os;
+        };
+
+    }
+}
@@ -1,9 +1,20 @@
 #pragma once
 
+#include <set>
+#include <map>
+#include <functional>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
 #include <common/error.hpp>
+#include <common/cancellation.hpp>
+#include <common/executor.hpp>
 
 #include <language/parser.hpp>
 #include <language/session.hpp>
+#include <language/result_cache.hpp>
+#include <language/shared_results.hpp>
 #include <language/notebook.hpp>
 
 #include <language/argument.hpp>
@@ -26,120 +37,170 @@ namespace Construction {
             WrongTypeException() : Exception("Unexpected type error") { }
         };
 
+        class CannotParseException : public Exception {
+        public:
+            CannotParseException() : Exception("Cannot parse the command") { }
+        };
+
         class CLI {
         public:
-            CLI() {
+            /**
+                Creates a CLI with a new session. The persistent result
+                cache is off unless it is set with SetCache.
+             */
+            CLI() : session(std::make_shared<Session>()), throwErrors(false) {
                 crashFile = ".crashfile";
             }
 
-            CLI(int argc, char** argv) {
-                /*auto crashFile = boost::filesystem::system_complete(argv[0]).remove_filename().string();
-                if (crashFile[crashFile.size()-1] != '/') crashFile += "/";
-                crashFile += ".crashfile";*/
-                crashFile = ".crashfile";
-            }
+            /**
+                Creates a CLI that works on the given session. Such a CLI
+                does not write a crash file, since the session is owned
+                by somebody else, and does not use the result cache
+                unless one is set.
+             */
+            CLI(const std::shared_ptr<Session>& session) : session(session), throwErrors(false) { }
 
             ~CLI() {
                 //database.SaveToFile("tensors.db");
             }
+        public:
+            Session& GetSession() { return *session; }
+            std::shared_ptr<Session> GetSessionPointer() const { return session; }
+
+            /**
+                \brief Sets the persistent cache for command results, nullptr disables it
+             */
+            void SetCache(const std::shared_ptr<ResultCache>& cache) { this->cache = cache; }
+            std::shared_ptr<ResultCache> GetCache() const { return cache; }
+
+            /**
+                \brief Shares the results of commands with other CLIs, nullptr disables it
+             */
+            void SetSharedResults(const std::shared_ptr<SharedResults>& shared) { this->shared = shared; }
         public:
             void Error(const std::string& message) const {
+                // Evaluate reports the errors to its caller
+                if (throwErrors) throw Exception(message);
+
                 std::cout << "\033[31m" << "Error: " << "\033[0m" << message << std::endl;
             }
         public:
+            /**
+                \brief Returns the key of the command for the result caches
+
+                This is the command with its variables and `%` replaced by
+                their keys, see Session::GetKey, so it only depends on what
+                is computed. Returns an empty string if the command or one
+                of the commands in its arguments is not cachable.
+             */
             std::string GetExpandedCommandString(const std::shared_ptr<Node>& document) const {
                 if (document->IsPrevious()) {
-                    return lastCmd;
-                } else if (document->IsCommand()) {
-                    auto commandName = std::dynamic_pointer_cast<CommandNode>(document)->GetIdentifier()->GetText();
+                    return session->GetCurrentKey();
+                } else if (document->IsLiteral()) {
+                    auto id = document->ToString();
 
-                    CommandPointer command;
+                    // The variable might still be computed in the background
+                    session->GetJobs().WaitFor(id, session->GetJob());
+                    return session->GetKey(id);
+                } else if (!document->IsCommand()) {
+                    return "";
+                }
 
-                    std::string result = commandName;
-                    result.append("(");
+                auto commandName = std::dynamic_pointer_cast<CommandNode>(document)->GetIdentifier()->GetText();
 
-                    auto args = std::dynamic_pointer_cast<CommandNode>(document)->GetArguments();
+                try {
+                    if (!CommandManagement::Instance()->CreateCommand(commandName)->Cachable()) return "";
+                } catch (UnknownCommandException& err) {
+                    return "";
+                }
 
-                    bool first = true;
-                    for (auto& arg : *args) {
-                        // Add comma to the previous argument
-                        if (!first) result.append(",");
-                        else first = false;
+                std::string result = commandName;
+                result.append("(");
 
-                        // If the argument is another command, call this first
-                        if (arg->IsCommand()) {
-                            // Update newLastCmd string
-                            // Note that Execute has overwritten lastCmd
-                            result.append(GetExpandedCommandString(arg));
-                        }
-                        // If pointer to previous, add this
-                        else if (arg->IsPrevious()) {
-                            // Update newLastCmd string
-                            result.append(lastCmd);
-                        }
-                        // If is a literal, load the name from memory
-                        else if (arg->IsLiteral()) {
-                            auto id = arg->ToString();
-                            auto it = definition.find(id);
-                            if (it == definition.end()) result.append("");
-                            else result.append(it->second);
-                        }
-                        // If indices, add this
-                        else if (arg->IsIndices()) {
-                            // Update command
-                            result.append("\"");
-                            result.append(std::dynamic_pointer_cast<IndicesNode>(arg)->GetText());
-                            result.append("\"");
-                        }
-                        // If string, add this
-                        else if (arg->IsString()) {
-                            // Update command
-                            result.append("\'");
-                            result.append(std::dynamic_pointer_cast<StringNode>(arg)->GetText());
-                            result.append("\'");
-                        }
-                    }
+                auto args = std::dynamic_pointer_cast<CommandNode>(document)->GetArguments();
+
+                bool first = true;
+                for (auto& arg : *args) {
+                    // Add comma to the previous argument
+                    if (!first) result.append(",");
+                    else first = false;
 
-                    // Append closing bracket
-                    result.append(")");
-                    return result;
+                    // Other commands, previous results and variables are identified by their key
+                    if (arg->IsCommand() || arg->IsPrevious() || arg->IsLiteral()) {
+                        auto key = GetExpandedCommandString(arg);
+                        if (key == "") return "";
+
+                        result.append(key);
+                    }
+                    // If indices, add this
+                    else if (arg->IsIndices()) {
+                        result.append(GetIndicesKey(IndexArgument(std::dynamic_pointer_cast<IndicesNode>(arg)->GetText()).GetIndices()));
+                    }
+                    // If string, add this
+                    else if (arg->IsString()) {
+                        result.append("\'");
+                        result.append(std::dynamic_pointer_cast<StringNode>(arg)->GetText());
+                        result.append("\'");
+                    }
+                    // If numeric, add this
+                    else if (arg->IsNumeric()) {
+                        result.append(std::dynamic_pointer_cast<NumericNode>(arg)->GetText());
+                    }
                 }
-                // Literal
-                else if (document->IsLiteral()) {
-                    auto id = document->ToString();
-                    auto it = definition.find(id);
-                    if (it == definition.end()) return "";
-                    return it->second;
+
+                // Append closing bracket
+                result.append(")");
+                return result;
+            }
+
+            /**
+                \brief Returns the key of the indices in the keys of the caches
+
+                Every index is written with its name, printed text, range
+                and position, s.t. the key only matches the same indices.
+             */
+            static std::string GetIndicesKey(const Tensor::Indices& indices) {
+                std::stringstream ss;
+                ss << "\"";
+
+                bool first = true;
+                for (auto& index : indices) {
+                    if (!first) ss << " ";
+                    else first = false;
+
+                    if (index.IsContravariant()) ss << "^";
+                    index.Serialize(ss);
                 }
+
+                ss << "\"";
+                return ss.str();
+            }
+
+            /**
+                \brief Returns the key of the command with the indices as only argument
+
+                This is the same as GetExpandedCommandString gives for it,
+                so other programs can share results with the CLI.
+             */
+            static std::string GetCommandKey(const std::string& command, const Tensor::Indices& indices) {
+                return command + "(" + GetIndicesKey(indices) + ")";
             }
 
             void Execute(const std::shared_ptr<Node>& document, bool silent=false) {
                 // Copy the most recent expression;
-                Expression lastResult = Session::Instance()->GetCurrent();
+                Expression lastResult = session->GetCurrent();
                 Expression previousResult = lastResult;
 
                 Common::TimeMeasurement time;
 
                 if (document->IsPrevious()) {
+                    returned = lastResult;
+
                     PrintExpression(lastResult);
                     return;
                 } else if (document->IsCommand()) {
                     auto commandName = std::dynamic_pointer_cast<CommandNode>(document)->GetIdentifier()->GetText();
 
-                    std::string expandedCmd = GetExpandedCommandString(document);
-
-                    // if the expandedCmd is in the database, do not evaluate
-                    //
-                    // TODO: if the algorithms are out of the experimental stage,
-                    //       add the caching again
-                    //
-                    /*if (database.Contains(expandedCmd)) {
-                        lastResult = database[expandedCmd];
-                        lastCmd = expandedCmd;
-                        if (!silent) PrintTensor();
-                        return;
-                    }*/
-
                     CommandPointer command;
 
                     try {
@@ -149,24 +210,101 @@ namespace Construction {
                         return;
                     }
 
+                    command->SetSession(session.get());
+
+                    // The key of the command, only needed for the result caches
+                    std::string expandedCmd;
+                    if ((cache || shared) && command->Cachable()) expandedCmd = GetExpandedCommandString(document);
+
+                    // If another session computes or computed the same, take its result
+                    bool shareable = shared && expandedCmd != "";
+                    SharedResults::Lease lease;
+
+                    if (shareable && shared->Acquire(expandedCmd, lastResult, lease)) {
+                        time.Stop();
+
+                        session->SetCurrent(expandedCmd, lastResult);
+                        returned = lastResult;
+
+                        if (!silent) {
+                            PrintExpression(lastResult);
+                            std::cout << "\033[90m   " << time << " (shared)\033[0m" << std::endl;
+                        }
+
+                        return;
+                    }
+
+                    // If the expanded command is in the cache, do not evaluate
+                    bool cachable = cache && expandedCmd != "";
+
+                    if (cachable && cache->Lookup(expandedCmd, lastResult)) {
+                        time.Stop();
+
+                        session->SetCurrent(expandedCmd, lastResult);
+                        lease.Complete(lastResult);
+                        returned = lastResult;
+
+                        if (!silent) {
+                            PrintExpression(lastResult);
+                            std::cout << "\033[90m   " << time << " (cached)\033[0m" << std::endl;
+                        }
+
+                        return;
+                    }
+
                     // Apply arguments
                     auto args = std::dynamic_pointer_cast<CommandNode>(document)->GetArguments();
 
+                    // Evaluate the independent commands among them at once
+                    std::map<size_t, std::pair<Expression, std::string>> evaluated;
+
+                    try {
+                        evaluated = EvaluateArguments(args);
+                    } catch (const CancelledException& e) {
+                        throw;
+                    } catch (const Exception& e) {
+                        Error(e.what());
+                        return;
+                    }
+
+                    // The last argument whose commands refer to the result of the one before
+                    size_t lastPrevious = 0;
+                    {
+                        size_t index = 0;
+                        for (auto& arg : *args) {
+                            index++;
+                            if (arg->IsCommand() && RefersToPrevious(arg)) lastPrevious = index;
+                        }
+                    }
+
+                    size_t index = 0;
+
                     for (auto& arg : *args) {
+                        index++;
+
                         // If the argument is another command, call this first
                         if (arg->IsCommand()) {
                             auto cmd = std::dynamic_pointer_cast<CommandNode>(arg);
-                            Execute(cmd, true);
+                            auto it = evaluated.find(index-1);
+
+                            if (it != evaluated.end()) {
+                                lastResult = it->second.first;
 
-                            // Replace with a tensor argument reference to the previous result
-                            lastResult = Session::Instance()->GetCurrent();
+                                // Only `%` in a later argument sees the result through the session
+                                if (index < lastPrevious) session->SetCurrent(it->second.second, lastResult);
+                            } else {
+                                Execute(cmd, true);
+
+                                // Replace with a tensor argument reference to the previous result
+                                lastResult = session->GetCurrent();
+                            }
 
                             switch (lastResult.GetType()) {
                                 // Tensor
                                 {
                                     case Tensor::AbstractExpression::TENSOR:
                                         auto newArg = std::make_shared<TensorArgument>();
-                                        newArg->SetTensor(lastResult.As<Tensor::Tensor>());
+                                        newArg->SetTensor(lastResult.Share<Tensor::Tensor>());
                                         command->AddArgument(std::move(newArg));
                                         break;
                                 }
@@ -175,7 +313,7 @@ namespace Construction {
                                 {
                                     case Tensor::AbstractExpression::SUBSTITUTION:
                                         auto newArg = std::make_shared<SubstitutionArgument>();
-                                        newArg->SetSubstitution(lastResult.As<Tensor::Substitution>());
+                                        newArg->SetSubstitution(lastResult.Share<Tensor::Substitution>());
                                         command->AddArgument(std::move(newArg));
                                         break;
                                 }
@@ -196,7 +334,7 @@ namespace Construction {
                                 {
                                     case Tensor::AbstractExpression::TENSOR:
                                         auto newArg = std::make_shared<TensorArgument>();
-                                        newArg->SetTensor(previousResult.As<Tensor::Tensor>());
+                                        newArg->SetTensor(previousResult.Share<Tensor::Tensor>());
                                         command->AddArgument(std::move(newArg));
                                         break;
                                 }
@@ -204,7 +342,7 @@ namespace Construction {
                                 {
                                     case Tensor::AbstractExpression::SUBSTITUTION:
                                         auto newArg = std::make_shared<SubstitutionArgument>();
-                                        newArg->SetSubstitution(previousResult.As<Tensor::Substitution>());
+                                        newArg->SetSubstitution(previousResult.Share<Tensor::Substitution>());
                                         command->AddArgument(std::move(newArg));
                                         break;
                                 }
@@ -222,13 +360,16 @@ namespace Construction {
                         // If is a literal, load the name from memory
                         else if (arg->IsLiteral()) {
                             auto id = arg->ToString();
-                            lastResult = Session::Instance()->Get(id);
+
+                            // The variable might still be computed in the background
+                            session->GetJobs().WaitFor(id, session->GetJob());
+                            lastResult = session->Get(id);
 
                             switch (lastResult.GetType()) {
                                 {
                                     case Tensor::AbstractExpression::TENSOR:
                                         auto newArg = std::make_shared<TensorArgument>();
-                                        newArg->SetTensor(lastResult.As<Tensor::Tensor>());
+                                        newArg->SetTensor(lastResult.Share<Tensor::Tensor>());
                                         command->AddArgument(std::move(newArg));
                                         break;
                                 }
@@ -236,7 +377,7 @@ namespace Construction {
                                 {
                                     case Tensor::AbstractExpression::SUBSTITUTION:
                                         auto newArg = std::make_shared<SubstitutionArgument>();
-                                        newArg->SetSubstitution(lastResult.As<Tensor::Substitution>());
+                                        newArg->SetSubstitution(lastResult.Share<Tensor::Substitution>());
                                         command->AddArgument(std::move(newArg));
                                         break;
                                 }
@@ -295,15 +436,19 @@ namespace Construction {
                     // Stop time measurement
                     time.Stop();
 
-                    // Update the session
+                    // Update the session, the key only belongs to a result of this command
                     if (!lastResult.IsVoid()) {
-                        Session::Instance()->SetCurrent(expandedCmd, lastResult);
+                        session->SetCurrent(newResult.IsVoid() ? "" : expandedCmd, lastResult);
                     }
 
-                    // Update database
-                    /*if (command->Cachable()) {
-                        database[lastCmd] = lastResult;
-                    }*/
+                    returned = newResult;
+
+                    // Update the caches
+                    if (cachable) {
+                        cache->Store(expandedCmd, newResult, time.Seconds());
+                    }
+
+                    lease.Complete(newResult);
 
                     // Print tensors unless in silent mode
                     if (!silent) {
@@ -321,13 +466,11 @@ namespace Construction {
                     Execute(expression, true);
 
                     // Update current
-                    lastResult = Session::Instance()->GetCurrent();
+                    lastResult = session->GetCurrent();
 
                     // Store the variable in memory
-                    Session::Instance()->Get(id) = lastResult;
-
-                    definition[id] = lastCmd;
-                    //database[lastCmd] = lastResult;
+                    session->Set(id, lastResult, session->GetLastCommandString());
+                    returned = lastResult;
 
                     // Print tensors unless in silent mode
                     if (!silent) {
@@ -342,10 +485,13 @@ namespace Construction {
                     return;
                 } else if (document->IsLiteral()) {
                     auto id = std::dynamic_pointer_cast<LiteralNode>(document)->GetText();
-                    Session::Instance()->SetCurrent(definition[id], Session::Instance()->Get(id));
+
+                    session->GetJobs().WaitFor(id, session->GetJob());
+                    session->SetCurrentToVariable(id);
 
                     // Update current
-                    lastResult = Session::Instance()->GetCurrent();
+                    lastResult = session->GetCurrent();
+                    returned = lastResult;
 
                     if (!silent) PrintExpression(lastResult);
                     return;
@@ -355,6 +501,9 @@ namespace Construction {
             }
         public:
             void operator()(const std::string& code) {
+                // Journal the session on disk in order to recover in case of crash
+                if (crashFile != "" && !session->HasJournal()) session->EnableJournal(crashFile);
+
                 std::string text = code;
 
                 bool silent = false;
@@ -364,6 +513,17 @@ namespace Construction {
                     text = code.substr(0, code.size() - 1);
                 }
 
+                // A trailing & runs the line in the background
+                bool background = false;
+
+                {
+                    auto end = text.find_last_not_of(" \t");
+                    if (end != std::string::npos && text[end] == '&') {
+                        background = true;
+                        text = text.substr(0, end);
+                    }
+                }
+
                 // Parse and get the AST
                 auto document = parser.Parse(text);
 
@@ -372,11 +532,44 @@ namespace Construction {
                     return;
                 }
 
+                // Background(...) does the same
+                {
+                    std::string variable;
+                    auto expression = document;
+
+                    if (document->IsAssignment()) {
+                        variable = std::dynamic_pointer_cast<AssignmentNode>(document)->GetIdentifier()->GetText();
+                        expression = std::dynamic_pointer_cast<AssignmentNode>(document)->GetExpression();
+                    }
+
+                    if (auto inner = UnwrapBackground(expression)) {
+                        background = true;
+                        expression = inner;
+                    }
+
+                    if (background) {
+                        StartJob(variable, expression, code);
+                        return;
+                    }
+                }
+
+                // Every command gets its own token, s.t. Ctrl-C and the limits
+                // only abort this one
+                Common::CancellationToken token;
+                token.SetTimeout(std::chrono::milliseconds(static_cast<long>(1000 * session->GetTimeout())));
+                token.SetMemoryLimit(static_cast<size_t>(1024 * 1024 * session->GetMemoryLimit()));
+
                 #if RECOVER_FROM_EXCEPTIONS == 1
                 try {
                 #endif
-                    Execute(document, silent);
-                    Session::Instance()->GetNotebook().Append(code);
+                    try {
+                        Common::CancellationScope scope(token);
+
+                        Execute(document, silent);
+                        session->AppendToNotebook(code);
+                    } catch (const CancelledException& e) {
+                        Error(e.what());
+                    }
                 #if RECOVER_FROM_EXCEPTIONS == 1
                 } catch (const std::bad_alloc& e) {
                     Error("Out of memory. :(");
@@ -385,18 +578,170 @@ namespace Construction {
                 }
                 #endif
 
-                // Store the session on disk in order to recover in case of crash
-                Session::Instance()->SaveToFile(crashFile);
             }
 
+            /**
+                \brief Evaluates the code and returns its result
+
+                In contrast to operator(), nothing is printed and errors
+                are thrown, s.t. other programs can report them. The
+                limits of the session apply as usual. Commands that
+                return nothing, e.g. Jobs(), give a void expression.
+
+                \throws CannotParseException
+             */
+            Expression Evaluate(const std::string& code) {
+                auto document = parser.Parse(code);
+                if (document == nullptr) throw CannotParseException();
+
+                return Evaluate(document, code);
+            }
+        private:
+            Expression Evaluate(const std::shared_ptr<Node>& document, const std::string& code) {
+                Common::CancellationToken token (false);
+                token.SetTimeout(std::chrono::milliseconds(static_cast<long>(1000 * session->GetTimeout())));
+                token.SetMemoryLimit(static_cast<size_t>(1024 * 1024 * session->GetMemoryLimit()));
+
+                Common::CancellationScope scope(token);
+
+                throwErrors = true;
+
+                try {
+                    Execute(document, true);
+                } catch (...) {
+                    throwErrors = false;
+                    throw;
+                }
+
+                throwErrors = false;
+                session->AppendToNotebook(code);
+
+                return returned;
+            }
+        public:
+
+            /**
+                \brief Evaluates the expression in a background job
+
+                The job works on a scratch session layered over ours and
+                stores the result into the variable once it is done. The
+                completed job is added to the notebook, which also puts it
+                into the journal.
+             */
+            void StartJob(const std::string& variable, const std::shared_ptr<Node>& expression, const std::string& code) {
+                // The job may outlive this CLI, but not the session
+                Session* parent = session.get();
+                auto cache = this->cache;
+
+                auto id = session->GetJobs().Start(variable, code, [parent, expression, cache](unsigned job, const std::string& variable) {
+                    CLI cli (std::make_shared<Session>(parent));
+                    cli.SetCache(cache);
+                    cli.GetSession().SetJob(job);
+
+                    // Errors fail the job instead of being printed, s.t. the
+                    // variable is not set. The job already has its token.
+                    cli.throwErrors = true;
+                    cli.Execute(expression, true);
+
+                    parent->Set(variable, cli.GetSession().GetCurrent(), cli.GetSession().GetLastCommandString());
+                }, [parent](const Jobs::Info& job) {
+                    if (job.state == Jobs::FINISHED) {
+                        std::cout << "\033[90m[" << job.id << "] Done: " << job.code << " -> " << job.variable << "   " << job.time << "\033[0m" << std::endl;
+
+                        parent->AppendToNotebook(job.code);
+                    } else {
+                        std::cout << "\033[31m[" << job.id << "] Failed: \033[0m" << job.error << std::endl;
+                    }
+                });
+
+                std::cout << "\033[90m   [" << id << "] started\033[0m" << std::endl;
+            }
+
+            /**
+                Returns the argument of `Background(...)`, or nullptr if
+                the node is no such call
+             */
+            static std::shared_ptr<Node> UnwrapBackground(const std::shared_ptr<Node>& node) {
+                if (!node->IsCommand()) return nullptr;
+
+                auto command = std::dynamic_pointer_cast<CommandNode>(node);
+                if (command->GetIdentifier()->GetText() != "Background") return nullptr;
+                if (command->GetArguments()->Size() != 1) return nullptr;
+
+                return *command->GetArguments()->begin();
+            }
+
+            /**
+                \brief Executes the lines of the script file
+
+                All lines are parsed up front. Consecutive assignments and
+                commands that only use pure commands do not change the
+                session besides their result, so they only depend on the
+                lines that define the variables they read, and on the line
+                before if they refer to `%`. Such lines are evaluated
+                concurrently as soon as their dependencies are done, while
+                their output and their results are applied to the session
+                in the order of the script. All other lines, e.g. session
+                commands or background jobs, wait for the lines before and
+                run on their own.
+             */
             void ExecuteScript(const std::string& filename, bool silent=false) {
+                RunScript(filename, silent);
+            }
+
+            /**
+                \brief Outcome of a line of a script
+             */
+            struct ScriptResult {
+                // Number of the line in the file, starting at 1
+                size_t line;
+
+                std::string code;
+                std::string variable;
+
+                Expression result;
+                double seconds;
+
+                // Empty if the line succeeded
+                std::string error;
+            };
+
+            typedef std::function<void(const ScriptResult&)>    ScriptObserver;
+
+            /**
+                \brief Executes the script and hands the outcome of every line to the observer
+
+                Nothing is printed, errors go to the observer as well.
+                The observer is called in the order of the script, as
+                soon as a line and the ones before are done. Background
+                jobs run in the foreground.
+             */
+            void ExecuteScript(const std::string& filename, const ScriptObserver& observer) {
+                this->observer = observer;
+                RunScript(filename, false);
+                this->observer = nullptr;
+            }
+        private:
+            void RunScript(const std::string& filename, bool silent) {
                 // Load text file
                 std::ifstream file (filename);
                 if (!file.is_open()) return;
 
-                // Read line per line and execute
+                // Journal the session on disk in order to recover in case of crash
+                if (crashFile != "" && !session->HasJournal()) session->EnableJournal(crashFile);
+
+                // Ctrl-C stops the whole script, not only the current line
+                Common::CancellationToken token;
+
+                // Read all the lines
+                std::vector<Statement> statements;
+
                 std::string line;
+                size_t number = 0;
+
                 while (std::getline(file, line)) {
+                    number++;
+
                     // Ignore empty lines
                     if (line == "") continue;
 
@@ -406,19 +751,505 @@ namespace Construction {
                     // Turn silent?
                     if (silent && line[line.size()-1] != ':') line.append(":");
 
-                    // Print line to see
-                    std::cout << "> " << line << std::endl;
+                    statements.push_back(Prepare(line));
+                    statements.back().line = number;
+                }
+
+                size_t begin = 0;
+                while (begin < statements.size()) {
+                    size_t end = begin;
+                    while (end < statements.size() && statements[end].concurrent) end++;
+
+                    if (end - begin > 1) {
+                        if (!ExecuteConcurrently(statements, begin, end, token)) return;
+                        begin = end;
+                    } else {
+                        if (!ExecuteLine(statements[begin], token)) return;
+                        begin++;
+                    }
+                }
+            }
+        private:
+            /**
+                A line of a script, see ExecuteScript
+             */
+            struct Statement {
+                enum State {
+                    WAITING,
+                    RUNNING,
+                    FINISHED,
+                    CANCELLED,
+                    FAILED,
+
+                    // Has to run on its own once the lines before are done
+                    SEQUENTIAL
+                };
+
+                Statement() : line(0), silent(false), concurrent(false), previous(false), state(WAITING) { }
+
+                size_t line;
+                std::string code;
+
+                // The whole line and the expression that is assigned, if any
+                std::shared_ptr<Node> document;
+                std::shared_ptr<Node> expression;
+                bool silent;
+
+                // May run at the same time as other concurrent statements
+                bool concurrent;
+
+                std::string variable;
+                std::set<std::string> reads;
+                bool previous;
+                std::vector<size_t> dependencies;
+
+                State state;
+                Common::CancellationToken limits;
+
+                Expression result;
+                std::string command;
+                Common::TimeMeasurement time;
+                std::string error;
+            };
+
+            /**
+                Parses the line and finds out if it may run concurrently
+             */
+            Statement Prepare(const std::string& code) {
+                Statement statement;
+                statement.code = code;
+
+                std::string text = code;
+
+                if (text.size() > 0 && text[text.size() - 1] == ':') {
+                    statement.silent = true;
+                    text = text.substr(0, text.size() - 1);
+                }
+
+                // Background jobs are started in order
+                bool background = false;
+
+                auto end = text.find_last_not_of(" \t");
+                if (end != std::string::npos && text[end] == '&') {
+                    background = true;
+                    text = text.substr(0, end);
+                }
+
+                auto document = parser.Parse(text);
+                if (document == nullptr) return statement;
+
+                statement.document = document;
+                statement.expression = document;
+
+                if (document->IsAssignment()) {
+                    statement.variable = std::dynamic_pointer_cast<AssignmentNode>(document)->GetIdentifier()->GetText();
+                    statement.expression = std::dynamic_pointer_cast<AssignmentNode>(document)->GetExpression();
+                }
+
+                // The same line without the job, see ExecuteScript with an observer
+                if (auto inner = UnwrapBackground(statement.expression)) {
+                    background = true;
+                    statement.expression = inner;
+
+                    if (document->IsAssignment()) {
+                        statement.document = std::make_shared<AssignmentNode>(std::dynamic_pointer_cast<AssignmentNode>(document)->GetIdentifier(), inner);
+                    } else {
+                        statement.document = inner;
+                    }
+                }
+
+                statement.concurrent = !background && statement.expression->IsCommand() &&
+                                       IsPure(statement.expression, statement.reads, statement.previous);
+
+                return statement;
+            }
+
+            /**
+                Creates a CLI on a scratch session layered over ours,
+                which throws its errors instead of printing them. The
+                current expression of the scratch session is Void.
+             */
+            std::unique_ptr<CLI> Fork() const {
+                std::unique_ptr<CLI> cli (new CLI(std::make_shared<Session>(session.get())));
+
+                cli->SetCache(cache);
+                cli->SetSharedResults(shared);
+                cli->throwErrors = true;
+
+                cli->GetSession().SetCurrent("", Expression::Void());
+
+                return cli;
+            }
+
+            /**
+                Evaluates the arguments that are commands concurrently,
+                if there are several that only call pure commands
+                and do not refer to `%`. They are forked as tasks of the
+                executor, and the calling thread helps out while it waits.
+
+                Returns the results by the position of the argument.
+                Arguments that gave no result are left out, s.t. they are
+                executed as usual.
+
+                \throws The first error of the arguments
+             */
+            std::map<size_t, std::pair<Expression, std::string>> EvaluateArguments(const std::shared_ptr<ArgumentsNode>& args) const {
+                std::vector<std::pair<size_t, std::shared_ptr<Node>>> independent;
+
+                {
+                    size_t index = 0;
+                    for (auto& arg : *args) {
+                        std::set<std::string> reads;
+                        bool previous = false;
+
+                        if (arg->IsCommand() && IsPure(arg, reads, previous) && !previous) {
+                            independent.push_back({ index, arg });
+                        }
+
+                        index++;
+                    }
+                }
+
+                std::map<size_t, std::pair<Expression, std::string>> results;
+                if (independent.size() < 2) return results;
+
+                std::vector<Expression> values (independent.size(), Expression::Void());
+                std::vector<std::string> keys (independent.size());
+
+                // The arguments belong to the same command, so the tasks
+                // share its limits
+                Common::TaskGroup group;
+
+                for (size_t i=0; i<independent.size(); i++) {
+                    group.Run([this, &independent, &values, &keys, i]() {
+                        auto cli = Fork();
+                        cli->Execute(independent[i].second, true);
+
+                        values[i] = cli->GetSession().GetCurrent();
+                        keys[i] = cli->GetSession().GetLastCommandString();
+                    });
+                }
+
+                group.Wait();
+
+                for (size_t i=0; i<independent.size(); i++) {
+                    if (!values[i].IsVoid()) results[independent[i].first] = { values[i], keys[i] };
+                }
+
+                return results;
+            }
+
+            /**
+                Checks if `%` appears anywhere in the node
+             */
+            static bool RefersToPrevious(const std::shared_ptr<Node>& node) {
+                if (node->IsPrevious()) return true;
+                if (!node->IsCommand()) return false;
+
+                for (auto& arg : *std::dynamic_pointer_cast<CommandNode>(node)->GetArguments()) {
+                    if (RefersToPrevious(arg)) return true;
+                }
+
+                return false;
+            }
+
+            /**
+                Checks if the node only calls pure commands, see
+                Command::Pure, and collects the variables it reads and if
+                it refers to `%`
+             */
+            static bool IsPure(const std::shared_ptr<Node>& node, std::set<std::string>& reads, bool& previous) {
+                if (node->IsPrevious()) {
+                    previous = true;
+                    return true;
+                } else if (node->IsLiteral()) {
+                    reads.insert(node->ToString());
+                    return true;
+                } else if (node->IsIndices() || node->IsString() || node->IsNumeric()) {
+                    return true;
+                } else if (!node->IsCommand()) {
+                    return false;
+                }
+
+                auto command = std::dynamic_pointer_cast<CommandNode>(node);
+
+                try {
+                    if (!CommandManagement::Instance()->CreateCommand(command->GetIdentifier()->GetText())->Pure()) return false;
+                } catch (UnknownCommandException& err) {
+                    return false;
+                }
+
+                for (auto& arg : *command->GetArguments()) {
+                    if (!IsPure(arg, reads, previous)) return false;
+                }
+
+                return true;
+            }
+
+            /**
+                Executes a single line of the script, returns false if
+                the script has to stop
+             */
+            bool ExecuteLine(const Statement& statement, Common::CancellationToken& token) {
+                if (token.IsCancelled()) {
+                    if (!observer) Error("Stopping execution of the script ...");
+                    return false;
+                }
+
+                if (observer) {
+                    ScriptResult result { statement.line, statement.code, statement.variable, Expression::Void(), 0, "" };
+                    Common::TimeMeasurement time;
 
                     try {
-                        // Execute
-                        (*this)(line);
-                    } catch (...) {
-                        // If an exception is thrown, exit since further evaluation
-                        // of the scripts cannot be garantueed.
-                        Error("Cannot recover from this. Stopping execution of the script ...");
-                        return;
+                        if (statement.document == nullptr) throw CannotParseException();
+                        result.result = Evaluate(statement.document, statement.code);
+                    } catch (const std::bad_alloc& e) {
+                        result.error = "Out of memory";
+                    } catch (const std::exception& e) {
+                        result.error = e.what();
+                    }
+
+                    time.Stop();
+                    result.seconds = time.Seconds();
+
+                    observer(result);
+                    return true;
+                }
+
+                // Print line to see
+                std::cout << "> " << statement.code << std::endl;
+
+                try {
+                    // Execute
+                    (*this)(statement.code);
+                } catch (...) {
+                    // If an exception is thrown, exit since further evaluation
+                    // of the scripts cannot be garantueed.
+                    Error("Cannot recover from this. Stopping execution of the script ...");
+                    return false;
+                }
+
+                return true;
+            }
+
+            /**
+                Evaluates the concurrent statements in [begin, end) on
+                forked CLIs as tasks of the executor, and applies them to
+                the session in order.
+
+                The error of a statement that failed or hit its limits is
+                reported once the lines before are applied, and the script
+                goes on, just as operator() does for a single line. A
+                statement that gave no result, or which depends on one that
+                did not finish, is executed on the session after the lines
+                before. Returns false if the script has to stop, i.e. if it
+                was cancelled.
+             */
+            bool ExecuteConcurrently(std::vector<Statement>& statements, size_t begin, size_t end, Common::CancellationToken& token) {
+                // Only the dependencies inside of the range, the others
+                // are in the session already
+                {
+                    std::map<std::string, size_t> writers;
+
+                    for (size_t i=begin; i<end; i++) {
+                        auto& statement = statements[i];
+
+                        for (auto& variable : statement.reads) {
+                            auto it = writers.find(variable);
+                            if (it != writers.end()) statement.dependencies.push_back(it->second);
+                        }
+
+                        if (statement.previous && i > begin) statement.dependencies.push_back(i-1);
+
+                        if (statement.variable != "") writers[statement.variable] = i;
                     }
                 }
+
+                Expression initial = session->GetCurrent();
+                std::string initialCmd = session->GetLastCommandString();
+
+                auto executor = Common::Executor::Instance();
+
+                unsigned limit = executor->GetNumberOfWorkers();
+                unsigned running = 0;
+
+                // Counts the statements that are done, guarded by the mutex
+                size_t completed = 0;
+
+                std::mutex mutex;
+                std::condition_variable condition;
+
+                std::unique_lock<std::mutex> lock(mutex);
+
+                // Helps the executor instead of blocking, see TaskGroup::Wait,
+                // and sleeps until the next statement is done otherwise
+                auto await = [&]() {
+                    size_t seen = completed;
+
+                    lock.unlock();
+                    bool helped = executor->RunPendingTask();
+                    lock.lock();
+
+                    if (!helped) condition.wait(lock, [&]() { return completed != seen; });
+                };
+
+                bool stop = false;
+
+                for (size_t next = begin; next < end && !stop; ) {
+                    if (token.IsCancelled()) {
+                        if (!observer) Error("Stopping execution of the script ...");
+                        stop = true;
+                        break;
+                    }
+
+                    // Start the statements whose dependencies are done
+                    for (size_t i=next; i<end && running < limit; i++) {
+                        auto& statement = statements[i];
+                        if (statement.state != Statement::WAITING) continue;
+
+                        bool ready = true;
+                        for (auto dependency : statement.dependencies) {
+                            auto state = statements[dependency].state;
+
+                            if (state == Statement::CANCELLED || state == Statement::FAILED || state == Statement::SEQUENTIAL) {
+                                statement.state = Statement::SEQUENTIAL;
+                            }
+
+                            if (state != Statement::FINISHED) ready = false;
+                        }
+
+                        if (!ready) continue;
+
+                        // Collect the results of the dependencies
+                        std::vector<std::pair<std::string, std::pair<Expression, std::string>>> inputs;
+                        for (auto dependency : statement.dependencies) {
+                            auto& other = statements[dependency];
+                            if (other.variable != "" && statement.reads.count(other.variable) > 0) {
+                                inputs.push_back({ other.variable, { other.result, other.command } });
+                            }
+                        }
+
+                        // Without `%` the result must not be confused with the previous one
+                        Expression previous = Expression::Void();
+                        std::string previousCmd;
+
+                        if (statement.previous) {
+                            previous = (i > begin) ? statements[i-1].result : initial;
+                            previousCmd = (i > begin) ? statements[i-1].command : initialCmd;
+                        }
+
+                        statement.state = Statement::RUNNING;
+                        running++;
+
+                        executor->Spawn([this, &statement, &mutex, &condition, &running, &completed, inputs, previous, previousCmd]() {
+                            auto cli = Fork();
+
+                            cli->GetSession().SetCurrent(previousCmd, previous);
+                            for (auto& input : inputs) {
+                                cli->GetSession().Set(input.first, input.second.first, input.second.second);
+                            }
+
+                            auto& token = statement.limits;
+                            token.SetTimeout(std::chrono::milliseconds(static_cast<long>(1000 * cli->GetSession().GetTimeout())));
+                            token.SetMemoryLimit(static_cast<size_t>(1024 * 1024 * cli->GetSession().GetMemoryLimit()));
+
+                            Common::TimeMeasurement time;
+
+                            auto state = Statement::FINISHED;
+                            Expression result;
+                            std::string command, error;
+
+                            try {
+                                Common::CancellationScope scope(token);
+
+                                cli->Execute(statement.expression, true);
+
+                                result = cli->GetSession().GetCurrent();
+                                command = cli->GetSession().GetLastCommandString();
+
+                                // Nothing came out, let the session decide what that means
+                                if (result.IsVoid()) state = Statement::SEQUENTIAL;
+                            } catch (const CancelledException& e) {
+                                state = Statement::CANCELLED;
+                                error = e.what();
+                            } catch (const std::bad_alloc& e) {
+                                state = Statement::FAILED;
+                                error = "Out of memory";
+                            } catch (const std::exception& e) {
+                                state = Statement::FAILED;
+                                error = e.what();
+                            } catch (...) {
+                                state = Statement::FAILED;
+                                error = "Something went terribly wrong. :(";
+                            }
+
+                            time.Stop();
+
+                            std::unique_lock<std::mutex> lock(mutex);
+
+                            statement.result = result;
+                            statement.command = command;
+                            statement.error = error;
+                            statement.time = time;
+                            statement.state = state;
+
+                            running--;
+                            completed++;
+                            condition.notify_all();
+                        });
+                    }
+
+                    auto& statement = statements[next];
+
+                    if (statement.state == Statement::WAITING || statement.state == Statement::RUNNING) {
+                        await();
+                        continue;
+                    }
+
+                    // Apply the statement to the session
+                    lock.unlock();
+
+                    if (statement.state == Statement::SEQUENTIAL) {
+                        if (!ExecuteLine(statement, token)) stop = true;
+                    } else {
+                        if (!observer) std::cout << "> " << statement.code << std::endl;
+
+                        if (statement.state == Statement::CANCELLED || statement.state == Statement::FAILED) {
+                            if (observer) {
+                                observer({ statement.line, statement.code, statement.variable, Expression::Void(), statement.time.Seconds(), statement.error });
+                            } else {
+                                Error(statement.error);
+                            }
+                        } else {
+                            if (statement.variable != "") {
+                                session->Set(statement.variable, statement.result, statement.command);
+                            }
+
+                            session->SetCurrent(statement.command, statement.result);
+                            session->AppendToNotebook(statement.code);
+
+                            if (observer) {
+                                observer({ statement.line, statement.code, statement.variable, statement.result, statement.time.Seconds(), "" });
+                            } else if (!statement.silent) {
+                                PrintExpression(statement.result);
+                                std::cout << "\033[90m   " << statement.time << "\033[0m" << std::endl;
+                            }
+                        }
+                    }
+
+                    lock.lock();
+                    next++;
+                }
+
+                // Do not wait for results nobody needs anymore
+                if (stop) {
+                    for (size_t i=begin; i<end; i++) statements[i].limits.Cancel();
+                }
+
+                // The running statements still refer to our state
+                while (running > 0) await();
+
+                return !stop;
             }
         public:
             void PrintExpression(const Expression& expression) {
@@ -444,6 +1275,17 @@ namespace Construction {
                 //std::stringstream ss;
                 //lastResult.Serialize(ss);
 
+                // Stream tensors directly, they might be huge
+                if (expression.IsTensor()) {
+                    std::cout << "\033[" << expression.GetColorCode() << "m";
+
+                    // Shift the output by three characters
+                    if (!expression.Share<Tensor::Tensor>()->Write(std::cout, session->GetPreview(), "   ")) std::cout << std::endl;
+
+                    std::cout << "\033[0m";
+                    return;
+                }
+
                 // Get the output
                 std::stringstream ss;
                 ss << expression.ToString();
@@ -465,10 +1307,20 @@ namespace Construction {
 
             //TensorDatabase database;
 
-            // Store the command to that was executed to create %
-            std::string lastCmd;
             std::string crashFile;
-            std::map<std::string, std::string> definition;
+
+            std::shared_ptr<Session> session;
+            std::shared_ptr<ResultCache> cache;
+            std::shared_ptr<SharedResults> shared;
+
+            // Result of the last line, void if its command returned nothing
+            Expression returned;
+
+            // Throw errors instead of printing them, while in Evaluate
+            bool throwErrors;
+
+            // Takes the results of the script that is executed, if set
+            ScriptObserver observer;
         };
 
     }
@@ -37,6 +37,8 @@ namespace Construction {
 
     namespace Language {
 
+        class Session;
+
         /**
             \class Command
 
@@ -87,11 +89,21 @@ namespace Construction {
          */
         class Command {
         public:
-            Command() = default;
-            Command(const std::string& name) : name(name) { }
+            Command() : session(nullptr) { }
+            Command(const std::string& name) : name(name), session(nullptr) { }
         public:
             std::string GetName() const { return name; }
             void SetName(const std::string& name) { this->name = name; }
+        public:
+            /**
+                \brief Sets the session of the CLI that executes the command
+             */
+            void SetSession(Session* session) { this->session = session; }
+
+            Session& GetSession() const {
+                assert(session != nullptr);
+                return *session;
+            }
         public:
             void AddArgument(const std::shared_ptr<BaseArgument>& arg) {
                 arguments.push_back(arg);
@@ -124,13 +136,13 @@ namespace Construction {
                 return GetArgument<StringArgument>(pos)->GetValue();
             }
 
-            Tensor::Tensor GetTensors(unsigned pos) const {
+            const Tensor::Tensor& GetTensors(unsigned pos) const {
                 assert(pos < arguments.size());
                 assert(arguments[pos]->IsTensorArgument());
                 return GetArgument<TensorArgument>(pos)->GetTensor();
             }
 
-            Tensor::Substitution GetSubstitution(unsigned pos) const {
+            const Tensor::Substitution& GetSubstitution(unsigned pos) const {
                 assert(pos < arguments.size());
                 assert(arguments[pos]->IsSubstitutionArgument());
                 return GetArgument<SubstitutionArgument>(pos)->GetSubstitution();
@@ -184,7 +196,19 @@ namespace Construction {
                 return Execute();
             }
         public:
-            static bool Cachable() { return true; }
+            /**
+                \brief Whether the result may be taken from the ResultCache
+             */
+            virtual bool Cachable() const { return true; }
+
+            /**
+                \brief Whether the result only depends on the arguments
+
+                Pure commands neither read nor change the state of the
+                session, so they may run concurrently to the other
+                commands of a line or script.
+             */
+            virtual bool Pure() const { return true; }
         public:
             virtual std::string Help() const = 0;
             virtual Expression Execute() const = 0;
@@ -192,6 +216,8 @@ namespace Construction {
             std::string name;
 
             std::vector<ArgumentPointer> arguments;
+
+            Session* session;
         };
 
         typedef std::shared_ptr<Command>    CommandPointer;
@@ -0,0 +1,265 @@
+#pragma once
+
+#include <string>
+#include <sstream>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <functional>
+#include <condition_variable>
+
+#include <common/error.hpp>
+#include <common/cancellation.hpp>
+#include <common/executor.hpp>
+#include <common/time_measurement.hpp>
+
+namespace Construction {
+    namespace Language {
+
+        /**
+            \class Jobs
+
+            The background jobs of a session. Every job evaluates one line
+            of code as a background task of the executor, see
+            Executor::SpawnBackground, s.t. jobs only use idle workers and
+            joining threads never end up in a job that runs for hours. The
+            parallel parts of the algorithms it calls run on the executor
+            as usual.
+
+            A job that is waited for before a worker picked it up runs on
+            the waiting thread instead, so waiting never depends on a free
+            worker.
+
+            Jobs are not cancelled by Ctrl-C, which only aborts the
+            command in the foreground, but they are cancelled and joined
+            once the session is destroyed.
+         */
+        class Jobs {
+        public:
+            enum State {
+                RUNNING,
+                FINISHED,
+                FAILED
+            };
+
+            /**
+                \brief Snapshot of a job for listing
+             */
+            struct Info {
+                unsigned id;
+                std::string variable;
+                std::string code;
+                State state;
+                std::string error;
+                std::string time;
+            };
+
+            typedef std::function<void(unsigned, const std::string&)>   Body;
+            typedef std::function<void(const Info&)>                    CompletionFunction;
+
+            // Id of the foreground, which comes after all the jobs
+            static const unsigned Foreground = static_cast<unsigned>(-1);
+        public:
+            Jobs() : nextId(1) { }
+
+            Jobs(const Jobs&) = delete;
+            Jobs& operator=(const Jobs&) = delete;
+
+            ~Jobs() {
+                std::unique_lock<std::mutex> lock(mutex);
+
+                // Jobs that did not start yet never will, the others are
+                // cancelled and still use the session until they are done
+                std::vector<std::shared_ptr<Job>> started;
+
+                for (auto& job : jobs) {
+                    job->token.Cancel();
+                    if (job->started.exchange(true)) started.push_back(job);
+                }
+
+                condition.wait(lock, [&started]() {
+                    for (auto& job : started) {
+                        if (job->state == RUNNING) return false;
+                    }
+                    return true;
+                });
+            }
+        public:
+            /**
+                \brief Starts a job that stores its result into the given variable
+
+                Jobs without a variable store their result in `job<id>`.
+                The body is called with the id of the job and the name of
+                the variable, the completion function after the body
+                returned or threw.
+             */
+            unsigned Start(const std::string& variable, const std::string& code, Body body, CompletionFunction onCompletion = CompletionFunction()) {
+                auto job = std::make_shared<Job>();
+
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+
+                    job->id = nextId++;
+                    job->variable = (variable != "") ? variable : "job" + std::to_string(job->id);
+                    job->code = code;
+                    job->state = RUNNING;
+                    job->body = body;
+                    job->onCompletion = onCompletion;
+
+                    jobs.push_back(job);
+                }
+
+                // The task only touches the job until it was started, the
+                // destructor waits for started jobs
+                Common::Executor::Instance()->SpawnBackground([this, job]() {
+                    if (job->started.exchange(true)) return;
+                    Run(*job);
+                });
+
+                return job->id;
+            }
+
+            /**
+                \brief Waits for the jobs that will write the variable
+
+                Only jobs that were started before the given one are
+                considered, s.t. `x = Simplify(x) &` does not wait for
+                itself. Pass the id of the job that waits, or Foreground.
+                Waiting can be aborted by the cancellation token of the
+                calling thread.
+
+                \throws CancelledException
+             */
+            void WaitFor(const std::string& variable, unsigned self = Foreground) {
+                std::unique_lock<std::mutex> lock(mutex);
+
+                while (true) {
+                    std::shared_ptr<Job> pending;
+                    for (auto& job : jobs) {
+                        if (job->id < self && job->variable == variable && job->state == RUNNING) {
+                            pending = job;
+                            break;
+                        }
+                    }
+
+                    if (!pending) return;
+
+                    // Nobody picked the job up yet, so run it right here
+                    if (!pending->started.exchange(true)) {
+                        lock.unlock();
+                        Run(*pending);
+                        lock.lock();
+                        continue;
+                    }
+
+                    condition.wait_for(lock, std::chrono::milliseconds(50));
+
+                    lock.unlock();
+                    Common::CheckCancellation();
+                    lock.lock();
+                }
+            }
+
+            static std::string StateToString(State state) {
+                switch (state) {
+                    case FINISHED: return "done";
+                    case FAILED: return "failed";
+                    default: return "running";
+                }
+            }
+
+            std::vector<Info> List() const {
+                std::unique_lock<std::mutex> lock(mutex);
+
+                std::vector<Info> result;
+                for (auto& job : jobs) {
+                    result.push_back(ToInfo(*job));
+                }
+                return result;
+            }
+        private:
+            struct Job {
+                Job() : started(false) { }
+
+                unsigned id;
+                std::string variable;
+                std::string code;
+
+                Body body;
+                CompletionFunction onCompletion;
+
+                State state;
+                std::string error;
+
+                Common::TimeMeasurement time;
+                Common::CancellationToken token { false };
+
+                // Set by whoever runs the job, see Start and WaitFor
+                std::atomic<bool> started;
+            };
+
+            /**
+                Runs the job on the calling thread
+             */
+            void Run(Job& job) {
+                State state = FINISHED;
+                std::string error;
+
+                try {
+                    Common::CancellationScope scope(job.token);
+                    job.body(job.id, job.variable);
+                } catch (const std::exception& e) {
+                    state = FAILED;
+                    error = e.what();
+                } catch (...) {
+                    state = FAILED;
+                    error = "Something went terribly wrong";
+                }
+
+                Info info;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    job.time.Stop();
+                    info = ToInfo(job);
+                }
+
+                info.state = state;
+                info.error = error;
+
+                if (job.onCompletion) job.onCompletion(info);
+
+                // Notify under the lock, the destructor may return right after
+                std::unique_lock<std::mutex> lock(mutex);
+                job.state = state;
+                job.error = error;
+
+                condition.notify_all();
+            }
+
+            static Info ToInfo(const Job& job) {
+                Info info;
+                info.id = job.id;
+                info.variable = job.variable;
+                info.code = job.code;
+                info.state = job.state;
+                info.error = job.error;
+
+                std::stringstream ss;
+                ss << job.time;
+                info.time = ss.str();
+
+                return info;
+            }
+
+        private:
+            std::vector<std::shared_ptr<Job>> jobs;
+            unsigned nextId;
+
+            mutable std::mutex mutex;
+            std::condition_variable condition;
+        };
+
+    }
+}
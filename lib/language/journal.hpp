@@ -0,0 +1,264 @@
+#pragma once
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <sstream>
+#include <fstream>
+#include <cstdint>
+#include <functional>
+#include <condition_variable>
+
+#include <tensor/expression.hpp>
+
+namespace Construction {
+    namespace Language {
+
+        /**
+            \class Journal
+
+            Append-only log of the changes to a session, used to recover
+            from crashes. Instead of rewriting the whole session after
+            every command, only the executed lines, the new current result
+            and the changed variables are appended, and this happens on a
+            background thread.
+
+            Every record carries the sequence number of the change. Once
+            the journal has grown large, it is compacted: the session is
+            written into a snapshot, which knows the last change it
+            contains, and the journal starts over. Recovering loads the
+            snapshot and replays the records that came after it.
+
+            The snapshot is stored under the given filename, the journal
+            next to it with the ending `.journal`.
+         */
+        class Journal {
+        public:
+            enum Type {
+                LINE = 1,
+                CURRENT = 2,
+                VARIABLE = 3
+            };
+
+            /**
+                \brief A change of the session
+
+                For lines the name is the line itself, for the current
+                result it is the command that created it.
+             */
+            struct Record {
+                Type type;
+                uint64_t sequence;
+                std::string name;
+                Tensor::Expression expression;
+            };
+
+            /**
+                Writes a snapshot into the file and returns the sequence
+                number of the last change in it
+             */
+            typedef std::function<uint64_t(const std::string&)>     SnapshotFunction;
+        public:
+            Journal(const std::string& filename, SnapshotFunction snapshot, size_t compactionSize = 64 * 1024 * 1024)
+                : filename(filename), snapshot(snapshot), compactionSize(compactionSize), snapshotSequence(0), snapshotRequested(false), terminate(false) {
+                thread = std::thread(&Journal::Run, this);
+            }
+
+            Journal(const Journal&) = delete;
+            Journal& operator=(const Journal&) = delete;
+
+            ~Journal() {
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    terminate = true;
+                }
+
+                condition.notify_all();
+                thread.join();
+            }
+        public:
+            std::string GetSnapshotFilename() const { return filename; }
+            std::string GetJournalFilename() const { return filename + ".journal"; }
+        public:
+            /**
+                \brief Queues a record, it is written in the background
+             */
+            void Append(Record record) {
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    queue.push_back(std::move(record));
+                }
+
+                condition.notify_one();
+            }
+
+            /**
+                \brief Writes a new snapshot in the background
+
+                Needed if the session changed without records, e.g. when
+                it was loaded from a file.
+             */
+            void RequestSnapshot() {
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    snapshotRequested = true;
+                }
+
+                condition.notify_one();
+            }
+
+            /**
+                \brief Reads all complete records from the journal file
+
+                A record that was cut off by a crash ends the replay.
+             */
+            static void Replay(const std::string& filename, std::function<void(const Record&)> apply) {
+                std::ifstream file (filename + ".journal", std::ios::binary);
+                if (!file.is_open()) return;
+
+                while (true) {
+                    Record record;
+
+                    char type;
+                    if (!file.read(&type, 1)) return;
+                    record.type = static_cast<Type>(type);
+
+                    file.read(reinterpret_cast<char*>(&record.sequence), sizeof(record.sequence));
+
+                    record.name = ReadString(file);
+                    auto expression = ReadString(file);
+
+                    if (!file) return;
+
+                    if (record.type != LINE) {
+                        std::stringstream ss (expression);
+                        auto deserialized = Tensor::Expression::Deserialize(ss);
+                        if (!deserialized) return;
+
+                        record.expression = *deserialized;
+                    }
+
+                    apply(record);
+                }
+            }
+        private:
+            void Run() {
+                // Start from a fresh snapshot, s.t. the journal only has
+                // to contain the changes of this run
+                Compact();
+
+                while (true) {
+                    std::deque<Record> batch;
+                    bool requested;
+
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        condition.wait(lock, [this]() { return terminate || snapshotRequested || !queue.empty(); });
+
+                        if (queue.empty() && !snapshotRequested && terminate) return;
+                        std::swap(batch, queue);
+
+                        requested = snapshotRequested;
+                        snapshotRequested = false;
+                    }
+
+                    // Only the latest current result of the batch matters
+                    uint64_t lastCurrent = 0;
+                    for (auto& record : batch) {
+                        if (record.type == CURRENT) lastCurrent = record.sequence;
+                    }
+
+                    for (auto& record : batch) {
+                        // Already in the snapshot
+                        if (record.sequence <= snapshotSequence) continue;
+                        if (record.type == CURRENT && record.sequence != lastCurrent) continue;
+
+                        Write(record);
+                    }
+
+                    journal.flush();
+
+                    if (requested || written > compactionSize) Compact();
+                }
+            }
+
+            void Write(const Record& record) {
+                std::string expression;
+                if (record.type != LINE) {
+                    std::stringstream ss;
+                    record.expression.Serialize(ss);
+                    expression = ss.str();
+                }
+
+                char type = static_cast<char>(record.type);
+                journal.write(&type, 1);
+                journal.write(reinterpret_cast<const char*>(&record.sequence), sizeof(record.sequence));
+
+                WriteString(journal, record.name);
+                WriteString(journal, expression);
+
+                written += 1 + sizeof(record.sequence) + 2 * sizeof(size_t) + record.name.size() + expression.size();
+            }
+
+            /**
+                Writes a snapshot and starts with an empty journal. The
+                snapshot is moved into place before the journal is
+                truncated, and since it knows its last change, a crash in
+                between does not apply anything twice.
+             */
+            void Compact() {
+                auto temporary = filename + ".tmp";
+
+                snapshotSequence = snapshot(temporary);
+                std::rename(temporary.c_str(), filename.c_str());
+
+                if (journal.is_open()) journal.close();
+                journal.open(GetJournalFilename(), std::ios::binary | std::ios::trunc);
+
+                written = 0;
+            }
+
+            static void WriteString(std::ostream& os, const std::string& string) {
+                size_t size = string.size();
+                os.write(reinterpret_cast<const char*>(&size), sizeof(size));
+                os.write(string.data(), string.size());
+            }
+
+            static std::string ReadString(std::istream& is) {
+                size_t size = 0;
+                if (!is.read(reinterpret_cast<char*>(&size), sizeof(size))) return "";
+
+                std::string string;
+                try {
+                    string.assign(size, ' ');
+                } catch (...) {
+                    // Garbage at the end of the journal
+                    is.setstate(std::ios::failbit);
+                    return "";
+                }
+
+                is.read(&string[0], size);
+                return string;
+            }
+        private:
+            std::string filename;
+            SnapshotFunction snapshot;
+            size_t compactionSize;
+
+            std::ofstream journal;
+            size_t written;
+            uint64_t snapshotSequence;
+
+            std::deque<Record> queue;
+            bool snapshotRequested;
+            bool terminate;
+
+            std::mutex mutex;
+            std::condition_variable condition;
+            std::thread thread;
+        };
+
+    }
+}
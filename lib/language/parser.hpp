@@ -581,6 +581,12 @@ namespace Construction {
 
                 GetNext();
 
+                // Commands without arguments, e.g. Jobs()
+                if (current.IsRightBracket()) {
+                    GetNext();
+                    return std::make_shared<CommandNode>(std::move(identifier), std::make_shared<ArgumentsNode>());
+                }
+
                 // Parse the arguments
                 auto arguments = ParseArguments();
                 if (arguments == nullptr) return nullptr;
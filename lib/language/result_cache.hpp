@@ -0,0 +1,225 @@
+#pragma once
+
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <vector>
+#include <algorithm>
+
+#include <unistd.h>
+
+#include <tensor/expression.hpp>
+
+#include <boost/filesystem/operations.hpp>
+#include <boost/iostreams/filtering_streambuf.hpp>
+#include <boost/iostreams/copy.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+
+namespace Construction {
+    namespace Language {
+
+        /**
+            \class ResultCache
+
+            Persistent cache for the results of commands. Every entry is
+            a file in the cache directory, named after the hash of the
+            expanded command string. Variables and `%` in the command are
+            expanded to a hash of their content, so the key only depends on
+            what is actually computed and not on names or history.
+
+            Besides the compressed result, an entry stores the command
+            itself to rule out collisions, the algorithm version it was
+            computed with and how long that took. Entries of another
+            version are ignored, so increase AlgorithmVersion whenever a
+            change in the algorithms changes their results.
+
+            Only results that took at least the minimum cost are stored,
+            everything else is cheaper to recompute than to load. Once the
+            entries take more than the maximum size, the least recently
+            used ones are removed.
+         */
+        class ResultCache {
+        public:
+            static const unsigned AlgorithmVersion = 1;
+        public:
+            ResultCache(const std::string& directory = ".construct-cache", double minimumCost = 0.1, uintmax_t maximumSize = 1024 * 1024 * 1024)
+                : directory(directory), minimumCost(minimumCost), maximumSize(maximumSize) { }
+        public:
+            /**
+                \brief Stable 64 bit FNV-1a hash, independent of the standard library
+             */
+            static std::string Hash(const std::string& text) {
+                uint64_t hash = 14695981039346656037ULL;
+
+                for (unsigned char c : text) {
+                    hash ^= c;
+                    hash *= 1099511628211ULL;
+                }
+
+                std::stringstream ss;
+                ss << std::hex << std::setw(16) << std::setfill('0') << hash;
+                return ss.str();
+            }
+
+            /**
+                \brief Hash of the content of an expression
+             */
+            static std::string Digest(const Tensor::Expression& expression) {
+                std::stringstream ss;
+                expression.Serialize(ss);
+                return Hash(ss.str());
+            }
+        public:
+            /**
+                \brief Looks up the result of the command
+
+                Returns false if there is no valid entry.
+             */
+            bool Lookup(const std::string& command, Tensor::Expression& result) const {
+                std::ifstream file (GetFilename(command), std::ios::binary);
+                if (!file.is_open()) return false;
+
+                try {
+                    std::stringstream is;
+
+                    // Decompress
+                    {
+                        boost::iostreams::filtering_streambuf<boost::iostreams::input> in;
+                        in.push(boost::iostreams::gzip_decompressor());
+                        in.push(file);
+                        boost::iostreams::copy(in, is);
+                    }
+
+                    unsigned version;
+                    is.read(reinterpret_cast<char*>(&version), sizeof(version));
+                    if (!is || version != AlgorithmVersion) return false;
+
+                    double cost;
+                    int64_t created;
+                    is.read(reinterpret_cast<char*>(&cost), sizeof(cost));
+                    is.read(reinterpret_cast<char*>(&created), sizeof(created));
+
+                    // Check for hash collisions
+                    if (ReadString(is) != command) return false;
+
+                    auto expression = Tensor::Expression::Deserialize(is);
+                    if (!expression) return false;
+
+                    // Mark the entry as recently used
+                    boost::system::error_code error;
+                    boost::filesystem::last_write_time(GetFilename(command), std::time(nullptr), error);
+
+                    result = *expression;
+                    return true;
+                } catch (...) {
+                    // Broken entries are treated as missing
+                    return false;
+                }
+            }
+
+            /**
+                \brief Stores the result of the command that took the given time in seconds
+             */
+            void Store(const std::string& command, const Tensor::Expression& result, double cost) const {
+                if (cost < minimumCost || result.IsVoid()) return;
+
+                std::stringstream os;
+
+                unsigned version = AlgorithmVersion;
+                int64_t created = static_cast<int64_t>(std::time(nullptr));
+
+                os.write(reinterpret_cast<const char*>(&version), sizeof(version));
+                os.write(reinterpret_cast<const char*>(&cost), sizeof(cost));
+                os.write(reinterpret_cast<const char*>(&created), sizeof(created));
+
+                WriteString(os, command);
+                result.Serialize(os);
+
+                try {
+                    boost::filesystem::create_directories(directory);
+
+                    // Write to a temporary file first, s.t. readers never see half an entry
+                    static std::atomic<unsigned> counter (0);
+                    auto filename = GetFilename(command);
+                    auto temporary = filename + "." + std::to_string(getpid()) + "." + std::to_string(counter++);
+
+                    {
+                        std::ofstream file (temporary, std::ios::binary);
+
+                        boost::iostreams::filtering_streambuf<boost::iostreams::input> out;
+                        out.push(boost::iostreams::gzip_compressor(boost::iostreams::gzip_params(boost::iostreams::gzip::best_speed)));
+                        out.push(os);
+                        boost::iostreams::copy(out, file);
+                    }
+
+                    std::rename(temporary.c_str(), filename.c_str());
+
+                    Prune();
+                } catch (...) {
+                    // The cache is only an optimization
+                }
+            }
+        private:
+            /**
+                Removes the least recently used entries until the cache
+                fits into the maximum size
+             */
+            void Prune() const {
+                std::vector<std::pair<std::time_t, boost::filesystem::path>> entries;
+                uintmax_t size = 0;
+
+                for (boost::filesystem::directory_iterator it (directory), end; it != end; ++it) {
+                    // Skip the temporary files of other writers
+                    if (!boost::filesystem::is_regular_file(it->status()) || it->path().filename().string().find('.') != std::string::npos) continue;
+
+                    size += boost::filesystem::file_size(it->path());
+                    entries.push_back({ boost::filesystem::last_write_time(it->path()), it->path() });
+                }
+
+                if (size <= maximumSize) return;
+
+                std::sort(entries.begin(), entries.end());
+
+                for (auto& entry : entries) {
+                    if (size <= maximumSize) break;
+
+                    boost::system::error_code error;
+                    auto entrySize = boost::filesystem::file_size(entry.second, error);
+                    if (error) continue;
+
+                    if (boost::filesystem::remove(entry.second, error)) size -= entrySize;
+                }
+            }
+
+            std::string GetFilename(const std::string& command) const {
+                return directory + "/" + Hash(command);
+            }
+
+            static void WriteString(std::ostream& os, const std::string& string) {
+                size_t size = string.size();
+                os.write(reinterpret_cast<const char*>(&size), sizeof(size));
+                os << string;
+            }
+
+            static std::string ReadString(std::istream& is) {
+                size_t size = 0;
+                is.read(reinterpret_cast<char*>(&size), sizeof(size));
+                if (!is) return "";
+
+                std::string string (size, ' ');
+                is.read(&string[0], size);
+                return string;
+            }
+        private:
+            std::string directory;
+            double minimumCost;
+            uintmax_t maximumSize;
+        };
+
+    }
+}
@@ -0,0 +1,353 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <set>
+#include <thread>
+#include <mutex>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <condition_variable>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+
+#include <common/error.hpp>
+#include <language/cli.hpp>
+#include <language/api.hpp>
+
+#include <tensors.pb.h>
+
+namespace Construction {
+    namespace Language {
+
+        class CannotStartServerException : public Exception {
+        public:
+            CannotStartServerException(const std::string& path) : Exception("Cannot listen on " + path) { }
+        };
+
+        /**
+            \class Server
+
+            \brief Answers the requests of the Construction service on a Unix domain socket
+
+            Every client connection gets its own session, s.t. clients
+            can define variables independently, and is served on its
+            own thread. The results of commands are shared between all
+            clients, and if a persistent result cache is given, also with
+            later runs. The in-memory caches
+            and the executor of the process stay warm between requests,
+            so the server only pays the startup cost once.
+
+            If several clients ask for the same command at once, it is
+            only computed once and all of them get the result. Finished
+            results stay in memory for the other clients as well.
+
+            Lines with a trailing `&` run as background jobs of the
+            session of the client, the jobs request lists them.
+
+            The requests and responses are the Request and Response
+            messages of tensors.proto, each preceded by its size as a
+            32 bit integer in network byte order. A client that announces
+            a message larger than MaximumMessageSize is disconnected.
+         */
+        class Server {
+        public:
+            static const uint32_t MaximumMessageSize = 64 * 1024 * 1024;
+        public:
+            Server(const std::string& path, const std::shared_ptr<ResultCache>& cache = nullptr, const std::shared_ptr<SharedResults>& shared = std::make_shared<SharedResults>())
+                : path(path), cache(cache), shared(shared), listening(-1) { }
+
+            ~Server() {
+                Stop();
+            }
+        public:
+            /**
+                \brief Accepts and serves clients until Stop is called
+
+                \throws CannotStartServerException
+             */
+            void Run() {
+                struct sockaddr_un address;
+                std::memset(&address, 0, sizeof(address));
+                address.sun_family = AF_UNIX;
+
+                if (path.size() >= sizeof(address.sun_path)) throw CannotStartServerException(path);
+                std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+                int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+                if (fd < 0) throw CannotStartServerException(path);
+
+                // Remove the socket of an earlier run
+                unlink(path.c_str());
+
+                if (bind(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) < 0 || listen(fd, 16) < 0) {
+                    close(fd);
+                    throw CannotStartServerException(path);
+                }
+
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    listening = fd;
+                }
+
+                while (true) {
+                    int client = accept(fd, nullptr, nullptr);
+
+                    if (client < 0) {
+                        if (errno == EINTR) continue;
+                        break;
+                    }
+
+                    std::unique_lock<std::mutex> lock(mutex);
+
+                    // Stopped in the meantime
+                    if (listening < 0) {
+                        close(client);
+                        break;
+                    }
+
+                    clients.insert(client);
+                    std::thread(&Server::Serve, this, client).detach();
+                }
+            }
+
+            /**
+                \brief Stops accepting clients and disconnects all of them
+
+                Requests that are currently computed are finished first.
+             */
+            void Stop() {
+                std::unique_lock<std::mutex> lock(mutex);
+
+                if (listening >= 0) {
+                    shutdown(listening, SHUT_RDWR);
+                    close(listening);
+                    unlink(path.c_str());
+                    listening = -1;
+                }
+
+                for (auto client : clients) shutdown(client, SHUT_RDWR);
+
+                // Wait for the clients to finish
+                condition.wait(lock, [this]() { return clients.empty(); });
+            }
+        public:
+            /**
+                \brief Answers a single request on the given CLI
+             */
+            construction::Response Handle(CLI& cli, const construction::Request& request) const {
+                construction::Response response;
+
+                try {
+                    Expression result;
+
+                    if (request.has_execute()) {
+                        result = cli.Evaluate(request.execute().command());
+                    } else if (request.has_tensor()) {
+                        auto indices = FromMessage(request.tensor());
+                        result = Share(CLI::GetCommandKey("Arbitrary", indices), [&]() { return API::Arbitrary(indices); });
+                    } else if (request.has_epsilon_gamma()) {
+                        auto indices = FromMessage(request.epsilon_gamma());
+                        result = Share(CLI::GetCommandKey("EpsilonGamma", indices), [&]() { return API::EpsilonGamma(indices); });
+                    } else if (request.has_jobs()) {
+                        ToMessage(cli.GetSession().GetJobs().List(), response.mutable_jobs());
+                        return response;
+                    } else {
+                        response.set_error("Empty request");
+                        return response;
+                    }
+
+                    if (result.IsTensor()) {
+                        ToMessage(*result.Share<Tensor::Tensor>(), response.mutable_tensors());
+                    }
+
+                    response.set_printed(result.ToString());
+                } catch (const std::bad_alloc& e) {
+                    response.set_error("Out of memory");
+                } catch (const std::exception& e) {
+                    response.set_error(e.what());
+                }
+
+                return response;
+            }
+        private:
+            /**
+                Computes the command unless another client already
+                computes or computed it. The key comes from
+                CLI::GetCommandKey, so the result is shared with Execute.
+             */
+            template<typename F>
+            Expression Share(const std::string& command, F fn) const {
+                Expression result;
+                SharedResults::Lease lease;
+
+                if (shared && shared->Acquire(command, result, lease)) return result;
+
+                result = fn();
+                lease.Complete(result);
+
+                return result;
+            }
+        public:
+            static Tensor::Indices FromMessage(const construction::Indices& message) {
+                Tensor::Indices result;
+
+                for (auto& index : message.indices()) {
+                    Tensor::Index i (index.name(), index.printed(), {1,3});
+                    if (index.up()) i.SetContravariant(true);
+
+                    result.Insert(i);
+                }
+
+                return result;
+            }
+
+            static void ToMessage(const Tensor::Indices& indices, construction::Indices* message) {
+                for (auto& index : indices) {
+                    auto i = message->add_indices();
+                    i->set_name(index.GetName());
+                    i->set_printed(index.GetPrintedText());
+                    i->set_up(index.IsContravariant());
+                }
+            }
+
+            static void ToMessage(const std::vector<Jobs::Info>& jobs, construction::JobList* message) {
+                for (auto& job : jobs) {
+                    auto j = message->add_jobs();
+                    j->set_id(job.id);
+                    j->set_variable(job.variable);
+                    j->set_code(job.code);
+                    j->set_state(Jobs::StateToString(job.state));
+                    if (job.state == Jobs::FAILED) j->set_error(job.error);
+                    j->set_time(job.time);
+                }
+            }
+
+            static void ToMessage(const Tensor::Tensor& tensor, construction::TensorInfo* message) {
+                message->set_name(tensor.GetName());
+                message->set_printed(tensor.ToString());
+
+                construction::TensorInfo::Type type = construction::TensorInfo::UNKNOWN;
+                if (tensor.IsEpsilon()) type = construction::TensorInfo::EPSILON;
+                else if (tensor.IsGamma()) type = construction::TensorInfo::GAMMA;
+                else if (tensor.IsEpsilonGamma()) type = construction::TensorInfo::EPSILONGAMMA;
+                else if (tensor.IsAdded()) type = construction::TensorInfo::ADDED;
+                else if (tensor.IsMultiplied()) type = construction::TensorInfo::MULTIPLIED;
+                else if (tensor.IsScaled()) type = construction::TensorInfo::SCALED;
+                else if (tensor.IsSubstitute()) type = construction::TensorInfo::SUBSTITUTED;
+
+                message->set_type(type);
+                ToMessage(tensor.GetIndices(), message->mutable_indices());
+            }
+
+            /**
+                Every summand becomes one symmetrized tensor, whose base
+                tensor is the summand without its scale
+             */
+            static void ToMessage(const Tensor::Tensor& tensor, construction::Tensors* message) {
+                if (tensor.IsZeroTensor()) return;
+
+                for (auto& summand : tensor.GetSummands()) {
+                    auto symmetrized = message->add_tensors();
+                    ToMessage(summand, symmetrized->mutable_info());
+
+                    auto base = summand.IsScaled() ? summand.SeparateScalefactor().second : summand;
+                    ToMessage(base, symmetrized->add_tensors()->mutable_info());
+                }
+            }
+        private:
+            /**
+                Serves the client on its own session until it disconnects
+             */
+            void Serve(int fd) {
+                CLI cli (std::make_shared<Session>());
+                cli.SetCache(cache);
+                cli.SetSharedResults(shared);
+
+                std::string buffer;
+
+                while (ReadMessage(fd, buffer)) {
+                    construction::Request request;
+                    construction::Response response;
+
+                    if (request.ParseFromString(buffer)) {
+                        response = Handle(cli, request);
+                    } else {
+                        response.set_error("Malformed request");
+                    }
+
+                    if (!response.SerializeToString(&buffer) || !WriteMessage(fd, buffer)) break;
+                }
+
+                std::unique_lock<std::mutex> lock(mutex);
+                clients.erase(fd);
+                close(fd);
+
+                condition.notify_all();
+            }
+
+            static bool ReadAll(int fd, char* data, size_t size) {
+                while (size > 0) {
+                    ssize_t n = read(fd, data, size);
+                    if (n < 0 && errno == EINTR) continue;
+                    if (n <= 0) return false;
+
+                    data += n;
+                    size -= n;
+                }
+                return true;
+            }
+
+            static bool WriteAll(int fd, const char* data, size_t size) {
+                while (size > 0) {
+                    ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+                    if (n < 0 && errno == EINTR) continue;
+                    if (n <= 0) return false;
+
+                    data += n;
+                    size -= n;
+                }
+                return true;
+            }
+
+            /**
+                Reads the next message. Returns false if the connection
+                was closed or the announced size exceeds MaximumMessageSize,
+                in which case the client is disconnected.
+             */
+            static bool ReadMessage(int fd, std::string& message) {
+                uint32_t size;
+                if (!ReadAll(fd, reinterpret_cast<char*>(&size), sizeof(size))) return false;
+
+                size = ntohl(size);
+                if (size > MaximumMessageSize) return false;
+
+                message.resize(size);
+                return ReadAll(fd, &message[0], message.size());
+            }
+
+            static bool WriteMessage(int fd, const std::string& message) {
+                uint32_t size = htonl(static_cast<uint32_t>(message.size()));
+                return WriteAll(fd, reinterpret_cast<const char*>(&size), sizeof(size)) && WriteAll(fd, message.data(), message.size());
+            }
+        private:
+            std::string path;
+            std::shared_ptr<ResultCache> cache;
+            std::shared_ptr<SharedResults> shared;
+
+            std::mutex mutex;
+            std::condition_variable condition;
+
+            int listening;
+
+            // Connected clients, each served by its own thread
+            std::set<int> clients;
+        };
+
+    }
+}
@@ -3,13 +3,23 @@
 #include <string>
 #include <sstream>
 #include <map>
+#include <vector>
+#include <memory>
 #include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <cstdio>
+#include <cstdint>
+#include <algorithm>
 
-#include <common/singleton.hpp>
 #include <common/error.hpp>
+#include <common/shared_mutex.hpp>
 
 #include <tensor/expression.hpp>
 #include <language/notebook.hpp>
+#include <language/jobs.hpp>
+#include <language/journal.hpp>
+#include <language/result_cache.hpp>
 
 #include <language/command.hpp>
 #include <language/argument.hpp>
@@ -31,192 +41,570 @@ namespace Construction {
             CannotOpenSessionException() : Exception("Cannot open the session.") { }
         };
 
-        class Session : public Singleton<Session> {
+        /**
+            \class Session
+
+            The state of a CLI: the notebook of executed lines, the most
+            recent result and the variables in memory. Every CLI works on
+            its own session unless one is handed in explicitly.
+
+            All the accessors are thread-safe. Reading variables only takes
+            a shared lock, so several threads, e.g. concurrently solved
+            equations, can read from the same session at once.
+
+            A session can be layered over a parent session. It has its own
+            notebook, current result and variables, but falls back to the
+            variables and jobs of the parent. Background jobs work on such
+            a scratch session, s.t. they do not overwrite `%` of the
+            foreground.
+
+            With a journal enabled, every change is also appended to the
+            journal in the background, see Journal.
+         */
+        class Session {
         public:
-            Session() { }
+            Session() : sequence(0), generation(0), timeout(0), memoryLimit(0), preview(0), parent(nullptr), job(0) { }
+
+            /**
+                Creates a session layered over the given one. The parent
+                has to outlive it, which holds for jobs since the parent
+                joins them on destruction.
+             */
+            Session(Session* parent) : lastCmd(parent->GetLastCommandString()), current(parent->GetCurrent()), sequence(0), generation(0), timeout(parent->GetTimeout()), memoryLimit(parent->GetMemoryLimit()), preview(parent->GetPreview()), parent(parent), job(0) { }
         public:
             Expression GetCurrent() const {
+                Common::SharedLock lock(mutex);
                 return current;
             }
 
             std::string GetLastCommandString() const {
+                Common::SharedLock lock(mutex);
                 return lastCmd;
             }
 
-            Notebook& GetNotebook() { return notebook; }
+            void AppendToNotebook(const std::string& line) {
+                std::unique_lock<Common::SharedMutex> lock(mutex);
+                notebook.Append(line);
+
+                Log(Journal::LINE, line, Expression::Void());
+            }
+
+            /**
+                \brief Sets the most recent result and the command that computed it
 
+                The command is the key of the result for the result caches,
+                see GetCurrentKey, or empty if it is not known.
+             */
             void SetCurrent(const std::string& cmd, const Expression& tensors) {
+                std::unique_lock<Common::SharedMutex> lock(mutex);
                 lastCmd = cmd;
                 current = tensors;
+                generation++;
+
+                Log(Journal::CURRENT, cmd, tensors);
             }
 
-            Expression& Get(const std::string& name) {
-                return memory[name];
+            /**
+                \brief Returns a copy of the variable, or Void if it does not exist
+
+                Variables of a loaded session are read from the file on
+                first access.
+             */
+            Expression Get(const std::string& name) const {
+                {
+                    Common::SharedLock lock(mutex);
+
+                    auto it = memory.find(name);
+                    if (it != memory.end()) return it->second;
+
+                    if (stored.find(name) == stored.end()) {
+                        return parent ? parent->Get(name) : Expression::Void();
+                    }
+                }
+
+                std::unique_lock<Common::SharedMutex> lock(mutex);
+
+                // Another thread might have loaded it in the meantime
+                auto it = memory.find(name);
+                if (it != memory.end()) return it->second;
+
+                auto iter = stored.find(name);
+                if (iter == stored.end()) return parent ? parent->Get(name) : Expression::Void();
+
+                return LoadVariable(iter);
             }
 
-            Expression& operator[](const std::string& name) {
-                return memory[name];
+            /**
+                \brief Sets the variable and the key it has for the result caches
+
+                The key is the expanded command that computed the variable,
+                or empty if it is not known, see GetKey.
+             */
+            void Set(const std::string& name, const Expression& expression, const std::string& key = "") {
+                std::unique_lock<Common::SharedMutex> lock(mutex);
+                memory[name] = expression;
+                stored.erase(name);
+
+                if (key != "") keys[name] = key;
+                else keys.erase(name);
+                generation++;
+
+                Log(Journal::VARIABLE, name, expression);
             }
 
-            size_t Size() const { return memory.size(); }
+            bool Contains(const std::string& name) const {
+                Common::SharedLock lock(mutex);
+                return memory.find(name) != memory.end() || stored.find(name) != stored.end() || (parent && parent->Contains(name));
+            }
+
+            size_t Size() const {
+                Common::SharedLock lock(mutex);
+                return memory.size() + stored.size();
+            }
         public:
-            void SaveToFile(const std::string& filename) const {
-                std::stringstream os;
+            /**
+                \brief Returns the key of the variable for the result caches
+
+                This is the expanded command that computed the variable if
+                it is known, otherwise the hash of its content. The hash is
+                only calculated once per value, so commands that read the
+                variable do not serialize it again. Returns an empty string
+                if the variable does not exist.
+             */
+            std::string GetKey(const std::string& name) const {
+                uint64_t version;
 
-                // Store the notebook
                 {
-                    size_t size = notebook.Size();
-                    os.write(reinterpret_cast<const char*>(&size), sizeof(size));
+                    Common::SharedLock lock(mutex);
 
-                    for (auto& line : notebook) {
-                        // Write line length
-                        size_t size = line.size();
-                        os.write(reinterpret_cast<const char*>(&size), sizeof(size));
+                    auto it = keys.find(name);
+                    if (it != keys.end()) return it->second;
 
-                        // Write the characters
-                        os << line;
+                    if (memory.find(name) == memory.end() && stored.find(name) == stored.end()) {
+                        return parent ? parent->GetKey(name) : "";
                     }
+
+                    version = generation;
                 }
 
-                // Store the current tensors
+                auto key = "#" + ResultCache::Digest(Get(name));
+
+                // Only remember it if the variable did not change in the meantime
+                std::unique_lock<Common::SharedMutex> lock(mutex);
+                if (generation == version) keys[name] = key;
+
+                return key;
+            }
+
+            /**
+                \brief Returns the key of the most recent result, see GetKey
+             */
+            std::string GetCurrentKey() const {
+                Expression expression;
+                uint64_t version;
+
                 {
-                    // Store last command string
-                    {
-                        std::stringstream ss;
-                        current.Serialize(ss);
+                    Common::SharedLock lock(mutex);
+                    if (lastCmd != "") return lastCmd;
 
-                        size_t size = ss.str().size();
-                        os.write(reinterpret_cast<const char*>(&size), sizeof(size));
-                        os << ss.str();
-                    }
+                    expression = current;
+                    version = generation;
+                }
+
+                auto key = "#" + ResultCache::Digest(expression);
+
+                std::unique_lock<Common::SharedMutex> lock(mutex);
+                if (generation == version) lastCmd = key;
+
+                return key;
+            }
+
+            /**
+                \brief Makes the variable the most recent result
+
+                Its key is taken over if it is known, but not calculated.
+             */
+            void SetCurrentToVariable(const std::string& name) {
+                auto expression = Get(name);
+                SetCurrent(GetKnownKey(name), expression);
+            }
+        private:
+            std::string GetKnownKey(const std::string& name) const {
+                Common::SharedLock lock(mutex);
+
+                auto it = keys.find(name);
+                if (it != keys.end()) return it->second;
+
+                if (memory.find(name) == memory.end() && stored.find(name) == stored.end()) {
+                    return parent ? parent->GetKnownKey(name) : "";
                 }
 
-                // Store the memory
+                return "";
+            }
+        public:
+            /**
+                \brief Time limit for every command in seconds, zero means no limit
+             */
+            double GetTimeout() const {
+                Common::SharedLock lock(mutex);
+                return timeout;
+            }
+
+            void SetTimeout(double seconds) {
+                std::unique_lock<Common::SharedMutex> lock(mutex);
+                timeout = seconds;
+            }
+
+            /**
+                \brief Memory limit for every command in megabytes, zero means no limit
+             */
+            double GetMemoryLimit() const {
+                Common::SharedLock lock(mutex);
+                return memoryLimit;
+            }
+
+            void SetMemoryLimit(double megabytes) {
+                std::unique_lock<Common::SharedMutex> lock(mutex);
+                memoryLimit = megabytes;
+            }
+
+            /**
+                \brief Number of summands that are printed of a result, zero means all
+             */
+            size_t GetPreview() const {
+                Common::SharedLock lock(mutex);
+                return preview;
+            }
+
+            void SetPreview(size_t summands) {
+                std::unique_lock<Common::SharedMutex> lock(mutex);
+                preview = summands;
+            }
+        public:
+            /**
+                \brief The background jobs, shared with the parent session
+             */
+            Jobs& GetJobs() { return parent ? parent->GetJobs() : jobs; }
+
+            /**
+                \brief The job that works on this session or the sessions it is layered over
+
+                Returns Jobs::Foreground outside of jobs. Forks of a job's
+                session, e.g. for its arguments on other threads, thereby
+                never wait for the job itself, see Jobs::WaitFor.
+             */
+            unsigned GetJob() const {
+                if (job != 0) return job;
+                return parent ? parent->GetJob() : Jobs::Foreground;
+            }
+
+            void SetJob(unsigned id) { job = id; }
+        public:
+            /**
+                \brief Starts to journal all changes for crash recovery
+
+                The snapshot is written to the given file, the journal next
+                to it. Both are brought up to date with the current state
+                right away.
+             */
+            void EnableJournal(const std::string& filename) {
+                DisableJournal();
+
+                auto journal = std::unique_ptr<Journal>(new Journal(filename, [this](const std::string& file) {
+                    return SaveToFile(file);
+                }));
+
+                std::unique_lock<Common::SharedMutex> lock(mutex);
+                this->journal = std::move(journal);
+            }
+
+            /**
+                \brief Writes the pending records and stops journaling
+             */
+            void DisableJournal() {
+                std::unique_ptr<Journal> journal;
+
                 {
-                    size_t size = memory.size();
-                    os.write(reinterpret_cast<const char*>(&size), sizeof(size));
+                    std::unique_lock<Common::SharedMutex> lock(mutex);
+                    std::swap(journal, this->journal);
                 }
 
-                for (auto it = memory.begin(); it != memory.end(); ++it) {
-                    // Write the name of the variable
-                    {
-                        size_t size = it->first.size();
-                        os.write(reinterpret_cast<const char*>(&size), sizeof(size));
-                        os << it->first;
+                // Joins the writer outside of the lock, it might be taking a snapshot
+                journal.reset();
+            }
+
+            bool HasJournal() const {
+                Common::SharedLock lock(mutex);
+                return journal != nullptr;
+            }
+
+            /**
+                \brief Restores the session from a snapshot and its journal
+
+                \throws CannotOpenSessionException
+             */
+            void Recover(const std::string& filename) {
+                if (std::ifstream(filename).good()) {
+                    LoadFromFile(filename);
+                }
+
+                bool changedCurrent = false;
+
+                Journal::Replay(filename, [&](const Journal::Record& record) {
+                    std::unique_lock<Common::SharedMutex> lock(mutex);
+
+                    // Already in the snapshot
+                    if (record.sequence <= sequence) return;
+                    sequence = record.sequence;
+
+                    switch (record.type) {
+                        case Journal::LINE:
+                            notebook.Append(record.name);
+                            std::cout << "> " << record.name << std::endl;
+                            break;
+
+                        case Journal::CURRENT:
+                            lastCmd = record.name;
+                            current = record.expression;
+                            changedCurrent = true;
+                            break;
+
+                        case Journal::VARIABLE:
+                            memory[record.name] = record.expression;
+                            stored.erase(record.name);
+                            keys.erase(record.name);
+                            break;
                     }
 
-                    // Serialize the tensor container
-                    {
+                    generation++;
+                });
+
+                if (changedCurrent) PrintCurrent();
+            }
+        public:
+            /**
+                \brief Writes the session into a file
+
+                The file starts with a header, followed by the compressed
+                notebook and most recent result, every variable compressed
+                on its own and an index of the variables:
+
+                    "CTSS" | version | last change | offset of the index | size of the head
+                    notebook and current result | variable 1 | variable 2 | ...
+                    number of variables | name 1, offset 1, size 1 | ...
+
+                Variables that were never loaded are copied from the file
+                they came from without decompressing them. The file is
+                written under a temporary name first and then moved.
+
+                Returns the sequence number of the last change that is
+                contained in the file.
+             */
+            uint64_t SaveToFile(const std::string& filename) const {
+                // Snapshots of the journal are written concurrently to the foreground
+                std::unique_lock<std::mutex> fileLock(fileMutex);
+
+                // Only lock the session while serializing, not while compressing
+                std::string head;
+                std::vector<std::pair<std::string, std::string>> variables;
+                std::vector<std::pair<std::string, std::string>> blobs;
+                uint64_t savedSequence;
+
+                {
+                    Common::SharedLock lock(mutex);
+
+                    std::stringstream os;
+                    WriteHead(os);
+                    head = os.str();
+
+                    for (auto& entry : memory) {
                         std::stringstream ss;
-                        it->second.Serialize(ss);
+                        entry.second.Serialize(ss);
+                        variables.push_back({ entry.first, ss.str() });
+                    }
 
-                        size_t size = ss.str().size();
-                        os.write(reinterpret_cast<const char*>(&size), sizeof(size));
-                        os << ss.str();
+                    for (auto& entry : stored) {
+                        blobs.push_back({ entry.first, ReadBlob(entry.second) });
                     }
+
+                    savedSequence = sequence;
                 }
 
-                // Output file
-                std::ofstream file (filename);
+                std::string temporary = filename + ".tmp";
 
-                // Compress
                 {
-                    boost::iostreams::filtering_streambuf <boost::iostreams::input> out;
-                    out.push(boost::iostreams::gzip_compressor(boost::iostreams::gzip_params(boost::iostreams::gzip::best_compression)));
-                    out.push(os);
-                    boost::iostreams::copy(out, file);
+                    std::ofstream file (temporary, std::ios::binary);
+                    if (!file.is_open()) throw CannotOpenSessionException();
+
+                    // Header, the offset of the index is written at the end
+                    file.write("CTSS", 4);
+                    WriteBinary<uint32_t>(file, FileVersion);
+                    WriteBinary<uint64_t>(file, savedSequence);
+                    WriteBinary<uint64_t>(file, 0);
+                    WriteBinary<uint64_t>(file, 0);
+
+                    uint64_t headSize = WriteCompressed(file, head);
+
+                    std::vector<std::pair<std::string, Blob>> index;
+
+                    for (auto& variable : variables) {
+                        Blob blob;
+                        blob.offset = file.tellp();
+                        blob.size = WriteCompressed(file, variable.second);
+                        index.push_back({ variable.first, blob });
+                    }
+
+                    for (auto& raw : blobs) {
+                        Blob blob;
+                        blob.offset = file.tellp();
+                        blob.size = raw.second.size();
+                        file.write(raw.second.data(), raw.second.size());
+                        index.push_back({ raw.first, blob });
+                    }
+
+                    // Index
+                    uint64_t indexOffset = file.tellp();
+
+                    WriteBinary<uint64_t>(file, index.size());
+                    for (auto& entry : index) {
+                        WriteBinary<uint64_t>(file, entry.first.size());
+                        file << entry.first;
+
+                        WriteBinary<uint64_t>(file, entry.second.offset);
+                        WriteBinary<uint64_t>(file, entry.second.size);
+                    }
+
+                    file.seekp(4 + sizeof(uint32_t) + sizeof(uint64_t));
+                    WriteBinary<uint64_t>(file, indexOffset);
+                    WriteBinary<uint64_t>(file, headSize);
                 }
 
-                file.close();
+                std::rename(temporary.c_str(), filename.c_str());
+
+                return savedSequence;
             }
 
             /** 
                 \brief Load a session from a file
 
-                Load a session from a file. It reads all the executed command lines and restores
-                the expressions on the stack and in the variable memory.
+                Load a session from a file. It reads all the executed command lines and the
+                most recent result, but only the index of the variables. A variable is read
+                from the file the first time it is accessed. The file is kept open for this,
+                so it may be overwritten in the meantime.
+
+                Sessions saved by older versions are read completely.
 
                 \param  {std::string}    The filename
 
                 \throws CannotOpenSessionException
              */
             void LoadFromFile(const std::string& filename) {
-                std::ifstream file (filename);
-                std::stringstream is;
+                auto file = std::make_shared<std::ifstream>(filename, std::ios::binary);
+                if (!file->is_open()) throw CannotOpenSessionException();
+
+                std::unique_lock<Common::SharedMutex> lock(mutex);
+
+                // Changes before the load might still be in the journal
+                uint64_t previous = sequence;
 
                 // Clear
-                notebook.Clear();
                 current = Expression::Void();
+                lastCmd = "";
                 memory.clear();
-
-                // Decompress
-                {
-                    boost::iostreams::filtering_streambuf<boost::iostreams::input> out;
-                    out.push(boost::iostreams::gzip_decompressor());
-                    out.push(file);
-                    boost::iostreams::copy(out, is);
+                stored.clear();
+                keys.clear();
+                source.reset();
+                generation++;
+
+                char magic[4];
+                if (!file->read(magic, 4) || std::string(magic, 4) != "CTSS") {
+                    file->clear();
+                    file->seekg(0);
+
+                    Loaded(previous, LoadCompletely(*file));
+                    return;
                 }
 
-                // Read notebook
-                {
-                    size_t numLines;
-                    is.read(reinterpret_cast<char*>(&numLines), sizeof(numLines));
-
-                    for (int i=0; i<numLines; ++i) {
-                        size_t size;
-                        is.read(reinterpret_cast<char*>(&size), sizeof(size));
+                auto version = ReadBinary<uint32_t>(*file);
+                auto savedSequence = ReadBinary<uint64_t>(*file);
+                auto indexOffset = ReadBinary<uint64_t>(*file);
+                auto headSize = ReadBinary<uint64_t>(*file);
 
-                        std::string string (size, ' ');
-                        is.read(&string[0], size);
+                if (!*file || version != FileVersion) throw CannotOpenSessionException();
 
-                        notebook.Append(string);
-                        std::cout << "> " << string << std::endl;
-                    }
-                }
+                source = file;
 
-                // Read the most recent result
+                // Read the notebook and the most recent result
                 {
-                    // Load container data
-                    std::string expressionString;
-                    {
-                        size_t length;
-                        is.read(reinterpret_cast<char*>(&length), sizeof(length));
+                    Blob blob;
+                    blob.offset = file->tellg();
+                    blob.size = headSize;
 
-                        std::string string (length, ' ');
-                        is.read(&string[0], length);
+                    std::stringstream is (Decompress(ReadBlob(blob)));
+                    ReadHead(is);
+                }
 
-                        expressionString = string;
-                    }
+                // Read the index of the variables
+                file->seekg(indexOffset);
 
-                    // Deserialize
-                    {
-                        std::stringstream ss(expressionString);
+                auto size = ReadBinary<uint64_t>(*file);
+                for (uint64_t i=0; i<size; i++) {
+                    auto length = ReadBinary<uint64_t>(*file);
+                    if (!*file) throw CannotOpenSessionException();
 
-                        std::unique_ptr<Expression> expression = Tensor::Expression::Deserialize(ss);
+                    std::string name (length, ' ');
+                    file->read(&name[0], length);
 
-                        if (!expression) throw CannotOpenSessionException();
+                    Blob blob;
+                    blob.offset = ReadBinary<uint64_t>(*file);
+                    blob.size = ReadBinary<uint64_t>(*file);
 
-                        current = *expression;
-                    }
+                    if (!*file) throw CannotOpenSessionException();
+
+                    stored.insert({ name, blob });
                 }
 
-                // Print the most recent result
-                {
-                    std::stringstream ss;
-                    ss << current.ToString();
-                    std::string line;
+                Loaded(previous, savedSequence);
+            }
+        private:
+            static const uint32_t FileVersion = 1;
 
-                    // Change the output color
-                    std::cout << "\033[" << current.GetColorCode() << "m";
+            /**
+                Position of a compressed variable in the session file
+             */
+            struct Blob {
+                uint64_t offset;
+                uint64_t size;
+            };
+
+            /**
+                Keeps the sequence numbers increasing, s.t. the journal
+                does not skip the changes after the load, and writes a
+                snapshot, since the loaded state is not in the journal
+             */
+            void Loaded(uint64_t previous, uint64_t savedSequence) {
+                sequence = std::max(previous, savedSequence);
 
-                    // Shift the output by three characters
-                    while (std::getline(ss, line)) {
-                        std::cout << "   " << line << std::endl;
-                    }
+                if (journal) journal->RequestSnapshot();
+            }
+
+            /**
+                Reads sessions of older versions, which are a single
+                compressed stream that ends with the variables. Returns
+                the last change contained in the file.
+             */
+            uint64_t LoadCompletely(std::istream& file) {
+                std::stringstream is;
+
+                // Decompress
+                {
+                    boost::iostreams::filtering_streambuf<boost::iostreams::input> out;
+                    out.push(boost::iostreams::gzip_decompressor());
+                    out.push(file);
+                    boost::iostreams::copy(out, is);
                 }
-                
-                // Change the color back
-                std::cout << "\033[0m";
+
+                ReadHead(is);
 
                 // Read the memory
                 {
@@ -262,13 +650,222 @@ namespace Construction {
                         memory.insert({name, *expression});
                     }
                 }
+
+                // Read the last change, files of older versions end before
+                uint64_t savedSequence = 0;
+                if (!is.read(reinterpret_cast<char*>(&savedSequence), sizeof(savedSequence))) savedSequence = 0;
+
+                return savedSequence;
+            }
+
+            /**
+                Writes the notebook and the most recent result
+             */
+            void WriteHead(std::ostream& os) const {
+                // Store the notebook
+                {
+                    size_t size = notebook.Size();
+                    os.write(reinterpret_cast<const char*>(&size), sizeof(size));
+
+                    for (auto& line : notebook) {
+                        // Write line length
+                        size_t size = line.size();
+                        os.write(reinterpret_cast<const char*>(&size), sizeof(size));
+
+                        // Write the characters
+                        os << line;
+                    }
+                }
+
+                // Store the current tensors
+                {
+                    std::stringstream ss;
+                    current.Serialize(ss);
+
+                    size_t size = ss.str().size();
+                    os.write(reinterpret_cast<const char*>(&size), sizeof(size));
+                    os << ss.str();
+                }
+            }
+
+            /**
+                Reads the notebook and the most recent result and prints them
+             */
+            void ReadHead(std::istream& is) {
+                // Read notebook
+                {
+                    size_t numLines;
+                    is.read(reinterpret_cast<char*>(&numLines), sizeof(numLines));
+
+                    for (int i=0; i<numLines; ++i) {
+                        size_t size;
+                        is.read(reinterpret_cast<char*>(&size), sizeof(size));
+
+                        std::string string (size, ' ');
+                        is.read(&string[0], size);
+
+                        notebook.Append(string);
+                        std::cout << "> " << string << std::endl;
+                    }
+                }
+
+                // Read the most recent result
+                {
+                    size_t length;
+                    is.read(reinterpret_cast<char*>(&length), sizeof(length));
+
+                    std::string string (length, ' ');
+                    is.read(&string[0], length);
+
+                    std::stringstream ss (string);
+                    auto expression = Tensor::Expression::Deserialize(ss);
+
+                    if (!expression) throw CannotOpenSessionException();
+
+                    current = *expression;
+                }
+
+                // Print the most recent result
+                PrintCurrent();
+            }
+
+            /**
+                Reads a variable that was not accessed since the session
+                was loaded. Has to be called under the exclusive lock.
+             */
+            Expression LoadVariable(const std::map<std::string, Blob>::iterator& it) const {
+                std::stringstream is (Decompress(ReadBlob(it->second)));
+
+                auto expression = Tensor::Expression::Deserialize(is);
+                if (!expression) throw CannotOpenSessionException();
+
+                auto result = memory.insert({ it->first, *expression }).first->second;
+                stored.erase(it);
+
+                return result;
+            }
+
+            /**
+                Reads the raw bytes of a blob from the loaded file. The
+                exclusive lock of the loader and the shared lock of the
+                writer keep the readers of the file apart.
+             */
+            std::string ReadBlob(const Blob& blob) const {
+                if (!source) throw CannotOpenSessionException();
+
+                std::string result (blob.size, ' ');
+                source->clear();
+                source->seekg(blob.offset);
+                source->read(&result[0], result.size());
+
+                if (!*source) throw CannotOpenSessionException();
+                return result;
+            }
+
+            static std::string Decompress(const std::string& blob) {
+                std::stringstream compressed (blob);
+                std::stringstream is;
+
+                boost::iostreams::filtering_streambuf<boost::iostreams::input> in;
+                in.push(boost::iostreams::gzip_decompressor());
+                in.push(compressed);
+                boost::iostreams::copy(in, is);
+
+                return is.str();
+            }
+
+            static uint64_t WriteCompressed(std::ostream& os, const std::string& data) {
+                auto start = os.tellp();
+                std::stringstream is (data);
+
+                boost::iostreams::filtering_streambuf<boost::iostreams::input> out;
+                out.push(boost::iostreams::gzip_compressor(boost::iostreams::gzip_params(boost::iostreams::gzip::best_compression)));
+                out.push(is);
+                boost::iostreams::copy(out, os);
+
+                return static_cast<uint64_t>(os.tellp() - start);
+            }
+
+            template<typename S>
+            static void WriteBinary(std::ostream& os, S value) {
+                os.write(reinterpret_cast<const char*>(&value), sizeof(value));
+            }
+
+            template<typename S>
+            static S ReadBinary(std::istream& is) {
+                S value = 0;
+                is.read(reinterpret_cast<char*>(&value), sizeof(value));
+                return value;
+            }
+
+            /**
+                Counts the change and hands it to the journal. Has to be
+                called under the exclusive lock, s.t. the records are
+                queued in the order of their sequence numbers.
+             */
+            void Log(Journal::Type type, const std::string& name, const Expression& expression) {
+                ++sequence;
+                if (!journal) return;
+
+                Journal::Record record;
+                record.type = type;
+                record.sequence = sequence;
+                record.name = name;
+                record.expression = expression;
+
+                journal->Append(std::move(record));
+            }
+
+            void PrintCurrent() const {
+                std::stringstream ss;
+                ss << current.ToString();
+                std::string line;
+
+                // Change the output color
+                std::cout << "\033[" << current.GetColorCode() << "m";
+
+                // Shift the output by three characters
+                while (std::getline(ss, line)) {
+                    std::cout << "   " << line << std::endl;
+                }
+
+                // Change the color back
+                std::cout << "\033[0m";
             }
         private:
             Notebook notebook;
 
-            std::string lastCmd;
+            mutable std::string lastCmd;
             Expression current;
-            std::map<std::string, Expression> memory;
+            // Variables that are not loaded yet stay in the file
+            mutable std::map<std::string, Expression> memory;
+            mutable std::map<std::string, Blob> stored;
+            mutable std::shared_ptr<std::ifstream> source;
+            uint64_t sequence;
+
+            // The keys of the variables for the result caches, see GetKey
+            mutable std::map<std::string, std::string> keys;
+
+            // Changes with every write, s.t. keys are only remembered for unchanged values
+            uint64_t generation;
+
+            double timeout;
+            double memoryLimit;
+            size_t preview;
+
+            mutable Common::SharedMutex mutex;
+            mutable std::mutex fileMutex;
+
+            // Destroyed before the state, its writer still takes snapshots
+            std::unique_ptr<Journal> journal;
+
+            Session* parent;
+
+            // The job that works on this session, 0 if none
+            unsigned job;
+
+            // Destroyed first, the running jobs still use the session
+            Jobs jobs;
         };
 
         /**
@@ -281,9 +878,17 @@ namespace Construction {
                 return "SaveSession(<String>)";
             }
 
+            bool Cachable() const {
+                return false;
+            }
+
+            bool Pure() const {
+                return false;
+            }
+
             Expression Execute() const {
                 auto filename = GetString(0);
-                Session::Instance()->SaveToFile(filename);
+                GetSession().SaveToFile(filename);
 
                 return Expression::Void();
             }
@@ -305,9 +910,17 @@ namespace Construction {
                 return "LoadSession(<String>)";
             }
 
+            bool Cachable() const {
+                return false;
+            }
+
+            bool Pure() const {
+                return false;
+            }
+
             Expression Execute() const {
                 auto filename = GetString(0);
-                Session::Instance()->LoadFromFile(filename);
+                GetSession().LoadFromFile(filename);
 
                 return Expression::Void();
             }
@@ -316,5 +929,156 @@ namespace Construction {
         REGISTER_COMMAND(LoadSession);
         REGISTER_ARGUMENT(LoadSession, 0, ArgumentType::STRING);
 
+        /**
+            \class TimeoutCommand
+
+            Sets the time limit in seconds for all the following commands.
+            A command that takes longer is aborted. Zero disables the limit.
+         */
+        CLI_COMMAND(Timeout)
+            std::string Help() const {
+                return "Timeout(<Numeric>)";
+            }
+
+            bool Cachable() const {
+                return false;
+            }
+
+            bool Pure() const {
+                return false;
+            }
+
+            Expression Execute() const {
+                GetSession().SetTimeout(GetNumeric(0));
+
+                return Expression::Void();
+            }
+        };
+
+        REGISTER_COMMAND(Timeout);
+        REGISTER_ARGUMENT(Timeout, 0, ArgumentType::NUMERIC);
+
+        /**
+            \class MemoryLimitCommand
+
+            Sets the memory limit in megabytes for all the following commands.
+            A command that makes the process grow above the limit is aborted.
+            Zero disables the limit.
+         */
+        CLI_COMMAND(MemoryLimit)
+            std::string Help() const {
+                return "MemoryLimit(<Numeric>)";
+            }
+
+            bool Cachable() const {
+                return false;
+            }
+
+            bool Pure() const {
+                return false;
+            }
+
+            Expression Execute() const {
+                GetSession().SetMemoryLimit(GetNumeric(0));
+
+                return Expression::Void();
+            }
+        };
+
+        REGISTER_COMMAND(MemoryLimit);
+        REGISTER_ARGUMENT(MemoryLimit, 0, ArgumentType::NUMERIC);
+
+        /**
+            \class PreviewCommand
+
+            Sets the number of summands that are printed of the following
+            results, the rest is only counted. Zero prints all of them.
+         */
+        CLI_COMMAND(Preview)
+            std::string Help() const {
+                return "Preview(<Numeric>)";
+            }
+
+            bool Cachable() const {
+                return false;
+            }
+
+            bool Pure() const {
+                return false;
+            }
+
+            Expression Execute() const {
+                GetSession().SetPreview(static_cast<size_t>(std::max(0.0, GetNumeric(0))));
+
+                return Expression::Void();
+            }
+        };
+
+        REGISTER_COMMAND(Preview);
+        REGISTER_ARGUMENT(Preview, 0, ArgumentType::NUMERIC);
+
+        /**
+            \class JobsCommand
+
+            Lists the background jobs of the session, i.e. the lines that
+            were started with a trailing `&` or Background(...).
+         */
+        CLI_COMMAND(Jobs)
+            std::string Help() const {
+                return "Jobs()";
+            }
+
+            bool Cachable() const {
+                return false;
+            }
+
+            bool Pure() const {
+                return false;
+            }
+
+            Expression Execute() const {
+                for (auto& job : GetSession().GetJobs().List()) {
+                    std::cout << "   [" << job.id << "] " << std::left << std::setw(10) << Jobs::StateToString(job.state) << job.code << " -> " << job.variable;
+                    std::cout << "\033[90m   " << job.time << "\033[0m" << std::endl;
+
+                    if (job.state == Jobs::FAILED) {
+                        std::cout << "       " << job.error << std::endl;
+                    }
+                }
+
+                return Expression::Void();
+            }
+        };
+
+        REGISTER_COMMAND(Jobs);
+
+        /**
+            \class WaitCommand
+
+            Joins the background job that computes the given variable and
+            returns its result. Using the variable anywhere else waits as
+            well, so this is mostly a way to make the waiting explicit.
+         */
+        CLI_COMMAND(Wait)
+            std::string Help() const {
+                return "Wait(<Tensor>)";
+            }
+
+            bool Cachable() const {
+                return false;
+            }
+
+            bool Pure() const {
+                return false;
+            }
+
+            Expression Execute() const {
+                return GetTensors(0);
+            }
+        };
+
+        REGISTER_COMMAND(Wait);
+        REGISTER_ARGUMENT(Wait, 0, ArgumentType::TENSOR);
+
     }
 }
\ No newline at end of file
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <string>
+#include <sstream>
+#include <set>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+
+#include <common/cache.hpp>
+#include <common/cancellation.hpp>
+#include <tensor/expression.hpp>
+
+namespace Construction {
+    namespace Language {
+
+        /**
+            \class SharedResults
+
+            \brief Shares the results of commands between concurrent sessions
+
+            The results are keyed by the expanded command string, which
+            names variables and `%` by a hash of their content, so equal
+            keys mean equal computations in every session. Finished
+            results are kept in memory within the budget.
+
+            If a command is requested while another session computes it,
+            the request waits for that result instead of computing it a
+            second time. The computing session holds a Lease, which hands
+            the result to all waiters once it is completed. If it is
+            destroyed without a result, e.g. due to an error, one of the
+            waiters computes the command instead.
+         */
+        class SharedResults {
+        public:
+            /**
+                Estimates the memory of an expression by its serialized size
+             */
+            struct ExpressionWeight {
+                size_t operator()(const Tensor::Expression& expression) const {
+                    std::stringstream ss;
+                    expression.Serialize(ss);
+                    return sizeof(Tensor::Expression) + static_cast<size_t>(ss.tellp());
+                }
+            };
+
+            /**
+                The right and duty to compute a command for everybody
+             */
+            class Lease {
+            public:
+                Lease() : owner(nullptr) { }
+
+                ~Lease() {
+                    if (owner) owner->Release(command, nullptr);
+                }
+
+                Lease(const Lease&) = delete;
+                Lease& operator=(const Lease&) = delete;
+            public:
+                /**
+                    \brief Hands the result to all waiting sessions
+                 */
+                void Complete(const Tensor::Expression& result) {
+                    if (!owner) return;
+
+                    owner->Release(command, &result);
+                    owner = nullptr;
+                }
+            private:
+                friend class SharedResults;
+
+                SharedResults* owner;
+                std::string command;
+            };
+        public:
+            SharedResults(size_t budget = 1024*1024*1024) : results(budget), coalesced(0) { }
+        public:
+            /**
+                \brief Returns the result of the command if it is known
+
+                If the command is computed by another session, this waits
+                for its result. Otherwise the lease is handed out and the
+                caller has to compute the command and complete the lease.
+             */
+            bool Acquire(const std::string& command, Tensor::Expression& result, Lease& lease) {
+                std::unique_lock<std::mutex> lock(mutex);
+
+                bool waited = false;
+
+                while (true) {
+                    if (results.Get(command, result)) {
+                        if (waited) coalesced++;
+                        return true;
+                    }
+
+                    if (running.count(command) == 0) break;
+
+                    // Stay responsive to the limits of the waiting command
+                    waited = true;
+                    condition.wait_for(lock, std::chrono::milliseconds(100));
+                    Common::CheckCancellation();
+                }
+
+                running.insert(command);
+
+                lease.owner = this;
+                lease.command = command;
+
+                return false;
+            }
+        public:
+            /**
+                \brief Number of requests that were answered by the computation of another one
+             */
+            size_t GetCoalesced() const { return coalesced; }
+
+            Common::Cache<std::string, Tensor::Expression, std::hash<std::string>, ExpressionWeight>::Statistics GetStatistics() const {
+                return results.GetStatistics();
+            }
+        private:
+            void Release(const std::string& command, const Tensor::Expression* result) {
+                bool store = result && !result->IsVoid();
+
+                // Weighing serializes the result, so do it before all
+                // other sessions are locked out
+                size_t size = store ? ExpressionWeight()(*result) : 0;
+
+                std::unique_lock<std::mutex> lock(mutex);
+
+                if (store) results.Set(command, *result, size);
+                running.erase(command);
+
+                condition.notify_all();
+            }
+        private:
+            Common::Cache<std::string, Tensor::Expression, std::hash<std::string>, ExpressionWeight> results;
+
+            std::mutex mutex;
+            std::condition_variable condition;
+
+            // The commands that are computed right now
+            std::set<std::string> running;
+
+            std::atomic<size_t> coalesced;
+        };
+
+    }
+}
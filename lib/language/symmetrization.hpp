@@ -21,7 +21,7 @@ namespace Construction {
                 return "Symmetrize(<Tensors>, <Indices>, ...)";
             }
 
-            static bool Cachable() {
+            bool Cachable() const {
                 return false;
             }
 
@@ -47,7 +47,7 @@ namespace Construction {
                 return "AntiSymmetrize(<Tensors>, <Indices>, ...)";
             }
 
-            static bool Cachable() {
+            bool Cachable() const {
                 return false;
             }
 
@@ -73,7 +73,7 @@ namespace Construction {
                 return "ExchangeSymmetrize(<Tensors>, <Indices>)";
             }
 
-            static bool Cachable() {
+            bool Cachable() const {
                 return true;
             }
 
@@ -94,7 +94,7 @@ namespace Construction {
                 return "BlockSymmetrize(<Tensors>, <Indices>, ...)";
             };
 
-            static bool Cachable() {
+            bool Cachable() const {
                 return true;
             }
 
@@ -119,7 +119,7 @@ namespace Construction {
                 return "IsSymmetric(<Tensors>, <Indices>)";
             }
 
-            static bool Cachable() {
+            bool Cachable() const {
                 return false;
             }
 
@@ -142,7 +142,7 @@ namespace Construction {
                 return "HasExchangeSymmetry(<Tensor>, <Indices>)";
             }
 
-            static bool Cachable() {
+            bool Cachable() const {
                 return false;
             }
 
@@ -180,7 +180,7 @@ namespace Construction {
                 return "Add(<Tensor>, <Tensor>...)";
             }
 
-            static bool Cachable() {
+            bool Cachable() const {
                 return false;
             }
 
@@ -212,7 +212,7 @@ namespace Construction {
                 return "Scale(<Tensor>, <Numeric>)";
             }
 
-            static bool Cachable() {
+            bool Cachable() const {
                 return false;
             }
 
@@ -257,7 +257,7 @@ namespace Construction {
                 return "DegreesOfFreedom(<Tensors>)";
             }
 
-            static bool Cachable() {
+            bool Cachable() const {
                 return false;
             }
 
@@ -278,7 +278,7 @@ namespace Construction {
                 return "IsZero(<Tensor>)";
             }
 
-            static bool Cachable() {
+            bool Cachable() const {
                 return false;
             }
 
@@ -0,0 +1,795 @@
+#pragma once
+
+#include <map>
+#include <tuple>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+
+#include <common/serializable.hpp>
+
+#include <tensor/expression.hpp>
+#include <tensor/scalar.hpp>
+#include <tensor/fraction.hpp>
+#include <tensor/variable.hpp>
+#include <tensor/tensor.hpp>
+#include <tensor/substitution.hpp>
+
+namespace Construction {
+    namespace Tensor {
+
+        using Common::WrongFormatException;
+
+        /**
+            \class Encoding
+
+            \brief Compact binary encoding of expressions
+
+            The names, LaTeX texts and indices of a tensor tree repeat
+            over and over again, in particular in sums with thousands of
+            summands. The encoding therefore collects every distinct
+            string and every distinct index of a blob into a table and
+            the tree only refers to them by their position. All numbers
+            and references are variable length integers, every node
+            starts with a one byte tag.
+
+            A blob consists of
+
+                version | strings | indices | length of the tree | tree
+
+            Since most results are sums of scaled products of epsilons
+            and gammas whose indices are a permutation of the indices
+            of the sum, such sums are stored densely as the scale and the
+            permutation of every summand.
+
+            Indices that a node does not need to be constructed, e.g. the
+            ones of scaled tensors which are taken from the child, are
+            not stored at all.
+
+            Blobs start with Marker when they are embedded into a stream
+            that could also contain the older text based format, which
+            never starts with this value.
+         */
+        class Encoding {
+        public:
+            static const unsigned Marker = 0x43544331;
+            static const uint8_t Version = 1;
+        protected:
+            enum Tag {
+                // Expressions
+                EXPRESSION_VOID = 0,
+                EXPRESSION_TENSOR = 1,
+                EXPRESSION_SCALAR = 2,
+                EXPRESSION_BOOLEAN = 3,
+                EXPRESSION_SUBSTITUTION = 4,
+
+                // Tensors
+                TENSOR_CUSTOM = 10,
+                TENSOR_ADDITION = 11,
+                TENSOR_MULTIPLICATION = 12,
+                TENSOR_SCALED = 13,
+                TENSOR_ZERO = 14,
+                TENSOR_SCALAR = 15,
+                TENSOR_EPSILON = 16,
+                TENSOR_GAMMA = 17,
+                TENSOR_EPSILONGAMMA = 18,
+                TENSOR_DELTA = 19,
+                TENSOR_SUBSTITUTE = 20,
+                TENSOR_EPSILONGAMMA_SUM = 21,
+
+                // Scalars
+                SCALAR_FRACTION = 30,
+                SCALAR_FLOATING_POINT = 31,
+                SCALAR_VARIABLE = 32,
+                SCALAR_ADDED = 33,
+                SCALAR_MULTIPLIED = 34
+            };
+        };
+
+        /**
+            \class Encoder
+
+            Collects expressions and writes them as one blob, s.t. they
+            share the tables.
+
+            Example:
+                Encoder encoder;
+                encoder.Write(expression);
+                encoder.Finish(os);
+         */
+        class Encoder : public Encoding {
+        public:
+            void Write(const Expression& expression) {
+                switch (expression.GetType()) {
+                    case AbstractExpression::TENSOR:
+                        WriteTag(EXPRESSION_TENSOR);
+                        WriteTensor(*expression.As<Tensor>()->As<AbstractTensor>());
+                        break;
+
+                    case AbstractExpression::SCALAR:
+                        WriteTag(EXPRESSION_SCALAR);
+                        WriteScalar(*expression.As<Scalar>()->As<AbstractScalar>());
+                        break;
+
+                    case AbstractExpression::BOOLEAN:
+                        WriteTag(EXPRESSION_BOOLEAN);
+                        WriteNumber(expression.As<BoolExpression>()->GetValue() ? 1 : 0);
+                        break;
+
+                    case AbstractExpression::SUBSTITUTION: {
+                        auto substitution = expression.As<Substitution>();
+
+                        WriteTag(EXPRESSION_SUBSTITUTION);
+                        WriteNumber(substitution->Size());
+
+                        for (auto& pair : *substitution) {
+                            WriteScalar(*pair.first.As<AbstractScalar>());
+                            WriteScalar(*pair.second.As<AbstractScalar>());
+                        }
+                        break;
+                    }
+
+                    default:
+                        WriteTag(EXPRESSION_VOID);
+                }
+            }
+
+            void Write(const Tensor& tensor) {
+                WriteTensor(*tensor.As<AbstractTensor>());
+            }
+
+            /**
+                \brief Writes the tables and everything written so far
+             */
+            void Finish(std::ostream& os) const {
+                std::string header;
+                header.push_back(static_cast<char>(Version));
+
+                AppendNumber(header, stringTable.size());
+                for (auto& string : stringTable) {
+                    AppendNumber(header, string.size());
+                    header.append(string);
+                }
+
+                AppendNumber(header, indexTable.size());
+                for (auto& index : indexTable) {
+                    AppendNumber(header, std::get<0>(index));
+                    AppendNumber(header, std::get<1>(index));
+                    AppendNumber(header, std::get<2>(index));
+                    AppendNumber(header, std::get<3>(index));
+                    header.push_back(std::get<4>(index) ? 1 : 0);
+                }
+
+                AppendNumber(header, body.size());
+
+                os.write(header.data(), header.size());
+                os.write(body.data(), body.size());
+            }
+        private:
+            typedef std::tuple<uint64_t, uint64_t, unsigned, unsigned, bool> IndexEntry;
+
+            void WriteTensor(const AbstractTensor& tensor) {
+                switch (tensor.GetType()) {
+                    case AbstractTensor::TensorType::ADDITION: {
+                        auto& sum = static_cast<const AddedTensor&>(tensor);
+
+                        if (WriteEpsilonGammaSum(sum)) break;
+
+                        WriteHeader(TENSOR_ADDITION, tensor);
+                        WriteIndices(tensor.GetIndices());
+                        WriteNumber(sum.Size());
+
+                        for (size_t i=0; i<sum.Size(); i++) {
+                            WriteTensor(*sum.At(i));
+                        }
+                        break;
+                    }
+
+                    case AbstractTensor::TensorType::MULTIPLICATION: {
+                        auto& product = static_cast<const MultipliedTensor&>(tensor);
+
+                        WriteHeader(TENSOR_MULTIPLICATION, tensor);
+                        WriteTensor(*product.GetFirst());
+                        WriteTensor(*product.GetSecond());
+                        break;
+                    }
+
+                    case AbstractTensor::TensorType::SCALED: {
+                        auto& scaled = static_cast<const ScaledTensor&>(tensor);
+
+                        WriteHeader(TENSOR_SCALED, tensor);
+                        WriteScalar(*scaled.GetScale().As<AbstractScalar>());
+                        WriteTensor(*scaled.GetTensor());
+                        break;
+                    }
+
+                    case AbstractTensor::TensorType::ZERO:
+                        WriteHeader(TENSOR_ZERO, tensor);
+                        break;
+
+                    case AbstractTensor::TensorType::SCALAR:
+                        WriteHeader(TENSOR_SCALAR, tensor);
+                        WriteScalar(*static_cast<const ScalarTensor&>(tensor)().As<AbstractScalar>());
+                        break;
+
+                    case AbstractTensor::TensorType::EPSILON:
+                        WriteHeader(TENSOR_EPSILON, tensor);
+                        WriteIndices(tensor.GetIndices());
+                        break;
+
+                    case AbstractTensor::TensorType::GAMMA: {
+                        auto signature = static_cast<const GammaTensor&>(tensor).GetSignature();
+
+                        WriteHeader(TENSOR_GAMMA, tensor);
+                        WriteIndices(tensor.GetIndices());
+                        WriteSigned(signature.first);
+                        WriteSigned(signature.second);
+                        break;
+                    }
+
+                    case AbstractTensor::TensorType::EPSILONGAMMA: {
+                        auto& epsilonGamma = static_cast<const EpsilonGammaTensor&>(tensor);
+
+                        WriteHeader(TENSOR_EPSILONGAMMA, tensor);
+                        WriteIndices(tensor.GetIndices());
+                        WriteNumber(epsilonGamma.GetNumEpsilons());
+                        WriteNumber(epsilonGamma.GetNumGammas());
+                        break;
+                    }
+
+                    case AbstractTensor::TensorType::DELTA:
+                        WriteHeader(TENSOR_DELTA, tensor);
+                        WriteIndices(tensor.GetIndices());
+                        break;
+
+                    case AbstractTensor::TensorType::SUBSTITUTE:
+                        WriteHeader(TENSOR_SUBSTITUTE, tensor);
+                        WriteIndices(tensor.GetIndices());
+                        WriteTensor(*static_cast<const SubstituteTensor&>(tensor).GetTensor());
+                        break;
+
+                    default:
+                        WriteHeader(TENSOR_CUSTOM, tensor);
+                        WriteIndices(tensor.GetIndices());
+                }
+            }
+
+            /**
+                Writes sums of (scaled) epsilon gamma tensors as the scale
+                and the positions of the indices of every summand in the
+                indices of the sum. Returns false if the sum has any other
+                shape.
+             */
+            bool WriteEpsilonGammaSum(const AddedTensor& sum) {
+                if (sum.Size() == 0) return false;
+
+                auto indices = IndexIds(sum.GetIndices());
+
+                std::map<uint64_t, uint64_t> positions;
+                for (size_t i=0; i<indices.size(); i++) {
+                    positions[indices[i]] = i;
+                }
+                if (positions.size() != indices.size()) return false;
+
+                unsigned numEpsilon = 0, numGamma = 0;
+
+                for (size_t i=0; i<sum.Size(); i++) {
+                    const AbstractTensor* summand = sum.At(i).get();
+
+                    if (summand->GetType() == AbstractTensor::TensorType::SCALED) {
+                        if (!IsUnnamed(*summand)) return false;
+                        summand = static_cast<const ScaledTensor*>(summand)->GetTensor().get();
+                    }
+
+                    if (summand->GetType() != AbstractTensor::TensorType::EPSILONGAMMA || !IsUnnamed(*summand)) return false;
+
+                    auto epsilonGamma = static_cast<const EpsilonGammaTensor*>(summand);
+
+                    if (i == 0) {
+                        numEpsilon = epsilonGamma->GetNumEpsilons();
+                        numGamma = epsilonGamma->GetNumGammas();
+                    } else if (numEpsilon != epsilonGamma->GetNumEpsilons() || numGamma != epsilonGamma->GetNumGammas()) {
+                        return false;
+                    }
+
+                    auto ids = IndexIds(summand->GetIndices());
+                    if (ids.size() != indices.size()) return false;
+
+                    for (auto id : ids) {
+                        if (positions.find(id) == positions.end()) return false;
+                    }
+                }
+
+                WriteHeader(TENSOR_EPSILONGAMMA_SUM, sum);
+                WriteIndices(sum.GetIndices());
+                WriteNumber(numEpsilon);
+                WriteNumber(numGamma);
+                WriteNumber(sum.Size());
+
+                for (size_t i=0; i<sum.Size(); i++) {
+                    const AbstractTensor* summand = sum.At(i).get();
+
+                    if (summand->GetType() == AbstractTensor::TensorType::SCALED) {
+                        auto scaled = static_cast<const ScaledTensor*>(summand);
+
+                        WriteNumber(1);
+                        WriteScalar(*scaled->GetScale().As<AbstractScalar>());
+                        summand = scaled->GetTensor().get();
+                    } else {
+                        WriteNumber(0);
+                    }
+
+                    for (auto id : IndexIds(summand->GetIndices())) {
+                        WriteNumber(positions[id]);
+                    }
+                }
+
+                return true;
+            }
+
+            void WriteScalar(const AbstractScalar& scalar) {
+                switch (scalar.GetType()) {
+                    case AbstractScalar::FRACTION: {
+                        auto& fraction = static_cast<const Fraction&>(scalar);
+
+                        WriteTag(SCALAR_FRACTION);
+                        WriteSigned(fraction.GetNumerator());
+                        WriteNumber(fraction.GetDenominator());
+                        break;
+                    }
+
+                    case AbstractScalar::FLOATING_POINT: {
+                        double value = scalar.ToDouble();
+
+                        WriteTag(SCALAR_FLOATING_POINT);
+                        body.append(reinterpret_cast<const char*>(&value), sizeof(value));
+                        break;
+                    }
+
+                    case AbstractScalar::VARIABLE: {
+                        auto& variable = static_cast<const Variable&>(scalar);
+
+                        WriteTag(SCALAR_VARIABLE);
+                        WriteNumber(StringId(variable.GetName()));
+                        WriteNumber(StringId(variable.GetPrintedText()));
+                        break;
+                    }
+
+                    case AbstractScalar::ADDED: {
+                        auto& added = static_cast<const AddedScalar&>(scalar);
+
+                        WriteTag(SCALAR_ADDED);
+                        WriteScalar(*added.GetFirst());
+                        WriteScalar(*added.GetSecond());
+                        break;
+                    }
+
+                    case AbstractScalar::MULTIPLIED: {
+                        auto& multiplied = static_cast<const MultipliedScalar&>(scalar);
+
+                        WriteTag(SCALAR_MULTIPLIED);
+                        WriteScalar(*multiplied.GetFirst());
+                        WriteScalar(*multiplied.GetSecond());
+                        break;
+                    }
+
+                    default:
+                        throw WrongFormatException();
+                }
+            }
+
+            void WriteHeader(Tag tag, const AbstractTensor& tensor) {
+                WriteTag(tag);
+                WriteNumber(StringId(tensor.GetName()));
+                WriteNumber(StringId(tensor.GetPrintedText()));
+            }
+
+            void WriteIndices(const Indices& indices) {
+                auto ids = IndexIds(indices);
+
+                WriteNumber(ids.size());
+                for (auto id : ids) WriteNumber(id);
+            }
+
+            void WriteTag(Tag tag) {
+                body.push_back(static_cast<char>(tag));
+            }
+
+            void WriteNumber(uint64_t value) {
+                AppendNumber(body, value);
+            }
+
+            void WriteSigned(int64_t value) {
+                // Zigzag, s.t. small negative numbers stay short
+                AppendNumber(body, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+            }
+
+            static void AppendNumber(std::string& buffer, uint64_t value) {
+                while (value >= 0x80) {
+                    buffer.push_back(static_cast<char>((value & 0x7F) | 0x80));
+                    value >>= 7;
+                }
+                buffer.push_back(static_cast<char>(value));
+            }
+
+            static bool IsUnnamed(const AbstractTensor& tensor) {
+                return tensor.GetName().empty() && tensor.GetPrintedText().empty();
+            }
+        private:
+            uint64_t StringId(const std::string& string) {
+                auto it = strings.find(string);
+                if (it != strings.end()) return it->second;
+
+                strings.insert({ string, stringTable.size() });
+                stringTable.push_back(string);
+                return stringTable.size() - 1;
+            }
+
+            std::vector<uint64_t> IndexIds(const Indices& indices) {
+                std::vector<uint64_t> result;
+
+                for (auto& index : indices) {
+                    IndexEntry entry (
+                        StringId(index.GetName()),
+                        StringId(index.GetPrintedText()),
+                        index.GetRange().GetFrom(),
+                        index.GetRange().GetTo(),
+                        index.IsContravariant()
+                    );
+
+                    auto it = indexIds.find(entry);
+                    if (it != indexIds.end()) {
+                        result.push_back(it->second);
+                        continue;
+                    }
+
+                    indexIds.insert({ entry, indexTable.size() });
+                    indexTable.push_back(entry);
+                    result.push_back(indexTable.size() - 1);
+                }
+
+                return result;
+            }
+        private:
+            std::string body;
+
+            std::map<std::string, uint64_t> strings;
+            std::vector<std::string> stringTable;
+
+            std::map<IndexEntry, uint64_t> indexIds;
+            std::vector<IndexEntry> indexTable;
+        };
+
+        /**
+            \class Decoder
+
+            Reads the tables of a blob written by Encoder. The expressions
+            have to be read in the order in which they were written.
+
+            \throws WrongFormatException
+         */
+        class Decoder : public Encoding {
+        public:
+            Decoder(std::istream& is) : position(0) {
+                char version;
+                if (!is.get(version) || static_cast<uint8_t>(version) != Version) throw WrongFormatException();
+
+                // Read the strings
+                auto numStrings = ReadNumber(is);
+                for (uint64_t i=0; i<numStrings; i++) {
+                    stringTable.push_back(ReadString(is, ReadNumber(is)));
+                }
+
+                // Read the indices
+                auto numIndices = ReadNumber(is);
+                for (uint64_t i=0; i<numIndices; i++) {
+                    auto& name = String(ReadNumber(is));
+                    auto& printed = String(ReadNumber(is));
+                    unsigned from = ReadNumber(is);
+                    unsigned to = ReadNumber(is);
+
+                    char up;
+                    if (!is.get(up)) throw WrongFormatException();
+
+                    Index index (name, printed, Range(from, to));
+                    index.SetContravariant(up != 0);
+                    indexTable.push_back(index);
+                }
+
+                // The tree is decoded from memory
+                body = ReadString(is, ReadNumber(is));
+            }
+        public:
+            ExpressionPointer ReadExpression() {
+                switch (ReadTag()) {
+                    case EXPRESSION_VOID:
+                        return ExpressionPointer(new VoidExpression());
+
+                    case EXPRESSION_TENSOR:
+                        return ExpressionPointer(new Tensor(ReadTensorTree()));
+
+                    case EXPRESSION_SCALAR:
+                        return ExpressionPointer(new Scalar(ReadScalar()));
+
+                    case EXPRESSION_BOOLEAN:
+                        return ExpressionPointer(new BoolExpression(ReadNumber() != 0));
+
+                    case EXPRESSION_SUBSTITUTION: {
+                        std::unique_ptr<Substitution> result (new Substitution());
+
+                        auto size = ReadNumber();
+                        for (uint64_t i=0; i<size; i++) {
+                            Scalar lhs (ReadScalar());
+                            Scalar rhs (ReadScalar());
+                            result->Insert(lhs, rhs);
+                        }
+
+                        return result;
+                    }
+
+                    default:
+                        throw WrongFormatException();
+                }
+            }
+
+            Tensor ReadTensor() {
+                return Tensor(ReadTensorTree());
+            }
+        private:
+            TensorPointer ReadTensorTree() {
+                auto tag = ReadTag();
+
+                auto& name = String(ReadNumber());
+                auto& printed = String(ReadNumber());
+
+                TensorPointer result;
+
+                switch (tag) {
+                    case TENSOR_ADDITION: {
+                        auto indices = ReadIndices();
+                        auto size = ReadNumber();
+
+                        std::vector<TensorPointer> summands;
+                        summands.reserve(size);
+
+                        for (uint64_t i=0; i<size; i++) {
+                            summands.push_back(ReadTensorTree());
+                        }
+
+                        result = TensorPointer(new AddedTensor(std::move(summands), indices));
+                        break;
+                    }
+
+                    case TENSOR_EPSILONGAMMA_SUM:
+                        result = ReadEpsilonGammaSum();
+                        break;
+
+                    case TENSOR_MULTIPLICATION: {
+                        auto A = ReadTensorTree();
+                        auto B = ReadTensorTree();
+                        result = TensorPointer(new MultipliedTensor(std::move(A), std::move(B)));
+                        break;
+                    }
+
+                    case TENSOR_SCALED: {
+                        Scalar c (ReadScalar());
+                        auto A = ReadTensorTree();
+                        result = TensorPointer(new ScaledTensor(std::move(A), c));
+                        break;
+                    }
+
+                    case TENSOR_ZERO:
+                        result = TensorPointer(new ZeroTensor());
+                        break;
+
+                    case TENSOR_SCALAR:
+                        result = TensorPointer(new ScalarTensor(name, printed, Scalar(ReadScalar())));
+                        break;
+
+                    case TENSOR_EPSILON:
+                        result = TensorPointer(new EpsilonTensor(ReadIndices()));
+                        break;
+
+                    case TENSOR_GAMMA: {
+                        auto indices = ReadIndices();
+                        int p = ReadSigned();
+                        int q = ReadSigned();
+                        result = TensorPointer(new GammaTensor(indices, p, q));
+                        break;
+                    }
+
+                    case TENSOR_EPSILONGAMMA: {
+                        auto indices = ReadIndices();
+                        unsigned numEpsilon = ReadNumber();
+                        unsigned numGamma = ReadNumber();
+                        result = TensorPointer(new EpsilonGammaTensor(numEpsilon, numGamma, indices));
+                        break;
+                    }
+
+                    case TENSOR_DELTA:
+                        result = TensorPointer(new DeltaTensor(ReadIndices()));
+                        break;
+
+                    case TENSOR_SUBSTITUTE: {
+                        auto indices = ReadIndices();
+                        auto A = ReadTensorTree();
+                        result = TensorPointer(new SubstituteTensor(std::move(A), indices));
+                        break;
+                    }
+
+                    case TENSOR_CUSTOM:
+                        return TensorPointer(new AbstractTensor(name, printed, ReadIndices()));
+
+                    default:
+                        throw WrongFormatException();
+                }
+
+                result->SetName(name);
+                result->SetPrintedText(printed);
+
+                return result;
+            }
+
+            TensorPointer ReadEpsilonGammaSum() {
+                auto indices = ReadIndices();
+                unsigned numEpsilon = ReadNumber();
+                unsigned numGamma = ReadNumber();
+                auto size = ReadNumber();
+
+                std::vector<TensorPointer> summands;
+                summands.reserve(size);
+
+                for (uint64_t i=0; i<size; i++) {
+                    bool scaled = (ReadNumber() != 0);
+
+                    ScalarPointer c;
+                    if (scaled) c = ReadScalar();
+
+                    Indices permuted;
+                    for (size_t j=0; j<indices.Size(); j++) {
+                        auto position = ReadNumber();
+                        if (position >= indices.Size()) throw WrongFormatException();
+
+                        permuted.Insert(indices[position]);
+                    }
+
+                    TensorPointer summand (new EpsilonGammaTensor(numEpsilon, numGamma, permuted));
+
+                    if (scaled) {
+                        summand = TensorPointer(new ScaledTensor(std::move(summand), Scalar(std::move(c))));
+                    }
+
+                    summands.push_back(std::move(summand));
+                }
+
+                return TensorPointer(new AddedTensor(std::move(summands), indices));
+            }
+
+            ScalarPointer ReadScalar() {
+                switch (ReadTag()) {
+                    case SCALAR_FRACTION: {
+                        int numerator = ReadSigned();
+                        unsigned denominator = ReadNumber();
+                        return ScalarPointer(new Fraction(numerator, denominator));
+                    }
+
+                    case SCALAR_FLOATING_POINT: {
+                        if (position + sizeof(double) > body.size()) throw WrongFormatException();
+
+                        double value;
+                        std::memcpy(&value, &body[position], sizeof(value));
+                        position += sizeof(value);
+
+                        return ScalarPointer(new FloatingPointScalar(value));
+                    }
+
+                    case SCALAR_VARIABLE: {
+                        auto& name = String(ReadNumber());
+                        auto& printed = String(ReadNumber());
+                        return ScalarPointer(new Variable(name, printed));
+                    }
+
+                    case SCALAR_ADDED: {
+                        auto A = ReadScalar();
+                        auto B = ReadScalar();
+                        return ScalarPointer(new AddedScalar(std::move(A), std::move(B)));
+                    }
+
+                    case SCALAR_MULTIPLIED: {
+                        auto A = ReadScalar();
+                        auto B = ReadScalar();
+                        return ScalarPointer(new MultipliedScalar(std::move(A), std::move(B)));
+                    }
+
+                    default:
+                        throw WrongFormatException();
+                }
+            }
+
+            Indices ReadIndices() {
+                Indices result;
+
+                auto size = ReadNumber();
+                for (uint64_t i=0; i<size; i++) {
+                    auto id = ReadNumber();
+                    if (id >= indexTable.size()) throw WrongFormatException();
+
+                    result.Insert(indexTable[id]);
+                }
+
+                return result;
+            }
+
+            const std::string& String(uint64_t id) const {
+                if (id >= stringTable.size()) throw WrongFormatException();
+                return stringTable[id];
+            }
+
+            unsigned ReadTag() {
+                if (position >= body.size()) throw WrongFormatException();
+                return static_cast<uint8_t>(body[position++]);
+            }
+
+            uint64_t ReadNumber() {
+                uint64_t value = 0;
+
+                for (unsigned shift = 0; shift < 64; shift += 7) {
+                    if (position >= body.size()) throw WrongFormatException();
+
+                    uint8_t byte = static_cast<uint8_t>(body[position++]);
+                    value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+
+                    if (!(byte & 0x80)) return value;
+                }
+
+                throw WrongFormatException();
+            }
+
+            int64_t ReadSigned() {
+                auto value = ReadNumber();
+                return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+            }
+
+            static uint64_t ReadNumber(std::istream& is) {
+                uint64_t value = 0;
+
+                for (unsigned shift = 0; shift < 64; shift += 7) {
+                    char c;
+                    if (!is.get(c)) throw WrongFormatException();
+
+                    uint8_t byte = static_cast<uint8_t>(c);
+                    value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+
+                    if (!(byte & 0x80)) return value;
+                }
+
+                throw WrongFormatException();
+            }
+
+            static std::string ReadString(std::istream& is, uint64_t size) {
+                std::string result;
+
+                // Read in chunks, s.t. a broken size does not allocate everything at once
+                char buffer[4096];
+                while (size > 0) {
+                    auto chunk = std::min<uint64_t>(size, sizeof(buffer));
+                    if (!is.read(buffer, chunk)) throw WrongFormatException();
+
+                    result.append(buffer, chunk);
+                    size -= chunk;
+                }
+
+                return result;
+            }
+        private:
+            std::vector<std::string> stringTable;
+            std::vector<Index> indexTable;
+
+            std::string body;
+            size_t position;
+        };
+
+    }
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <memory>
+#include <type_traits>
 #include <string>
 #include <sstream>
 #include <iostream>
@@ -84,6 +85,8 @@ namespace Construction {
 			}
 		public:
 			virtual int GetColorCode() const override { return (value) ? 32 : 31; }
+
+			bool GetValue() const { return value; }
 		public:
 			virtual void Serialize(std::ostream& os) const override {
 				WriteBinary<char>(os, static_cast<char>(value));
@@ -97,14 +100,25 @@ namespace Construction {
 			bool value;
 		};
 
+		/**
+			\class Expression
+
+			Handle to an immutable expression. Copies share the expression,
+			so passing even huge tensors around costs O(1). Access to the
+			expression is only possible through const pointers or copies.
+		 */
 		class Expression : public Common::Printable, public Serializable<Expression> {
 		public:
 			Expression() : pointer(ExpressionPointer(new VoidExpression())) { }
 
-			Expression(const Expression& other) : pointer(std::move(other.pointer->Clone())) { }
-			Expression(Expression&& other) : pointer(std::move(other.pointer)) { }
+			Expression(const Expression& other) = default;
+			Expression(Expression&& other) = default;
 
 			Expression(const AbstractExpression& expr) : pointer(expr.Clone()) { }
+
+			// Take over temporaries, e.g. the results of commands, without a clone
+			template<class T, typename = typename std::enable_if<std::is_base_of<AbstractExpression, T>::value && !std::is_lvalue_reference<T>::value>::type>
+			Expression(T&& expr) : pointer(std::make_shared<T>(std::move(expr))) { }
 		private:
 			Expression(ExpressionPointer pointer) : pointer(std::move(pointer)) { }
 		public:
@@ -114,15 +128,8 @@ namespace Construction {
 			static Expression True() { return Expression(ExpressionPointer(new BoolExpression(true))); }
 			static Expression False() { return Expression(ExpressionPointer(new BoolExpression(false))); }
 		public:
-			Expression& operator=(const Expression& other) {
-				pointer = std::move(other.pointer->Clone());
-				return *this;
-			}
-
-			Expression& operator=(Expression&& other) {
-				pointer = std::move(other.pointer);
-				return *this;
-			}
+			Expression& operator=(const Expression& other) = default;
+			Expression& operator=(Expression&& other) = default;
 		public:
 			inline int GetColorCode() const { return pointer->GetColorCode(); }
 		public:
@@ -151,12 +158,19 @@ namespace Construction {
             static std::unique_ptr<Expression> Deserialize(std::istream& is);
 		public:
 			template<class T>
-			T As() { return *static_cast<T*>(pointer.get()); }
+			T As() { return *static_cast<const T*>(pointer.get()); }
 
 			template<class T>
 			const T* As() const { return static_cast<const T*>(pointer.get()); }
+
+			/**
+				Returns a handle to the expression that keeps it alive
+				without copying it
+			 */
+			template<class T>
+			std::shared_ptr<const T> Share() const { return std::static_pointer_cast<const T>(pointer); }
 		private:
-			ExpressionPointer pointer;
+			std::shared_ptr<const AbstractExpression> pointer;
 		};
 
 	}
@@ -16,6 +16,9 @@ namespace Construction {
             Fraction(int numerator, unsigned int denominator) :  AbstractScalar(AbstractScalar::FRACTION), numerator(numerator), denominator(denominator) { }
 
             virtual ~Fraction() = default;
+        public:
+            int GetNumerator() const { return numerator; }
+            unsigned GetDenominator() const { return denominator; }
         public:
             int gcd(int num1, int num2) {
                 int tmp;
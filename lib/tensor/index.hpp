@@ -10,7 +10,7 @@
 #include <common/printable.hpp>
 #include <common/range.hpp>
 #include <common/serializable.hpp>
-#include <common/task_pool.hpp>
+#include <common/executor.hpp>
 
 namespace Construction {
 	namespace Tensor {
@@ -1096,6 +1096,43 @@ namespace Construction {
 			std::vector<Index> indices;
 		};
 
+		/**
+			Hashes the indices with everything that distinguishes them, i.e.
+			name, printed text, range and variance, e.g. for caches keyed
+			by indices
+		 */
+		struct IndicesHasher {
+			size_t operator()(const Indices& indices) const {
+				size_t result = indices.Size();
+				for (auto& index : indices) {
+					result = result * 31 + std::hash<std::string>()(index.GetName());
+					result = result * 31 + std::hash<std::string>()(index.GetPrintedText());
+					result = result * 31 + index.GetRange().GetFrom();
+					result = result * 31 + index.GetRange().GetTo();
+					result = result * 31 + index.IsContravariant();
+				}
+				return result;
+			}
+		};
+
+		/**
+			Compares the indices like IndicesHasher, in contrast to
+			Indices::operator== which ignores range and variance
+		 */
+		struct IndicesEqual {
+			bool operator()(const Indices& one, const Indices& other) const {
+				if (one.Size() != other.Size()) return false;
+
+				for (unsigned i=0; i<one.Size(); i++) {
+					if (one[i].GetName() != other[i].GetName()) return false;
+					if (one[i].GetPrintedText() != other[i].GetPrintedText()) return false;
+					if (!(one[i].GetRange() == other[i].GetRange())) return false;
+					if (one[i].IsContravariant() != other[i].IsContravariant()) return false;
+				}
+
+				return true;
+			}
+		};
 
 		std::vector<unsigned> IndexAssignments::operator()(const Indices& indices) const {
 			std::vector<unsigned> result;
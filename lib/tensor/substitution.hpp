@@ -19,6 +19,11 @@ namespace Construction {
 			void Insert(const Scalar& variable, const Scalar& expression) {
 				substitutions.push_back({variable, expression});
 			}
+
+			size_t Size() const { return substitutions.size(); }
+
+			std::vector< std::pair<Scalar, Scalar> >::const_iterator begin() const { return substitutions.begin(); }
+			std::vector< std::pair<Scalar, Scalar> >::const_iterator end() const { return substitutions.end(); }
 		public:
 			inline Scalar operator()(const Scalar& scalar) const {
 				Scalar result = scalar;
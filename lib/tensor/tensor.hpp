@@ -7,7 +7,8 @@
 #include <cmath>
 #include <memory>
 
-#include <common/task_pool.hpp>
+#include <common/parallel.hpp>
+#include <common/cache.hpp>
 #include <tensor/permutation.hpp>
 #include <tensor/fraction.hpp>
 #include <tensor/symmetry.hpp>
@@ -16,6 +17,19 @@
 #include <vector/vector.hpp>
 #include <vector/matrix.hpp>
 
+namespace Construction {
+	namespace Common {
+
+		template<>
+		struct CacheWeight<Tensor::Indices> {
+			size_t operator()(const Tensor::Indices& indices) const {
+				return sizeof(Tensor::Indices) + indices.Size() * sizeof(Tensor::Index);
+			}
+		};
+
+	}
+}
+
 namespace Construction {
 	namespace Tensor {
 
@@ -23,6 +37,7 @@ namespace Construction {
 		class ScaledTensor;
 		class AddedTensor;
 		class MultipliedTensor;
+		class Decoder;
 
 		/**
 			\class CannotAddTensorsException
@@ -1738,6 +1753,8 @@ namespace Construction {
 			virtual ~Tensor() = default;
 		private:
 			Tensor(TensorPointer pointer) : AbstractExpression(TENSOR), pointer(std::move(pointer)) { }
+
+			friend class Decoder;
 		public:
 			Tensor& operator=(const Tensor& other) {
 				pointer = std::move(other.pointer->Clone());
@@ -1848,36 +1865,89 @@ namespace Construction {
 			inline bool IsZero() const { return pointer->IsZero(); }
 		public:
 			virtual std::string ToString() const override {
-                // Has variables?
-                bool vars = HasVariables();
+				std::stringstream ss;
+				Write(ss);
+				return ss.str();
+			}
 
-				// One summand per line
-				auto summands = GetSummands();
+			/**
+				\brief Writes the tensor to the stream, like ToString
 
+				The summands are written one after another straight from
+				the sum, without copying them, s.t. printing a huge sum
+				only needs the memory of one summand at a time. If there
+				are variables, every summand gets its own line.
+
+				If the limit is not zero, only the first limit summands
+				are written, followed by the number of the omitted ones.
+				Every line starts with the indent.
+
+				\returns {bool}		True if the last line was terminated
+			 */
+			bool Write(std::ostream& os, size_t limit = 0, const std::string& indent = "") const {
 				// Stop recursion if atomic tensor
-				if (summands.size() == 1) {
-					if (summands[0].IsZeroTensor()) return "0";
-					return summands[0].pointer->ToString();
+				if (!IsAdded()) {
+					os << indent << (IsZeroTensor() ? "0" : pointer->ToString());
+					return false;
 				}
 
-				// Else, iterate over all summands
-				std::stringstream ss;
-				for (unsigned i=0; i<summands.size(); i++) {
-					ss << summands[i];
-					if (i < summands.size() - 1) ss << " + ";
-                    if (vars) ss << std::endl;
+				auto added = As<AddedTensor>();
+				size_t size = added->Size();
+
+				if (size == 1) {
+					os << indent << (added->At(0)->IsZeroTensor() ? "0" : added->At(0)->ToString());
+					return false;
 				}
-				return ss.str();
+
+				// One summand per line
+				bool vars = HasVariables();
+
+				size_t count = (limit > 0 && limit < size) ? limit : size;
+
+				for (size_t i=0; i<count; i++) {
+					auto& summand = added->At(i);
+
+					// Only the first summand and, with variables, every summand starts a line
+					bool line = (i == 0 || vars);
+
+					// Sums in sums are split again and indent their own lines
+					if (summand->IsAddedTensor()) {
+						Tensor(summand->Clone()).Write(os, 0, line ? indent : "");
+					} else {
+						if (line) os << indent;
+						os << (summand->IsZeroTensor() ? "0" : summand->ToString());
+					}
+
+					if (i < size - 1) os << " + ";
+					if (vars) os << std::endl;
+				}
+
+				if (count < size) {
+					if (vars) os << indent;
+					os << "... (" << (size - count) << " more summands)";
+					if (vars) os << std::endl;
+				}
+
+				return vars;
+			}
+
+			friend std::ostream& operator<<(std::ostream& os, const Tensor& tensor) {
+				tensor.Write(os);
+				return os;
 			}
 		public:
 			bool HasVariables() const {
-                auto summands = GetSummands();
+				if (!IsAdded()) return IsScaled() && As<ScaledTensor>()->GetScale().HasVariables();
 
-                for (auto& t : summands) {
-                    if (t.IsScaled() && t.SeparateScalefactor().first.HasVariables()) return true;
-                }
+				// Only look at the scales, without copying the summands
+				auto added = As<AddedTensor>();
 
-                return false;
+				for (size_t i=0; i<added->Size(); i++) {
+					auto& summand = added->At(i);
+					if (summand->IsScaledTensor() && static_cast<const ScaledTensor*>(summand.get())->GetScale().HasVariables()) return true;
+				}
+
+				return false;
 			}
 
 			/**
@@ -1899,6 +1969,13 @@ namespace Construction {
 				}
 			}
 
+			/**
+				\brief Returns the number of summands without copying them
+			 */
+			size_t GetNumberOfSummands() const {
+				return IsAdded() ? As<AddedTensor>()->Size() : 1;
+			}
+
 			/**
 				\brief Expands the tensorial expression
 
@@ -1999,40 +2076,35 @@ namespace Construction {
 
 				Vector::Matrix M (dimension, summands.size());
 
-				// Insert the values into the matrix
-				{
-					Common::TaskPool pool;
-					std::mutex mutex;
-
-					for (int i=0; i<summands.size(); i++) {
-						pool.Enqueue([&](unsigned id, const Tensor& tensor) {
-
-							for (int j=0; j<dimension; j++) {
-								IndexAssignments assignment;
-
-								// Convert into index assignment
-                        		int k = 0;
-                        		for (auto &index : indices) {
-                            		assignment[index.GetName()] = combinations[j][k];
-                            		k++;
-                        		}
+				// Convert the combinations into index assignments once
+				std::vector<IndexAssignments> assignments (dimension);
+				for (int j=0; j<dimension; j++) {
+					int k = 0;
+					for (auto &index : indices) {
+						assignments[j][index.GetName()] = combinations[j][k];
+						k++;
+					}
+				}
 
-                        		// Calculate the value of the assignment
-                        		float value = tensor(assignment).ToDouble();
+				// Calculate the non-zero entries of every column in parallel
+				std::vector<std::vector<std::pair<unsigned, float>>> columns (summands.size());
 
-                        		// only lock and insert if necessary
-                        		if (value != 0) {
-                        			std::unique_lock<std::mutex> lock(mutex);
+				Parallel::For(0, summands.size(), [&](size_t id) {
+					Tensor tensor = summands[id].SeparateScalefactor().second;
 
-                        			// Insert the value into the matrix
-                        			M(j,id) = value;
-                        		}
-							}
+					for (unsigned j=0; j<dimension; j++) {
+						// Calculate the value of the assignment
+						float value = tensor(assignments[j]).ToDouble();
 
-						}, i, summands[i].SeparateScalefactor().second);
+						if (value != 0) columns[id].push_back({ j, value });
 					}
+				});
 
-					pool.Wait();
+				// Insert the values into the matrix
+				for (unsigned id=0; id<columns.size(); id++) {
+					for (auto& entry : columns[id]) {
+						M(entry.first, id) = entry.second;
+					}
 				}
 
                 // Reduce to reduced matrix echelon form
@@ -2050,6 +2122,8 @@ namespace Construction {
                 unsigned max = std::min(static_cast<unsigned>(M.GetNumberOfRows()), static_cast<unsigned>(summands.size()));
 
                 for (int currentRow=0; currentRow < max; currentRow++) {
+                	Common::CheckCancellation();
+
                 	// Initialize the next tensor
                 	scalar_type scalar = 0;
                 	Tensor tensor = Tensor::Zero();
@@ -2312,6 +2386,8 @@ namespace Construction {
 				// Iterate over all variables
 				int i = 0;
 				for (auto& pair : variables) {
+					Common::CheckCancellation();
+
 					_variables.push_back(pair.first);
 
 					// Evaluate all the components
@@ -2335,9 +2411,36 @@ namespace Construction {
 				return { M, _variables };
 			}
 		public:
+			/**
+				\brief Returns all orders of the tensor indices that permute the given ones
+
+				The result only depends on the indices, so it is shared
+				between all tensors with the same indices, e.g. the
+				summands in the symmetrizations of a coefficient.
+			 */
 			std::vector<Indices> PermuteIndices(const Indices& indices) const {
+				static Common::Cache<std::pair<Indices, Indices>, std::vector<Indices>, PermutationKeyHasher, Common::CacheWeight<std::vector<Indices>>, PermutationKeyEqual> cache (32*1024*1024);
+
 				auto tensorIndices = GetIndices();
 
+				return cache.GetOrCalculate({ tensorIndices, indices }, [&]() {
+					return CalculatePermutations(tensorIndices, indices);
+				});
+			}
+		private:
+			struct PermutationKeyHasher {
+				size_t operator()(const std::pair<Indices, Indices>& key) const {
+					return IndicesHasher()(key.first) * 31 + IndicesHasher()(key.second);
+				}
+			};
+
+			struct PermutationKeyEqual {
+				bool operator()(const std::pair<Indices, Indices>& one, const std::pair<Indices, Indices>& other) const {
+					return IndicesEqual()(one.first, other.first) && IndicesEqual()(one.second, other.second);
+				}
+			};
+
+			static std::vector<Indices> CalculatePermutations(const Indices& tensorIndices, const Indices& indices) {
 				// Calculate the position of the indices to permute
 				std::vector<unsigned> positionsToPermute;
 				for (auto& index : indices) {
@@ -2350,6 +2453,7 @@ namespace Construction {
                 std::function<void(unsigned,Indices,Indices)> fn = [&](unsigned i, Indices used, Indices unused) {
                     // if all indices are used,
                     if (unused.Size() == 0) {
+                        Common::CheckCancellation();
                         permutations.push_back(used);
                     } else {
                         // if the current index is not part of the symmetrized indices, just insert and go to the next
@@ -2383,6 +2487,7 @@ namespace Construction {
 
                 return permutations;
 			}
+		public:
 
             /**
                 \brief Symmetrizes the tensor in the given indices
@@ -2405,27 +2510,18 @@ namespace Construction {
 
 					// Symmetrize all the summands in parallel
 					{
-						Common::TaskPool pool (8);
-						bool firstEntry = true;
-						std::mutex mutex;
-
-						symmetrizedSummands = pool.Map<std::pair<scalar_type,Tensor>, Tensor>(summands, [&](const Tensor& tensor) {
-							auto result = tensor.Symmetrize(indices).SeparateScalefactor();
-
-							// Extract the scale of the first entry
-							{
-								std::unique_lock<std::mutex> lock(mutex);
-								if (firstEntry) {
-									firstEntry = false;
-									overalScale = result.first;
-								}
+						symmetrizedSummands = Parallel::Transform<std::pair<scalar_type,Tensor>>(summands, [&](const Tensor& tensor) {
+							return tensor.Symmetrize(indices).SeparateScalefactor();
+						}, 1);
+
+						// Check if all the summands have the same scale as the first one
+						if (symmetrizedSummands.size() > 0) overalScale = symmetrizedSummands[0].first;
+						for (auto& result : symmetrizedSummands) {
+							if (overalScale != result.first) {
+								hasSameScale = false;
+								break;
 							}
-
-							// If this has a different scale, remember this
-							if (overalScale != result.first) hasSameScale = false;
-
-							return result;
-						});
+						}
 					}
 
 					Tensor result = Tensor::Zero();
@@ -2450,6 +2546,8 @@ namespace Construction {
 							bool firstEntry = true;
 
 							while (stack.size() > 0) {
+								Common::CheckCancellation();
+
 								// Get the first element from the stack
 								auto s = stack[0].SeparateScalefactor();
 								Tensor current = std::move(s.second);
@@ -2533,8 +2631,7 @@ namespace Construction {
 
 					// Move the tensors on the stack
 					{
-						Common::TaskPool pool (8);
-						stack = pool.Map<Tensor,Indices>(permutations, [this](const Indices& indices) {
+						stack = Parallel::Transform<Tensor>(permutations, [this](const Indices& indices) {
 							Tensor clone = *this;
 							clone.SetIndices(indices);
 							return clone.Canonicalize();
@@ -2543,6 +2640,8 @@ namespace Construction {
 
 					// Iterate over all
 					while (stack.size() > 0) {
+						Common::CheckCancellation();
+
 						// Get the first element from the stack
 						auto s = stack[0].SeparateScalefactor();
 						Tensor current = std::move(s.second);
@@ -2602,27 +2701,18 @@ namespace Construction {
 
 					// Symmetrize all the summands in parallel
 					{
-						Common::TaskPool pool (8);
-						bool firstEntry = true;
-						std::mutex mutex;
-
-						symmetrizedSummands = pool.Map<std::pair<scalar_type,Tensor>, Tensor>(summands, [&](const Tensor& tensor) {
-							auto result = tensor.AntiSymmetrize(indices).SeparateScalefactor();
-
-							// Extract the scale of the first entry
-							{
-								std::unique_lock<std::mutex> lock(mutex);
-								if (firstEntry) {
-									firstEntry = false;
-									overalScale = result.first;
-								}
+						symmetrizedSummands = Parallel::Transform<std::pair<scalar_type,Tensor>>(summands, [&](const Tensor& tensor) {
+							return tensor.AntiSymmetrize(indices).SeparateScalefactor();
+						}, 1);
+
+						// Check if all the summands have the same scale as the first one
+						if (symmetrizedSummands.size() > 0) overalScale = symmetrizedSummands[0].first;
+						for (auto& result : symmetrizedSummands) {
+							if (overalScale != result.first && overalScale != -result.first) {
+								hasSameScale = false;
+								break;
 							}
-
-							// If this has a different scale, remember this
-                            if (overalScale != result.first && overalScale != -result.first) hasSameScale = false;
-
-							return result;
-						});
+						}
 					}
 
 					Tensor result = Tensor::Zero();
@@ -2650,6 +2740,8 @@ namespace Construction {
 							bool firstEntry = true;
 
 							while (stack.size() > 0) {
+								Common::CheckCancellation();
+
 								// Get the first element from the stack
 								auto s = stack[0].SeparateScalefactor();
 								Tensor current = std::move(s.second);
@@ -2738,10 +2830,9 @@ namespace Construction {
 
 					// Move the tensors on the stack
 					{
-						Common::TaskPool pool (8);
                         auto originalIndices = GetIndices();
 
-						stack = pool.Map<Tensor,Indices>(permutations, [this, &originalIndices](const Indices& indices) {
+						stack = Parallel::Transform<Tensor>(permutations, [this, &originalIndices](const Indices& indices) {
 							Tensor clone = *this;
 							clone.SetIndices(indices);
 
@@ -2758,6 +2849,8 @@ namespace Construction {
 
 					// Iterate over all
 					while (stack.size() > 0) {
+						Common::CheckCancellation();
+
 						// Get the first element from the stack
 						auto s = stack[0].SeparateScalefactor();
 						Tensor current = std::move(s.second);
@@ -2811,9 +2904,6 @@ namespace Construction {
 
 					// Symmetrize all the summands in parallel
 					{
-						Common::TaskPool pool (1);
-						bool firstEntry = true;
-						std::mutex mutex;
                         auto originalIndices = GetIndices();
 
                         // Generate tensor mapping
@@ -2822,25 +2912,19 @@ namespace Construction {
                             mapping[from[i]] = indices[i];
                         }
 
-						symmetrizedSummands = pool.Map<std::pair<scalar_type,Tensor>, Tensor>(summands, [&](const Tensor& tensor) {
+						symmetrizedSummands = Parallel::Transform<std::pair<scalar_type,Tensor>>(summands, [&](const Tensor& tensor) {
                             // Call exchange symmetrization on the summand
-							auto result = tensor.ExchangeSymmetrize(tensor.GetIndices(), tensor.GetIndices().Shuffle(mapping)).SeparateScalefactor();
-
-							// Extract the scale of the first entry
-							{
-								std::unique_lock<std::mutex> lock(mutex);
-
-								if (firstEntry) {
-									firstEntry = false;
-									overalScale = result.first;
-								}
+							return tensor.ExchangeSymmetrize(tensor.GetIndices(), tensor.GetIndices().Shuffle(mapping)).SeparateScalefactor();
+						}, 1);
+
+						// Check if all the summands have the same scale as the first one
+						if (symmetrizedSummands.size() > 0) overalScale = symmetrizedSummands[0].first;
+						for (auto& result : symmetrizedSummands) {
+							if (overalScale != result.first && overalScale != -result.first) {
+								hasSameScale = false;
+								break;
 							}
-
-							// If this has a different scale, remember this
-                            if (overalScale != result.first && overalScale != -result.first) hasSameScale = false;
-
-							return result;
-						});
+						}
 					}
 
 					Tensor result = Tensor::Zero();
@@ -2867,6 +2951,8 @@ namespace Construction {
 							bool firstEntry = true;
 
 							while (stack.size() > 0) {
+								Common::CheckCancellation();
+
 								// Get the first element from the stack
 								auto s = stack[0].SeparateScalefactor();
 								Tensor current = std::move(s.second);
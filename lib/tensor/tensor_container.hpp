@@ -9,6 +9,7 @@
 #include <common/serializable.hpp>
 
 #include <tensor/tensor.hpp>
+#include <tensor/encoding.hpp>
 
 namespace Construction {
     namespace Tensor {
@@ -80,29 +81,60 @@ namespace Construction {
         public:
             friend class boost::serialization::access;
 
+            /**
+                \brief Writes all tensors into one compact blob, s.t. they share the tables
+             */
             virtual void Serialize(std::ostream& os) const {
+                size_t marker = Encoding::Marker;
+                os.write(reinterpret_cast<const char*>(&marker), sizeof(marker));
+
                 // Write size of container
-                /*size_t size = data.size();
+                size_t size = data.size();
                 os.write(reinterpret_cast<const char*>(&size), sizeof(size));
 
                 // Store every tensor
+                Encoder encoder;
                 for (auto& t : data) {
-                    t->Serialize(os);
-                }*/
+                    encoder.Write(t);
+                }
+                encoder.Finish(os);
             }
 
+            /**
+                \brief Reads a container written by Serialize
+
+                Containers of older versions start with the size and store
+                every tensor in the text based format.
+
+                \throws WrongFormatException
+             */
             static std::shared_ptr<TensorContainer> Deserialize(std::istream& is) {
-                /*size_t size;
-                is.read(reinterpret_cast<char*>(&size), sizeof(size));*/
+                size_t size = 0;
+                is.read(reinterpret_cast<char*>(&size), sizeof(size));
+                if (!is) throw Common::WrongFormatException();
 
                 auto result = std::make_shared<TensorContainer>();
 
-                /*for (int i=0; i<size; i++) {
-                    auto tensor =  Tensor::Deserialize(is);
-                    result->Insert(std::move(tensor));
-                }*/
+                if (size == Encoding::Marker) {
+                    is.read(reinterpret_cast<char*>(&size), sizeof(size));
+                    if (!is) throw Common::WrongFormatException();
+
+                    Decoder decoder (is);
+                    for (size_t i=0; i<size; i++) {
+                        result->Insert(decoder.ReadTensor());
+                    }
+
+                    return result;
+                }
+
+                for (size_t i=0; i<size; i++) {
+                    auto tensor = Tensor::Deserialize(is);
+                    if (!tensor) throw Common::WrongFormatException();
+
+                    result->Insert(*static_cast<Tensor*>(tensor.get()));
+                }
 
-                return std::move(result);
+                return result;
             }
 
             template<class Archive>
@@ -1,7 +1,15 @@
 #pragma once
 
+#include <map>
+#include <mutex>
+#include <vector>
+#include <memory>
 #include <sstream>
 #include <fstream>
+#include <cstdio>
+#include <cstdint>
+
+#include <common/error.hpp>
 
 #include <tensor/tensor.hpp>
 #include <tensor/tensor_container.hpp>
@@ -13,34 +21,108 @@
 namespace Construction {
     namespace Tensor {
 
+        class CannotOpenDatabaseException : public Exception {
+        public:
+            CannotOpenDatabaseException() : Exception("Cannot open the tensor database") { }
+        };
+
+        /**
+            \class TensorDatabase
+
+            \brief Named tensor containers that are stored in a single file
+
+            The file consists of a header, the compressed entries one after
+            another and an index that maps every name to the offset and the
+            size of its entry:
+
+                "CTDB" | version | number of entries | offset of the index
+                entry 1 | entry 2 | ...
+                name 1, offset 1, size 1 | name 2, offset 2, size 2 | ...
+
+            Open only reads the header and the index. An entry is read and
+            decompressed the first time it is accessed, so looking up a
+            single entry of a large database does not touch the rest of
+            the file. LoadFromFile reads all entries at once.
+
+            Saving copies entries that were never accessed as they are,
+            without decompressing them.
+            Append adds a single entry to an opened database without
+            rewriting the others.
+         */
         class TensorDatabase {
+        public:
+            static const uint32_t Version = 1;
         public:
             TensorDatabase() = default;
         public:
             void Clear() {
+                std::unique_lock<std::mutex> lock(mutex);
+
                 data.clear();
+                index.clear();
+                filename = "";
             }
 
             size_t Size() const {
-                return data.size();
+                std::unique_lock<std::mutex> lock(mutex);
+
+                size_t size = data.size();
+                for (auto& entry : index) {
+                    if (data.find(entry.first) == data.end()) size++;
+                }
+                return size;
+            }
+
+            /**
+                \brief Returns the names of all the entries, including the ones not read yet
+             */
+            std::vector<std::string> GetNames() const {
+                std::unique_lock<std::mutex> lock(mutex);
+
+                std::vector<std::string> result;
+                for (auto& entry : data) result.push_back(entry.first);
+                for (auto& entry : index) {
+                    if (data.find(entry.first) == data.end()) result.push_back(entry.first);
+                }
+                return result;
             }
         public:
             bool Contains(const std::string& name) const {
-                auto it = data.find(name);
-                if (it == data.end()) return false;
-                return true;
+                std::unique_lock<std::mutex> lock(mutex);
+                return data.find(name) != data.end() || index.find(name) != index.end();
             }
 
             TensorContainer operator[](const std::string& name) const {
+                std::unique_lock<std::mutex> lock(mutex);
+
                 auto it = data.find(name);
-                if (it == data.end()) return TensorContainer();
-                return it->second;
+                if (it != data.end()) return it->second;
+
+                auto iter = index.find(name);
+                if (iter == index.end()) return TensorContainer();
+
+                return *ReadEntry(iter->second);
             }
 
             TensorContainer& operator[](const std::string& name) {
+                std::unique_lock<std::mutex> lock(mutex);
+
+                auto it = data.find(name);
+                if (it != data.end()) return it->second;
+
+                // Read from the file, s.t. it can be modified
+                auto iter = index.find(name);
+                if (iter != index.end()) {
+                    return data[name] = *ReadEntry(iter->second);
+                }
+
                 return data[name];
             }
 
+            /**
+                Iterates over the entries in memory, i.e. the ones that were
+                loaded, accessed or inserted
+             */
             std::map<std::string, TensorContainer>::iterator begin() {
                 return data.begin();
             }
@@ -57,106 +139,272 @@ namespace Construction {
                 return data.end();
             }
         public:
-            void SaveToFile(const std::string& filename) const {
-                std::stringstream os;
+            /**
+                \brief Opens the database without reading any entry
 
-                // Write number of elements
-                size_t size = data.size();
-                os.write(reinterpret_cast<const char*>(&size), sizeof(size));
+                \throws CannotOpenDatabaseException
+             */
+            void Open(const std::string& filename) {
+                std::unique_lock<std::mutex> lock(mutex);
 
-                // Iterate over all elements
-                for (auto it = data.begin(); it != data.end(); it++) {
-                    // Write the string
-                    size = it->first.size();
-                    os.write(reinterpret_cast<const char*>(&size), sizeof(size));
-                    os << it->first;
+                std::ifstream file (filename, std::ios::binary);
+                if (!file.is_open()) throw CannotOpenDatabaseException();
 
-                    // Serialize the tensor container
-                    {
-                        std::stringstream ss;
-                        it->second.Serialize(ss);
+                // Read the header
+                char magic[4];
+                file.read(magic, 4);
+                if (!file || std::string(magic, 4) != "CTDB") throw CannotOpenDatabaseException();
 
-                        size = ss.str().size();
-                        os.write(reinterpret_cast<const char*>(&size), sizeof(size));
-                        os << ss.str();
-                    }
-                }
+                auto version = ReadBinary<uint32_t>(file);
+                auto size = ReadBinary<uint64_t>(file);
+                auto indexOffset = ReadBinary<uint64_t>(file);
 
-                std::ofstream file (filename);
+                if (!file || version != Version) throw CannotOpenDatabaseException();
 
-                // Compress
-                {
-                    boost::iostreams::filtering_streambuf <boost::iostreams::input> out;
-                    out.push(boost::iostreams::gzip_compressor(boost::iostreams::gzip_params(boost::iostreams::gzip::best_compression)));
-                    out.push(os);
-                    boost::iostreams::copy(out, file);
+                // Read the index
+                std::map<std::string, IndexEntry> newIndex;
+
+                file.seekg(indexOffset);
+                for (uint64_t i=0; i<size; i++) {
+                    auto length = ReadBinary<uint64_t>(file);
+                    if (!file) throw CannotOpenDatabaseException();
+
+                    std::string name (length, ' ');
+                    file.read(&name[0], length);
+
+                    IndexEntry entry;
+                    entry.offset = ReadBinary<uint64_t>(file);
+                    entry.size = ReadBinary<uint64_t>(file);
+
+                    if (!file) throw CannotOpenDatabaseException();
+
+                    newIndex.insert({ name, entry });
                 }
 
-                file.close();
+                data.clear();
+                index = std::move(newIndex);
+                this->filename = filename;
             }
 
+            /**
+                \brief Opens the database and reads all the entries
+
+                \throws CannotOpenDatabaseException
+                \throws WrongFormatException
+             */
             void LoadFromFile(const std::string& filename) {
-                data.clear();
+                Open(filename);
 
-                std::ifstream file (filename);
-                std::stringstream is;
+                std::unique_lock<std::mutex> lock(mutex);
 
-                // Decompress
-                {
-                    boost::iostreams::filtering_streambuf<boost::iostreams::input> out;
-                    out.push(boost::iostreams::gzip_decompressor());
-                    out.push(file);
-                    boost::iostreams::copy(out, is);
+                for (auto& entry : index) {
+                    data[entry.first] = *ReadEntry(entry.second);
                 }
+            }
+
+            /**
+                \brief Writes the database into a file
+
+                The file is written under a temporary name first and then
+                moved, so saving into the opened file is safe and a crash
+                never leaves a broken database behind.
+             */
+            void SaveToFile(const std::string& filename) {
+                std::unique_lock<std::mutex> lock(mutex);
 
-                // Write number of elements
-                size_t numElements;
-                is.read(reinterpret_cast<char*>(&numElements), sizeof(numElements));
+                std::string temporary = filename + ".tmp";
 
-                std::cout << numElements << std::endl;
+                std::map<std::string, IndexEntry> newIndex;
 
-                // Iterate over all elements
-                for (size_t i=0; i<numElements; i++) {
-                    // Read name
-                    std::string name;
-                    {
-                        size_t length;
-                        is.read(reinterpret_cast<char*>(&length), sizeof(length));
+                {
+                    std::ofstream file (temporary, std::ios::binary);
 
-                        std::string string (length, ' ');
-                        is.read(&string[0], length);
+                    // Header, the offset of the index is written at the end
+                    file.write("CTDB", 4);
+                    WriteBinary<uint32_t>(file, Version);
 
-                        name = string;
+                    uint64_t size = data.size();
+                    for (auto& entry : index) {
+                        if (data.find(entry.first) == data.end()) size++;
                     }
 
-                    // Load tensor container data
-                    std::string containerString;
-                    {
-                        size_t length;
-                        is.read(reinterpret_cast<char*>(&length), sizeof(length));
+                    WriteBinary<uint64_t>(file, size);
+                    WriteBinary<uint64_t>(file, 0);
+
+                    // Entries in memory
+                    for (auto& entry : data) {
+                        std::stringstream ss;
+                        entry.second.Serialize(ss);
 
-                        std::string string (length, ' ');
-                        is.read(&string[0], length);
+                        IndexEntry position;
+                        position.offset = file.tellp();
+                        position.size = WriteCompressed(file, ss);
 
-                        containerString = string;
+                        newIndex.insert({ entry.first, position });
                     }
 
-                    // Deserialize the container string
-                    std::shared_ptr<TensorContainer> container;
-                    {
-                        std::stringstream ss (containerString);
-                        container = TensorContainer::Deserialize(ss);
+                    // Entries that were never read are copied as they are
+                    if (this->filename != "" && !index.empty()) {
+                        std::ifstream source (this->filename, std::ios::binary);
+
+                        for (auto& entry : index) {
+                            if (data.find(entry.first) != data.end()) continue;
+
+                            std::string blob (entry.second.size, ' ');
+                            source.seekg(entry.second.offset);
+                            source.read(&blob[0], blob.size());
+
+                            IndexEntry position;
+                            position.offset = file.tellp();
+                            position.size = blob.size();
+                            file.write(blob.data(), blob.size());
+
+                            newIndex.insert({ entry.first, position });
+                        }
+                    }
+
+                    // Index
+                    uint64_t indexOffset = file.tellp();
+
+                    for (auto& entry : newIndex) {
+                        WriteBinary<uint64_t>(file, entry.first.size());
+                        file << entry.first;
+
+                        WriteBinary<uint64_t>(file, entry.second.offset);
+                        WriteBinary<uint64_t>(file, entry.second.size);
                     }
 
-                    // Insert the pair
-                    data.insert({ name, *container });
+                    file.seekp(4 + sizeof(uint32_t) + sizeof(uint64_t));
+                    WriteBinary<uint64_t>(file, indexOffset);
                 }
 
-                file.close();
+                std::rename(temporary.c_str(), filename.c_str());
+
+                index = std::move(newIndex);
+                this->filename = filename;
+            }
+
+            /**
+                \brief Adds the entry to the end of the opened file
+
+                Only the entry and a new index are written, the other
+                entries are neither read nor copied. The header is updated
+                last, so an interrupted append leaves the database as it
+                was. The previous index remains as unused bytes in the
+                file until it is saved with SaveToFile.
+
+                \throws CannotOpenDatabaseException
+             */
+            void Append(const std::string& name, const TensorContainer& container) {
+                std::unique_lock<std::mutex> lock(mutex);
+
+                if (filename == "") throw CannotOpenDatabaseException();
+
+                std::fstream file (filename, std::ios::binary | std::ios::in | std::ios::out);
+                if (!file.is_open()) throw CannotOpenDatabaseException();
+
+                file.seekp(0, std::ios::end);
+
+                std::stringstream ss;
+                container.Serialize(ss);
+
+                IndexEntry position;
+                position.offset = file.tellp();
+                position.size = WriteCompressed(file, ss);
+
+                auto newIndex = index;
+                newIndex[name] = position;
+
+                // Index
+                uint64_t indexOffset = file.tellp();
+
+                for (auto& entry : newIndex) {
+                    WriteBinary<uint64_t>(file, entry.first.size());
+                    file << entry.first;
+
+                    WriteBinary<uint64_t>(file, entry.second.offset);
+                    WriteBinary<uint64_t>(file, entry.second.size);
+                }
+
+                file.flush();
+                if (!file) throw CannotOpenDatabaseException();
+
+                // Number of entries and offset of the index at once
+                std::stringstream header;
+                WriteBinary<uint64_t>(header, newIndex.size());
+                WriteBinary<uint64_t>(header, indexOffset);
+
+                file.seekp(4 + sizeof(uint32_t));
+                file << header.rdbuf();
+                file.flush();
+
+                if (!file) throw CannotOpenDatabaseException();
+
+                // The entry is read from the file again when accessed
+                data.erase(name);
+                index = std::move(newIndex);
+            }
+        private:
+            struct IndexEntry {
+                uint64_t offset;
+                uint64_t size;
+            };
+
+            template<typename S>
+            static void WriteBinary(std::ostream& os, S value) {
+                os.write(reinterpret_cast<const char*>(&value), sizeof(value));
+            }
+
+            template<typename S>
+            static S ReadBinary(std::istream& is) {
+                S value = 0;
+                is.read(reinterpret_cast<char*>(&value), sizeof(value));
+                return value;
+            }
+
+            static uint64_t WriteCompressed(std::ostream& os, std::istream& is) {
+                auto start = os.tellp();
+
+                boost::iostreams::filtering_streambuf<boost::iostreams::input> out;
+                out.push(boost::iostreams::gzip_compressor(boost::iostreams::gzip_params(boost::iostreams::gzip::best_compression)));
+                out.push(is);
+                boost::iostreams::copy(out, os);
+
+                return static_cast<uint64_t>(os.tellp() - start);
+            }
+
+            /**
+                Seeks to the entry in the opened file and decompresses only this one
+             */
+            std::shared_ptr<TensorContainer> ReadEntry(const IndexEntry& entry) const {
+                std::ifstream file (filename, std::ios::binary);
+                if (!file.is_open()) throw CannotOpenDatabaseException();
+
+                std::string blob (entry.size, ' ');
+                file.seekg(entry.offset);
+                file.read(&blob[0], blob.size());
+                if (!file) throw CannotOpenDatabaseException();
+
+                std::stringstream compressed (blob);
+                std::stringstream is;
+
+                {
+                    boost::iostreams::filtering_streambuf<boost::iostreams::input> in;
+                    in.push(boost::iostreams::gzip_decompressor());
+                    in.push(compressed);
+                    boost::iostreams::copy(in, is);
+                }
+
+                return TensorContainer::Deserialize(is);
             }
         private:
             std::map<std::string, TensorContainer> data;
+            std::map<std::string, IndexEntry> index;
+
+            std::string filename;
+
+            mutable std::mutex mutex;
         };
 
     }
-}
\ No newline at end of file
+}
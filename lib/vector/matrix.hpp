@@ -1,6 +1,7 @@
 #pragma once
 
 #include <common/error.hpp>
+#include <common/cancellation.hpp>
 #include <vector/vector.hpp>
 
 #include <iomanip>
@@ -469,6 +470,9 @@ namespace Construction {
                 for (unsigned r=0; r<numRows; r++) {
                     if (lead >= GetNumberOfColumns()) return;
 
+                    // Allow to stop between the pivot steps
+                    Common::CheckCancellation();
+
                     unsigned i = r;
                     while (At(i, lead) == 0) {
                         i++;
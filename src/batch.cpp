@@ -0,0 +1,40 @@
+#include <iostream>
+#include <string>
+
+#include <language/batch.hpp>
+
+/**
+    Runs the given scripts without a terminal
+
+        construct-batch [--cache] script.txt [...]
+
+    The results are written to the standard output as JSON lines as
+    soon as they are known, see Construction::Language::Batch. All
+    scripts run on the same session, one after another. With --cache
+    the results of commands are kept in .construct-cache for later runs.
+ */
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "You need to specify the scripts that need to be run" << std::endl;
+        return -1;
+    }
+
+    Construction::Language::CLI cli;
+    Construction::Language::Batch batch (std::cout);
+
+    for (int i=1; i<argc; i++) {
+        if (std::string(argv[i]) == "--cache") {
+            cli.SetCache(std::make_shared<Construction::Language::ResultCache>());
+            continue;
+        }
+
+        try {
+            batch.Run(cli, argv[i]);
+        } catch (const Construction::Exception& e) {
+            std::cerr << e.what() << std::endl;
+            return -1;
+        }
+    }
+
+    return 0;
+}
@@ -1,6 +1,8 @@
 #include <thread>
 
-#include <common/task_pool.hpp>
+#include <common/executor.hpp>
+#include <common/process_pool.hpp>
+#include <common/cancellation.hpp>
 #include <common/time_measurement.hpp>
 #include <common/progressbar.hpp>
 
@@ -12,7 +14,9 @@
 #include <tensor/index_parser.hpp>
 
 #include <language/api.hpp>
-//#include <lib/tensor/tensor_database.hpp>
+#include <equations/coefficient_store.hpp>
+
+using Construction::Equations::CoefficientStore;
 
 typedef std::pair<unsigned, unsigned>               OneCoefficient;
 typedef std::pair<OneCoefficient, OneCoefficient>   Coefficient;
@@ -27,7 +31,16 @@ std::string ToString(const Coefficient& coeff) {
     return ss.str();
 }
 
-Tensor GenerateTensor(const Coefficient& coeff, std::mutex& mutex, std::string& out, bool printSteps=false) {
+/**
+    A step of the generation together with the key of its result in the store
+ */
+struct Step {
+    std::string key;
+    std::string command;
+    std::function<Tensor(const Tensor&)> apply;
+};
+
+Tensor GenerateTensor(const Coefficient& coeff, std::string& out, bool printSteps=false, CoefficientStore* store=nullptr) {
     auto indices = Construction::Tensor::Indices::GetRomanSeries(NumberOfIndices(coeff), {1,3});
 
     // If no indices, return scalar
@@ -35,62 +48,34 @@ Tensor GenerateTensor(const Coefficient& coeff, std::mutex& mutex, std::string&
         return Construction::Tensor::Tensor::One();
     }
 
-    // Generate the tensor
-    std::string previous = "Tensor(" + indices.ToCommand() + ")";
-    if (printSteps) std::cerr << previous << std::endl;
-
-    Construction::Tensor::Tensor tensors = Construction::Language::API::Arbitrary(indices);
-    // Simplify the expression
-    tensors.Simplify();
-    tensors.RedefineVariables("e");
-
     // Symmetrize in the blocks
     auto block1 = Construction::Tensor::Indices::GetRomanSeries(coeff.first.first, {1,3});
     auto block2 = Construction::Tensor::Indices::GetRomanSeries(coeff.first.second, {1,3}, coeff.first.first);
     auto block3 = Construction::Tensor::Indices::GetRomanSeries(coeff.second.first, {1,3}, coeff.first.first + coeff.first.second);
     auto block4 = Construction::Tensor::Indices::GetRomanSeries(coeff.second.second, {1,3}, coeff.first.first + coeff.first.second + coeff.second.first);
 
-    if (block1.Size() > 0) {
-        previous = "Symmetrize(" + previous + "," + block1.ToCommand() + ")";
-        if (printSteps) std::cerr << previous << std::endl;
-
-        tensors = Construction::Language::API::Symmetrize(tensors, block1);
-
-        // Simplify the expression
-        tensors.Simplify();
-        tensors.RedefineVariables("e");
-    }
-    if (block2.Size() > 0) {
-        previous = "Symmetrize(" + previous + "," + block2.ToCommand() + ")";
-        if (printSteps) {
-            std::cerr << previous << std::endl;
-        }
-
-        tensors = Construction::Language::API::Symmetrize(tensors, block2);
+    // The result of every step only depends on the number of indices
+    // and the blocks symmetrized so far, s.t. other coefficients can
+    // continue from it
+    std::vector<unsigned> shape = { static_cast<unsigned>(indices.Size()) };
+    std::vector<Step> steps;
 
-        // Simplify the expression
-        tensors.Simplify();
-        tensors.RedefineVariables("e");
-    }
-    if (block3.Size() > 0) {
-        previous = "Symmetrize(" + previous + "," + block3.ToCommand() + ")";
-        if (printSteps) std::cerr << previous << std::endl;
+    // Generate the tensor
+    std::string previous = "Tensor(" + indices.ToCommand() + ")";
 
-        tensors = Construction::Language::API::Symmetrize(tensors, block3);
+    steps.push_back({ CoefficientStore::Key("coefficients", shape, "arbitrary"), previous, [&](const Tensor&) {
+        return Construction::Language::API::Arbitrary(indices);
+    }});
 
-        // Simplify the expression
-        tensors.Simplify();
-        tensors.RedefineVariables("e");
-    }
-    if (block4.Size() > 0) {
-        previous = "Symmetrize(" + previous + "," + block4.ToCommand() + ")";
-        if (printSteps) std::cerr << previous << std::endl;
+    for (auto& block : { block1, block2, block3, block4 }) {
+        shape.push_back(block.Size());
+        if (block.Size() == 0) continue;
 
-        tensors = Construction::Language::API::Symmetrize(tensors, block4);
+        previous = "Symmetrize(" + previous + "," + block.ToCommand() + ")";
 
-        // Simplify the expression
-        tensors.Simplify();
-        tensors.RedefineVariables("e");
+        steps.push_back({ CoefficientStore::Key("coefficients", shape, "symmetrized"), previous, [block](const Tensor& tensors) {
+            return Construction::Language::API::Symmetrize(tensors, block);
+        }});
     }
 
     // Implement the exchange symmetry
@@ -100,15 +85,36 @@ Tensor GenerateTensor(const Coefficient& coeff, std::mutex& mutex, std::string&
     newIndices.Append(block3);
 
     previous = "ExchangeSymmetrize(" + previous + "," + newIndices.ToCommand() + ")";
-    if (printSteps) std::cerr << previous << std::endl;
 
-    tensors = Construction::Language::API::ExchangeSymmetrize(tensors, indices, newIndices);
+    std::vector<unsigned> blocks = { coeff.first.first, coeff.first.second, coeff.second.first, coeff.second.second };
 
-    // Simplify the expression
-    tensors.Simplify();
-    tensors.RedefineVariables("e");
+    steps.push_back({ CoefficientStore::Key("coefficients", blocks), previous, [&](const Tensor& tensors) {
+        return Construction::Language::API::ExchangeSymmetrize(tensors, indices, newIndices);
+    }});
 
-    return tensors;
+    // Continue after the last step that is in the store
+    Construction::Tensor::Tensor tensors;
+    size_t first = 0;
+
+    for (size_t i=steps.size(); store && i>0; i--) {
+        if (store->Lookup(steps[i-1].key, tensors)) {
+            first = i;
+            if (printSteps) std::cerr << steps[i-1].command << " (stored)" << std::endl;
+            break;
+        }
+    }
+
+    for (size_t i=first; i<steps.size(); i++) {
+        if (printSteps) std::cerr << steps[i].command << std::endl;
+
+        tensors = steps[i].apply(tensors);
+
+        // Simplify the expression
+        tensors.Simplify();
+        tensors.RedefineVariables("e");
+
+        if (store) store->Store(steps[i].key, tensors);
+    }
 
     // Set the output
     out = previous;
@@ -182,61 +188,100 @@ std::string TensorToString(const std::string& prefix, const Coefficient& coeff,
     return ss.str();
 }
 
+/**
+    Calculates all the coefficients in forked worker processes and
+    prints the results in the order in which they arrive
+ */
+void RunInProcesses(const std::vector<Coefficient>& coefficients, unsigned processes, CoefficientStore& store) {
+    std::vector<std::string> jobs;
+    for (auto& c : coefficients) {
+        std::stringstream ss;
+        ss << c.first.first << " " << c.first.second << " " << c.second.first << " " << c.second.second;
+        jobs.push_back(ss.str());
+    }
+
+    // Physical memory of the machine
+    size_t memory = static_cast<size_t>(sysconf(_SC_PHYS_PAGES)) * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+
+    Construction::Common::ProcessPool* poolPointer = nullptr;
+
+    Construction::Common::ProcessPool pool (processes, [&](const std::string& job) {
+        Coefficient c;
+        std::stringstream(job) >> c.first.first >> c.first.second >> c.second.first >> c.second.second;
+
+        // Give up before the kernel has to kill us, the coordinator will
+        // try again with fewer workers and thus more memory for each
+        Construction::Common::CancellationToken token (false);
+        token.SetMemoryLimit(memory / 4 * 3 / poolPointer->GetConcurrency());
+        Construction::Common::CancellationScope scope (token);
+
+        std::string cmd;
+        auto tensor = GenerateTensor(c, cmd, false, &store);
+
+        std::stringstream ss;
+        Construction::Tensor::Expression(tensor).Serialize(ss);
+        return ss.str();
+    });
+
+    poolPointer = &pool;
+
+    Construction::Common::ProgressBar progress(coefficients.size(), 100);
+    progress.Start();
+
+    pool.Run(jobs, [&](size_t i, const std::string& result) {
+        progress++;
+
+        std::stringstream ss (result);
+        auto expression = Construction::Tensor::Expression::Deserialize(ss);
+        if (!expression) return;
+
+        std::cout << TensorToString("\\lambda", coefficients[i], expression->As<Construction::Tensor::Tensor>()) << std::endl;
+    }, [&](size_t i, const std::string& message) {
+        progress++;
+
+        std::cerr << "Failed " << ToString(coefficients[i]) << ": " << message << std::endl;
+    });
+}
+
 int main(int argc, char** argv) {
 
-    //Construction::Tensor::TensorDatabase database;
-    std::mutex mutex;
+    // Results of earlier runs
+    CoefficientStore store;
     std::mutex coutMutex;
 
-    if (argc < 5) {
+    if (argc >= 2 && std::string(argv[1]) == "--processes") {
+        // Every coefficient in its own worker process, so that a single
+        // one running out of memory does not kill the whole run
+        unsigned processes = (argc >= 3) ? atoi(argv[2]) : std::thread::hardware_concurrency();
 
-        // Load database if present
-        /*std::ifstream file("tensors.db");
-        if (file) {
-            file.close();
-            try {
-                database.LoadFromFile("tensors.db");
-            } catch (...) {
-                database.Clear();
-            }
-        } else file.close();
-
-        for (auto it = database.begin(); it != database.end(); it++) {
-            std::cout << it->first;
-        }
-        */
+        RunInProcesses(GenerateCoefficientList(4, 3), processes, store);
+    } else if (argc < 5) {
 
         // Generate coefficient list
         auto coefficients = GenerateCoefficientList(4, 3);
 
         std::vector<std::thread> threads;
-        Construction::Common::TaskPool pool(10);
+        Construction::Common::TaskGroup group;
 
         Construction::Common::ProgressBar progress(coefficients.size(), 100);
         progress.Start();
 
         for (auto &c : coefficients) {
 
-            pool.Enqueue([&]() {
+            group.Run([&]() {
                 std::string cmd;
-                auto tensor = GenerateTensor(c, mutex, cmd);
+                auto tensor = GenerateTensor(c, cmd, false, &store);
 
                 progress++;
 
                 coutMutex.lock();
                 std::cout << TensorToString("\\lambda", c, tensor) << std::endl;
                 coutMutex.unlock();
-
-                mutex.lock();
-                //database[cmd] = tensor;
-
-                //database.SaveToFile("tensors.db");
-                mutex.unlock();
             });
 
         }
 
-        pool.Wait();
+        group.Wait();
 
     } else {
         std::string cmd;
@@ -244,7 +289,7 @@ int main(int argc, char** argv) {
 
         //std::cerr << "Started " << ToString(c) << " ..." << std::endl;
 
-        auto tensor = GenerateTensor(c, mutex, cmd, true);
+        auto tensor = GenerateTensor(c, cmd, true, &store);
 
         coutMutex.lock();
         std::cerr << "Finished " << ToString(c) << " ..." << std::endl;
@@ -0,0 +1,39 @@
+#include <iostream>
+#include <string>
+
+#include <language/server.hpp>
+
+/**
+    Runs the construction server on the given Unix domain socket
+
+        construction-server [--cache] [socket]
+
+    The server keeps running until it is killed. A socket left behind
+    by an earlier run is replaced. With --cache the results of commands
+    are also kept in .construct-cache for later runs.
+ */
+int main(int argc, char** argv) {
+    GOOGLE_PROTOBUF_VERIFY_VERSION;
+
+    std::shared_ptr<Construction::Language::ResultCache> cache;
+    std::string path = ".construct.sock";
+
+    for (int i=1; i<argc; i++) {
+        std::string option = argv[i];
+
+        if (option == "--cache") cache = std::make_shared<Construction::Language::ResultCache>();
+        else path = option;
+    }
+
+    Construction::Language::Server server (path, cache);
+
+    try {
+        std::cerr << "Listening on " << path << std::endl;
+        server.Run();
+    } catch (const Construction::Exception& e) {
+        std::cerr << e.what() << std::endl;
+        return -1;
+    }
+
+    return 0;
+}
@@ -1,7 +1,84 @@
 #define RECOVER_FROM_EXCEPTIONS 	0
 
+#include <mutex>
+
 #include <equations/equations.hpp>
 #include <common/progressbar.hpp>
+#include <common/json.hpp>
+
+/**
+    Prints the given coefficients in the order of their definition
+ */
+void Print(const std::vector<Construction::Equations::CoefficientReference>& coefficients) {
+    for (auto it = Construction::Equations::Coefficients::Instance()->begin(); it != Construction::Equations::Coefficients::Instance()->end(); ++it) {
+        // Only print the given ones
+        if (std::find(coefficients.begin(), coefficients.end(), it->second) == coefficients.end()) continue;
+
+        auto tensor = *it->second->Get();
+
+        auto summands = tensor.GetSummands();
+
+        std::cout << "  \033[36m#<" << it->first.id << ":" << it->first.l << ":" << it->first.ld << ":" << it->first.r << ":" << it->first.rd << ">" << "\033[0m = " << std::endl;
+
+        for (int i=0; i<summands.size(); ++i) {
+            auto t = summands[i];
+
+            if (t.IsScaled()) {
+                auto s = t.SeparateScalefactor();
+                std::cout << "     \033[32m" << s.first << "\033[0m * \033[33m";
+
+                if (s.second.IsAdded()) {
+                    std::cout << "(" << s.second << ")";
+                } else std::cout << s.second;
+            } else {
+                std::cout << "     \033[33m" << t.ToString();
+            }
+
+            std::cout << "\033[0m";
+
+            if (i < summands.size()-1) std::cout << " + ";
+
+            std::cout << std::endl;
+        }
+
+        std::cout << std::endl;
+    }
+}
+
+/**
+    Writes the given coefficients as JSON lines in the order of their definition,
+    one record per coefficient, e.g.
+
+        {"coefficient":"#<1:2:0:2:0>","id":1,"l":2,"ld":0,"r":2,"rd":0,"summands":1,"size":312,"result":"..."}
+ */
+void PrintJson(const std::vector<Construction::Equations::CoefficientReference>& coefficients) {
+    for (auto it = Construction::Equations::Coefficients::Instance()->begin(); it != Construction::Equations::Coefficients::Instance()->end(); ++it) {
+        // Only print the given ones
+        if (std::find(coefficients.begin(), coefficients.end(), it->second) == coefficients.end()) continue;
+
+        auto tensor = *it->second->Get();
+
+        std::stringstream name;
+        name << "#<" << it->first.id << ":" << it->first.l << ":" << it->first.ld << ":" << it->first.r << ":" << it->first.rd << ">";
+
+        std::stringstream serialized;
+        tensor.Serialize(serialized);
+
+        Construction::Common::JsonRecord record;
+        record.Add("coefficient", name.str())
+              .Add("id", it->first.id)
+              .Add("l", static_cast<int>(it->first.l))
+              .Add("ld", static_cast<int>(it->first.ld))
+              .Add("r", static_cast<int>(it->first.r))
+              .Add("rd", static_cast<int>(it->first.rd))
+              .Add("summands", tensor.IsZeroTensor() ? static_cast<size_t>(0) : tensor.GetSummands().size())
+              .Add("size", static_cast<size_t>(serialized.tellp()))
+              .Add("result", tensor.ToString());
+
+        // Flush, s.t. the records can be processed while solving the rest
+        std::cout << record << std::endl;
+    }
+}
 
 int main(int argc, char** argv) {
     std::cerr << "The infamous Apple Program" << std::endl;
@@ -13,11 +90,27 @@ int main(int argc, char** argv) {
         return -1;
     }
 
+    // Parse the options
+    bool follow = false;
+    bool json = false;
+
+    for (int i=2; i<argc; i++) {
+        std::string option = argv[i];
+
+        if (option == "--follow") follow = true;
+
+        // Machine-readable output without progress bar
+        else if (option == "--json") json = true;
+
+        // Do not reuse or keep the coefficients of other runs
+        else if (option == "--no-store") Construction::Equations::Coefficients::Instance()->SetStore(nullptr);
+    }
+
     // Open file
     std::ifstream file (argv[1]);
     if (!file.is_open()) return -1;
 
-    std::vector<std::unique_ptr<Construction::Equations::Equation>> equations;
+    Construction::Equations::System equations;
 
     // Read line per line and add them as equations
     std::string line;
@@ -26,13 +119,13 @@ int main(int argc, char** argv) {
         if (line == "") continue;
 
         // Add the equation
-        equations.push_back(
+        equations.Insert(
             std::unique_ptr<Construction::Equations::Equation>(new Construction::Equations::Equation(line))
         );
     }
 
     // Calculate number of coefficients and equations
-    int numberOfSteps = equations.size() + Construction::Equations::Coefficients::Instance()->Size();
+    int numberOfSteps = equations.Size() + Construction::Equations::Coefficients::Instance()->Size();
 
     // Create progress bar
     Construction::Common::ProgressBar progress (numberOfSteps, 100);
@@ -53,60 +146,54 @@ int main(int argc, char** argv) {
 
     // Start progress bar
     std::cerr << "Start calculating ..." << std::endl;
-    progress.Start();
+    if (!json) progress.Start();
 
-    // Start the generation of all required coefficients
-    Construction::Equations::Coefficients::Instance()->StartAll();
+    // In JSON mode, write the records of every component as soon as it is solved
+    std::mutex output;
+    Construction::Equations::System::ComponentObserver observer = nullptr;
 
-    // Wait for all equations to be solved
-    for (auto& eq : equations) {
-        eq->Wait();
+    if (json) {
+        observer = [&](const std::vector<Construction::Equations::CoefficientReference>& coefficients) {
+            std::unique_lock<std::mutex> lock(output);
+            PrintJson(coefficients);
+        };
     }
 
-    // Print the result
-    int offset = 0;
+    // Start the generation of all required coefficients
+    Construction::Equations::Coefficients::Instance()->StartAll();
+
+    // Solve the independent parts of the system in parallel
+    auto solved = equations.Solve(observer);
 
     // Clean the line
-    for (int i=0; i<200; i++) {
-        std::cerr << " ";
+    if (!json) {
+        for (int i=0; i<200; i++) {
+            std::cerr << " ";
+        }
+        std::cerr << "\r";
     }
-    std::cerr << "\r";
 
     // Print the results
-    for (auto it = Construction::Equations::Coefficients::Instance()->begin(); it != Construction::Equations::Coefficients::Instance()->end(); ++it) {
-        //auto tensor = it->second->Get()->RedefineVariables("e", offset);
-        auto tensor = *it->second->Get();
-
-        auto summands = tensor.GetSummands();
-
-        if (!tensor.IsZeroTensor()) {
-            offset += summands.size();
-        }
-
-        std::cout << "  \033[36m#<" << it->first.id << ":" << it->first.l << ":" << it->first.ld << ":" << it->first.r << ":" << it->first.rd << ">" << "\033[0m = " << std::endl;
-
-        for (int i=0; i<summands.size(); ++i) {
-            auto t = summands[i];
+    if (!json) Print(solved);
 
-            if (t.IsScaled()) {
-                auto s = t.SeparateScalefactor();
-                std::cout << "     \033[32m" << s.first << "\033[0m * \033[33m";
+    // In follow mode, read further equations from the standard input
+    // and only solve the part of the system they are connected to
+    if (follow) {
+        while (std::getline(std::cin, line)) {
+            if (line == "") continue;
 
-                if (s.second.IsAdded()) {
-                    std::cout << "(" << s.second << ")";
-                } else std::cout << s.second;
-            } else {
-                std::cout << "     \033[33m" << t.ToString();
-            }
+            auto& eq = equations.Insert(
+                std::unique_ptr<Construction::Equations::Equation>(new Construction::Equations::Equation(line))
+            );
 
-            std::cout << "\033[0m";
+            Construction::Equations::Coefficients::Instance()->StartAll();
 
-            if (i < summands.size()-1) std::cout << " + ";
+            // The coefficients might already be known
+            eq.TryEvaluate();
 
-            std::cout << std::endl;
+            auto solved = equations.Solve(observer);
+            if (!json) Print(solved);
         }
-
-        std::cout << std::endl;
     }
 
     std::cerr << "Finished." << std::endl;
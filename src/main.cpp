@@ -24,6 +24,7 @@
 #include <fstream>
 #include <string>
 #include <cstdio>
+#include <csignal>
 
 #include <readline/readline.h>
 #include <readline/history.h>
@@ -99,16 +100,31 @@ char** getCommandCompletions(const char* text, int start, int) {
 	return completionList;
 }
 
+void interruptHandler(int) {
+	// Abort the command that is running right now
+	Construction::Common::CancellationToken::Interrupt();
+}
+
 int main(int argc, char** argv) {
 
-	Construction::Language::CLI cli (argc, argv);
+	Construction::Language::CLI cli;
+
+	// Ctrl-C cancels the current command instead of killing the session
+	std::signal(SIGINT, &interruptHandler);
 
 	// Hook readline completion
 	rl_attempted_completion_function = &getCommandCompletions;
 
+	// Keep the results of commands for later runs
+	int first = 1;
+	if (argc >= 2 && std::string(argv[1]) == "--cache") {
+		cli.SetCache(std::make_shared<Construction::Language::ResultCache>());
+		first++;
+	}
+
 	// If there is a filename given, execute this
-	if (argc >= 2) {
-		std::string filename = argv[1];
+	if (argc > first) {
+		std::string filename = argv[first];
 		cli.ExecuteScript(filename);
 		return 0;
 	}
@@ -119,8 +135,8 @@ int main(int argc, char** argv) {
     if (crashFile[crashFile.size()-1] != '/') crashFile += "/";
     crashFile += ".crashfile";*/
 
-	// If the file exists
-	if (boost::filesystem::exists( crashFile )) {
+	// If the snapshot or the journal exists
+	if (boost::filesystem::exists( crashFile ) || boost::filesystem::exists( crashFile + ".journal" )) {
 		// Ask if the session should be restored
 		std::cout << "Construction can restore the previous session. Should it? [Y/n]: ";
 
@@ -129,7 +145,7 @@ int main(int argc, char** argv) {
 			std::cin >> input;
 
 			if (input == "Y") {
-				Construction::Language::Session::Instance()->LoadFromFile(crashFile);
+				cli.GetSession().Recover(crashFile);
 				break;
 			} else if (input == "n") break;
 			else
@@ -139,13 +155,18 @@ int main(int argc, char** argv) {
 
 	// CLI mode
 
+	// Only preview huge results, Preview(0) prints them completely
+	cli.GetSession().SetPreview(1000);
+
 	std::string input;
 	while (true) {
 		input = std::string(readline("> "));
 
 		if (input == "Exit") {
-			// Delete crash file
+			// Delete crash file and journal
+			cli.GetSession().DisableJournal();
 			remove(crashFile.c_str());
+			remove((crashFile + ".journal").c_str());
 
 			std::cout << "Bye!" << std::endl;
 			break;
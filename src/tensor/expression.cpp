@@ -2,38 +2,40 @@
 #include <tensor/scalar.hpp>
 #include <tensor/tensor.hpp>
 #include <tensor/substitution.hpp>
+#include <tensor/encoding.hpp>
 
 using Construction::Tensor::Expression;
 using Construction::Tensor::Tensor;
 using Construction::Tensor::Scalar;
+using Construction::Tensor::Encoding;
+using Construction::Tensor::Encoder;
+using Construction::Tensor::Decoder;
+using Construction::Common::WrongFormatException;
 
 void Expression::Serialize(std::ostream& os) const {
-	// Write type
-	WriteBinary<unsigned>(os, static_cast<unsigned>(pointer->GetType()));
+	// Write the compact encoding, see Encoding
+	WriteBinary<unsigned>(os, Encoding::Marker);
 
-	// Call the different serialization methods
-	switch (pointer->GetType()) {
-		case AbstractExpression::TENSOR:
-			static_cast<Tensor*>(pointer.get())->Serialize(os);
-			break;
-		case AbstractExpression::SCALAR: 
-			static_cast<Scalar*>(pointer.get())->Serialize(os);
-			break;
-		case AbstractExpression::BOOLEAN: 
-			static_cast<BoolExpression*>(pointer.get())->Serialize(os);
-			break;
-		case AbstractExpression::SUBSTITUTION:
-			static_cast<Substitution*>(pointer.get())->Serialize(os);
-			break;
-		case AbstractExpression::VOID_TYPE: 
-			static_cast<VoidExpression*>(pointer.get())->Serialize(os);
-			break;
-	}
+	Encoder encoder;
+	encoder.Write(*this);
+	encoder.Finish(os);
 }
 
 std::unique_ptr<Expression> Expression::Deserialize(std::istream& is) {
-	// Read type
-    AbstractExpression::Type type = static_cast<AbstractExpression::Type>(ReadBinary<unsigned>(is));
+	// Read the marker, older versions started with the type
+    unsigned marker = ReadBinary<unsigned>(is);
+
+    if (marker == Encoding::Marker) {
+        try {
+            Decoder decoder (is);
+            return std::unique_ptr<Expression>(new Expression(decoder.ReadExpression()));
+        } catch (const WrongFormatException&) {
+            return nullptr;
+        }
+    }
+
+    // Older text based format
+    AbstractExpression::Type type = static_cast<AbstractExpression::Type>(marker);
 
     std::unique_ptr<Expression> result;
 
@@ -59,5 +61,5 @@ std::unique_ptr<Expression> Expression::Deserialize(std::istream& is) {
 			break;
     }
 
-    return std::move(result);
+    return result;
 }
\ No newline at end of file
@@ -1,2 +1,7 @@
 #include "common/range.cpp"
-#include "common/time_measurement.hpp"
\ No newline at end of file
+#include "common/time_measurement.hpp"
+#include "common/executor.cpp"
+#include "common/parallel.cpp"
+#include "common/cancellation.cpp"
+#include "common/process_pool.cpp"
+#include "common/cache.cpp"
\ No newline at end of file
@@ -0,0 +1,96 @@
+#include <thread>
+#include <vector>
+
+#include <common/cache.hpp>
+#include <tensor/index.hpp>
+
+using Construction::Common::Cache;
+
+SCENARIO("Memoisation cache", "[cache]") {
+
+    GIVEN(" a cache with room for four integers in one shard") {
+        Cache<int, int> cache (4 * sizeof(int), 1);
+
+        THEN(" a missing key is counted as miss") {
+            int value;
+            REQUIRE(!cache.Get(1, value));
+            REQUIRE(cache.GetStatistics().misses == 1);
+        }
+
+        THEN(" a stored value is found again") {
+            cache.Set(1, 10);
+
+            int value;
+            REQUIRE(cache.Get(1, value));
+            REQUIRE(value == 10);
+            REQUIRE(cache.GetStatistics().hits == 1);
+        }
+
+        THEN(" the least recently used entry is evicted") {
+            for (int i=0; i<4; i++) cache.Set(i, i);
+
+            int value;
+            REQUIRE(cache.Get(0, value));
+
+            cache.Set(4, 4);
+
+            REQUIRE(cache.Contains(0));
+            REQUIRE(!cache.Contains(1));
+            REQUIRE(cache.GetStatistics().evictions == 1);
+            REQUIRE(cache.GetStatistics().bytes == 4 * sizeof(int));
+        }
+
+        THEN(" GetOrCalculate only calculates once") {
+            int calls = 0;
+            auto fn = [&]() { calls++; return 42; };
+
+            REQUIRE(cache.GetOrCalculate(7, fn) == 42);
+            REQUIRE(cache.GetOrCalculate(7, fn) == 42);
+            REQUIRE(calls == 1);
+        }
+    }
+
+    GIVEN(" a sharded cache used by several threads") {
+        Cache<int, int> cache (1024 * sizeof(int), 8);
+
+        std::vector<std::thread> threads;
+        for (int t=0; t<4; t++) {
+            threads.emplace_back([&cache]() {
+                for (int i=0; i<512; i++) cache.GetOrCalculate(i, [i]() { return i * i; });
+            });
+        }
+        for (auto& thread : threads) thread.join();
+
+        THEN(" every value is correct and the budget is respected") {
+            int value;
+            REQUIRE(cache.Get(100, value));
+            REQUIRE(value == 10000);
+            REQUIRE(cache.GetStatistics().bytes <= cache.GetBudget());
+        }
+    }
+
+    GIVEN(" a cache keyed by indices") {
+        using Construction::Tensor::Index;
+        using Construction::Tensor::Indices;
+
+        Cache<Indices, int, Construction::Tensor::IndicesHasher, Construction::Common::CacheWeight<int>, Construction::Tensor::IndicesEqual> cache;
+
+        Indices lower;
+        lower.Insert(Index("a", {1,3}));
+
+        Indices upper = lower;
+        upper[0].SetContravariant(true);
+
+        Indices spacetime;
+        spacetime.Insert(Index("a", {0,3}));
+
+        cache.Set(lower, 1);
+
+        THEN(" indices that only differ in variance or range are different keys") {
+            REQUIRE(cache.Contains(lower));
+            REQUIRE(!cache.Contains(upper));
+            REQUIRE(!cache.Contains(spacetime));
+        }
+    }
+
+}
@@ -0,0 +1,35 @@
+#include <common/cancellation.hpp>
+#include <common/parallel.hpp>
+
+using Construction::Common::CancellationToken;
+using Construction::Common::CancellationScope;
+
+SCENARIO("Cancellation", "[cancellation]") {
+
+    GIVEN(" a cancelled token") {
+        CancellationToken token;
+        token.Cancel();
+
+        THEN(" parallel loops stop at the next chunk") {
+            CancellationScope scope(token);
+
+            REQUIRE_THROWS_AS(Construction::Parallel::For(0, 100, [](size_t) { }, 1), Construction::CancelledException);
+        }
+
+        THEN(" other threads are not affected") {
+            REQUIRE_NOTHROW(Construction::Common::CheckCancellation());
+        }
+    }
+
+    GIVEN(" a token with a timeout") {
+        CancellationToken token;
+        token.SetTimeout(std::chrono::milliseconds(1));
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+        THEN(" the deadline is exceeded") {
+            REQUIRE_THROWS_AS(token.Check(), Construction::DeadlineExceededException);
+        }
+    }
+
+}
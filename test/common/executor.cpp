@@ -0,0 +1,40 @@
+#include <common/executor.hpp>
+
+using Construction::Common::TaskGroup;
+
+SCENARIO("Executor", "[executor]") {
+
+    GIVEN(" a task group") {
+
+        WHEN(" tasks fork and join nested groups") {
+            std::atomic<unsigned> counter (0);
+
+            TaskGroup group;
+            for (int i=0; i<16; i++) {
+                group.Run([&counter]() {
+                    TaskGroup inner;
+                    for (int j=0; j<16; j++) {
+                        inner.Run([&counter]() { ++counter; });
+                    }
+                    inner.Wait();
+                });
+            }
+            group.Wait();
+
+            THEN(" all of them are executed") {
+                REQUIRE(counter == 256);
+            }
+        }
+
+        WHEN(" a task throws") {
+            TaskGroup group;
+            group.Run([]() { throw std::runtime_error("error"); });
+
+            THEN(" the exception is rethrown on join") {
+                REQUIRE_THROWS(group.Wait());
+            }
+        }
+
+    }
+
+}
@@ -0,0 +1,25 @@
+#include <common/parallel.hpp>
+
+SCENARIO("Parallel algorithms", "[parallel]") {
+
+    GIVEN(" a range of numbers") {
+        std::vector<unsigned> numbers (1000);
+        for (unsigned i=0; i<numbers.size(); i++) numbers[i] = i;
+
+        THEN(" Transform keeps the order") {
+            auto squares = Construction::Parallel::Transform<unsigned>(numbers, [](unsigned i) { return i*i; }, 7);
+
+            REQUIRE(squares.size() == numbers.size());
+            REQUIRE(squares[999] == 999*999);
+        }
+
+        THEN(" Reduce calculates the sum") {
+            auto sum = Construction::Parallel::Reduce(0, numbers.size(), static_cast<size_t>(0), [&](size_t i) {
+                return static_cast<size_t>(numbers[i]);
+            }, [](size_t a, size_t b) { return a + b; });
+
+            REQUIRE(sum == 499500);
+        }
+    }
+
+}
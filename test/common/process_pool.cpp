@@ -0,0 +1,78 @@
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#include <common/process_pool.hpp>
+
+using Construction::Common::ProcessPool;
+
+SCENARIO("Process pool", "[process-pool]") {
+
+    GIVEN(" a pool of worker processes") {
+        ProcessPool pool (4, [](const std::string& job) -> std::string {
+            // Crash the worker process
+            if (job == "crash") _exit(1);
+            if (job == "throw") throw std::runtime_error("failed");
+            if (job == "memory") throw Construction::MemoryLimitExceededException();
+
+            return job + job;
+        });
+
+        THEN(" the results of the workers are returned") {
+            std::vector<std::string> results (3);
+
+            pool.Run({ "a", "b", "c" }, [&](size_t i, const std::string& result) {
+                results[i] = result;
+            });
+
+            REQUIRE(results[0] == "aa");
+            REQUIRE(results[1] == "bb");
+            REQUIRE(results[2] == "cc");
+        }
+
+        THEN(" failed jobs are retried with less workers and finally given up") {
+            std::vector<std::string> results (4);
+            std::vector<size_t> failed;
+
+            pool.Run({ "a", "crash", "b", "throw" }, [&](size_t i, const std::string& result) {
+                results[i] = result;
+            }, [&](size_t i, const std::string&) {
+                failed.push_back(i);
+            });
+
+            std::sort(failed.begin(), failed.end());
+
+            REQUIRE(results[0] == "aa");
+            REQUIRE(results[2] == "bb");
+            REQUIRE(failed == std::vector<size_t>({ 1, 3 }));
+            REQUIRE(pool.GetConcurrency() == 1);
+        }
+
+        THEN(" errors of the jobs are reported without retrying them") {
+            std::vector<std::string> messages (2);
+
+            pool.Run({ "throw", "a" }, [&](size_t i, const std::string& result) {
+                messages[i] = result;
+            }, [&](size_t i, const std::string& message) {
+                messages[i] = message;
+            });
+
+            REQUIRE(messages[0] == "failed");
+            REQUIRE(messages[1] == "aa");
+            REQUIRE(pool.GetConcurrency() == 4);
+        }
+
+        THEN(" jobs that exceed the memory limit are retried with less workers") {
+            std::vector<size_t> failed;
+
+            pool.Run({ "memory" }, [&](size_t, const std::string&) { }, [&](size_t i, const std::string&) {
+                failed.push_back(i);
+            });
+
+            REQUIRE(failed == std::vector<size_t>({ 0 }));
+            REQUIRE(pool.GetConcurrency() == 1);
+        }
+    }
+
+}
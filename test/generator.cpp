@@ -0,0 +1 @@
+#include "generator/basis_table.cpp"
@@ -0,0 +1,48 @@
+#include <fstream>
+
+#include <boost/filesystem/operations.hpp>
+
+#include <generator/base_tensor.hpp>
+#include <generator/basis_table.hpp>
+
+using Construction::Generator::BasisTable;
+using Construction::Generator::BaseTensorGenerator;
+using Construction::Tensor::Indices;
+
+SCENARIO("Basis tables", "[basis-table]") {
+
+    GIVEN(" a basis table in a temporary directory") {
+        auto directory = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+
+        auto indices = Indices::GetRomanSeries(5, {1,3});
+        BaseTensorGenerator generator;
+
+        THEN(" it agrees with the generator when building and when loading the table") {
+            BasisTable table (directory);
+            REQUIRE(table.Generate(indices).ToString() == generator.Generate(indices).ToString());
+            REQUIRE(boost::filesystem::exists(directory + "/basis.5.table"));
+
+            BasisTable loaded (directory);
+            REQUIRE(loaded.Generate(indices).ToString() == generator.Generate(indices).ToString());
+        }
+
+        THEN(" a table with positions out of range is rebuilt") {
+            {
+                BasisTable table (directory);
+                table.Generate(indices);
+            }
+
+            {
+                std::fstream file (directory + "/basis.5.table", std::ios::in | std::ios::out | std::ios::binary);
+                file.seekp(-1, std::ios::end);
+                file.put(static_cast<char>(200));
+            }
+
+            BasisTable table (directory);
+            REQUIRE(table.Generate(indices).ToString() == generator.Generate(indices).ToString());
+        }
+
+        boost::filesystem::remove_all(directory);
+    }
+
+}
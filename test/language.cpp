@@ -0,0 +1,8 @@
+#include "language/script.cpp"
+#include "language/jobs.cpp"
+#include "language/homogeneous_system.cpp"
+#include "language/server.cpp"
+#include "language/limits.cpp"
+#include "language/session.cpp"
+#include "language/journal.cpp"
+#include "language/result_cache.cpp"
@@ -0,0 +1,47 @@
+#include <tensor/index.hpp>
+#include <language/api.hpp>
+
+using Construction::Language::API::ToFraction;
+using Construction::Language::API::HomogeneousSystem;
+using Construction::Tensor::Range;
+
+SCENARIO("Homogeneous systems", "[homogeneous-system]") {
+
+    GIVEN(" entries of a reduced float system") {
+        int numerator;
+        unsigned denominator;
+
+        THEN(" simple fractions are recovered from float precision") {
+            REQUIRE(ToFraction(1.0f/3, numerator, denominator));
+            REQUIRE(numerator == 1);
+            REQUIRE(denominator == 3);
+
+            REQUIRE(ToFraction(-2.0f/7, numerator, denominator));
+            REQUIRE(numerator == -2);
+            REQUIRE(denominator == 7);
+        }
+
+        THEN(" entries that cannot be snapped unambiguously are rejected") {
+            REQUIRE(!ToFraction(1.0/1024, numerator, denominator));
+            REQUIRE(!ToFraction(0.3337, numerator, denominator));
+        }
+    }
+
+    GIVEN(" several equations on an arbitrary tensor") {
+        auto indices = Construction::Tensor::Indices::GetRomanSeries(3, {1,3});
+        auto tensor = Construction::Language::API::Arbitrary(indices);
+
+        auto first = Construction::Language::API::AntiSymmetrize(tensor, indices.Partial(Range(0,1)));
+        auto second = Construction::Language::API::AntiSymmetrize(tensor, indices.Partial(Range(1,2)));
+
+        WHEN(" solving them at once") {
+            auto substitution = HomogeneousSystem(std::vector<Construction::Tensor::Tensor>({ first, second }));
+
+            THEN(" all of them are solved") {
+                REQUIRE(substitution(first).Simplify().IsZero());
+                REQUIRE(substitution(second).Simplify().IsZero());
+            }
+        }
+    }
+
+}
@@ -0,0 +1,82 @@
+#include <chrono>
+
+#include <common/cancellation.hpp>
+#include <language/cli.hpp>
+#include <language/jobs.hpp>
+
+using Construction::Language::CLI;
+using Construction::Language::Session;
+using Construction::Language::Jobs;
+using Construction::Common::CancellationToken;
+using Construction::Common::CancellationScope;
+
+/**
+    Runs the line on the CLI without printing anything
+ */
+void RunSilently(CLI& cli, const std::string& code) {
+    std::stringstream output;
+    auto buffer = std::cout.rdbuf(output.rdbuf());
+
+    cli(code);
+
+    std::cout.rdbuf(buffer);
+}
+
+/**
+    Waits at most ten seconds for the jobs that write the variable
+ */
+void WaitForJobs(CLI& cli, const std::string& variable) {
+    CancellationToken token;
+    token.SetTimeout(std::chrono::seconds(10));
+
+    CancellationScope scope(token);
+    cli.GetSession().GetJobs().WaitFor(variable);
+}
+
+SCENARIO("Background jobs", "[jobs]") {
+
+    GIVEN(" a job whose arguments run concurrently and read its own variable") {
+        CLI cli (std::make_shared<Session>());
+
+        RunSilently(cli, "x = Arbitrary({a b}):");
+        RunSilently(cli, "x = Substitute(Simplify(x), HomogeneousSystem(Simplify(x))) &");
+
+        THEN(" the arguments do not wait for the job itself") {
+            REQUIRE_NOTHROW(WaitForJobs(cli, "x"));
+
+            auto jobs = cli.GetSession().GetJobs().List();
+            REQUIRE(jobs.size() == 1);
+            REQUIRE(jobs[0].state == Jobs::FINISHED);
+        }
+    }
+
+    GIVEN(" a job that fails") {
+        CLI cli (std::make_shared<Session>());
+
+        RunSilently(cli, "a = Arbitrary({a b}):");
+        RunSilently(cli, "b = Arbitrary(a) &");
+
+        THEN(" the job fails and the variable is not written") {
+            REQUIRE_NOTHROW(WaitForJobs(cli, "b"));
+
+            auto jobs = cli.GetSession().GetJobs().List();
+            REQUIRE(jobs.size() == 1);
+            REQUIRE(jobs[0].state == Jobs::FAILED);
+            REQUIRE(!cli.GetSession().Contains("b"));
+        }
+    }
+
+    GIVEN(" several jobs that read each other") {
+        CLI cli (std::make_shared<Session>());
+
+        RunSilently(cli, "a = Arbitrary({a b c d}) &");
+        RunSilently(cli, "b = Simplify(a) &");
+        RunSilently(cli, "c = Simplify(b) &");
+
+        THEN(" the last one sees the results of the others") {
+            REQUIRE_NOTHROW(WaitForJobs(cli, "c"));
+            REQUIRE(cli.GetSession().Get("c").As<Construction::Tensor::Tensor>().ToString() == cli.GetSession().Get("a").As<Construction::Tensor::Tensor>().ToString());
+        }
+    }
+
+}
@@ -0,0 +1,126 @@
+#include <cstdio>
+#include <fstream>
+
+#include <language/journal.hpp>
+
+using Construction::Language::Journal;
+using Construction::Tensor::Expression;
+
+/**
+    Returns the records in the journal of the snapshot file
+ */
+std::vector<Journal::Record> ReadJournal(const std::string& filename) {
+    std::vector<Journal::Record> records;
+    Journal::Replay(filename, [&](const Journal::Record& record) { records.push_back(record); });
+    return records;
+}
+
+SCENARIO("Journal", "[journal]") {
+
+    GIVEN(" a session with a journal") {
+        std::string filename = "/tmp/construction-test-journal.session";
+
+        CLI cli (std::make_shared<Session>());
+        cli.GetSession().EnableJournal(filename);
+
+        RunSilently(cli, "x = Arbitrary({a b}):");
+        RunSilently(cli, "y = Arbitrary({a b c}):");
+        RunSilently(cli, "Symmetrize(x, {a b})");
+
+        cli.GetSession().DisableJournal();
+
+        THEN(" the changes are in the journal") {
+            auto records = ReadJournal(filename);
+
+            REQUIRE(records.size() > 0);
+            for (size_t i=1; i<records.size(); i++) {
+                REQUIRE(records[i].sequence > records[i-1].sequence);
+            }
+        }
+
+        THEN(" recovering restores the variables and the current result") {
+            Session recovered;
+
+            std::stringstream output;
+            auto buffer = std::cout.rdbuf(output.rdbuf());
+            recovered.Recover(filename);
+            std::cout.rdbuf(buffer);
+
+            REQUIRE(output.str().find("> y = Arbitrary({a b c}):") != std::string::npos);
+            REQUIRE(recovered.Get("x").ToString() == cli.GetSession().Get("x").ToString());
+            REQUIRE(recovered.Get("y").ToString() == cli.GetSession().Get("y").ToString());
+            REQUIRE(recovered.GetCurrent().ToString() == cli.GetSession().GetCurrent().ToString());
+        }
+
+        THEN(" a record cut off by a crash ends the replay") {
+            {
+                std::ofstream journal (filename + ".journal", std::ios::binary | std::ios::app);
+                journal << "\x03garbage";
+            }
+
+            Session recovered;
+
+            std::stringstream output;
+            auto buffer = std::cout.rdbuf(output.rdbuf());
+            REQUIRE_NOTHROW(recovered.Recover(filename));
+            std::cout.rdbuf(buffer);
+
+            REQUIRE(recovered.Get("y").ToString() == cli.GetSession().Get("y").ToString());
+        }
+
+        std::remove(filename.c_str());
+        std::remove((filename + ".journal").c_str());
+    }
+
+    GIVEN(" a journal whose snapshot contains the first changes") {
+        std::string filename = "/tmp/construction-test-journal.snapshot";
+        unsigned snapshots = 0;
+
+        {
+            Journal journal (filename, [&](const std::string& file) {
+                std::ofstream(file) << "snapshot";
+                snapshots++;
+                return uint64_t(2);
+            });
+
+            journal.Append({ Journal::LINE, 1, "first", Expression::Void() });
+            journal.Append({ Journal::LINE, 2, "second", Expression::Void() });
+            journal.Append({ Journal::LINE, 3, "third", Expression::Void() });
+        }
+
+        THEN(" only the later changes are written") {
+            auto records = ReadJournal(filename);
+
+            REQUIRE(snapshots == 1);
+            REQUIRE(records.size() == 1);
+            REQUIRE(records[0].name == "third");
+        }
+
+        std::remove(filename.c_str());
+        std::remove((filename + ".journal").c_str());
+    }
+
+    GIVEN(" a journal that is compacted after every change") {
+        std::string filename = "/tmp/construction-test-journal.compacted";
+        unsigned snapshots = 0;
+
+        {
+            Journal journal (filename, [&](const std::string& file) {
+                std::ofstream(file) << "snapshot";
+                return uint64_t(++snapshots);
+            }, 1);
+
+            journal.Append({ Journal::LINE, 100, "line", Expression::Void() });
+        }
+
+        THEN(" the journal starts over with a new snapshot") {
+            REQUIRE(snapshots == 2);
+            REQUIRE(ReadJournal(filename).size() == 0);
+            REQUIRE(std::ifstream(filename).good());
+        }
+
+        std::remove(filename.c_str());
+        std::remove((filename + ".journal").c_str());
+    }
+
+}
@@ -0,0 +1,64 @@
+#include <common/cancellation.hpp>
+#include <language/cli.hpp>
+
+/**
+    Returns the output of the line on the CLI
+ */
+std::string RunAndCapture(CLI& cli, const std::string& code) {
+    std::stringstream output;
+    auto buffer = std::cout.rdbuf(output.rdbuf());
+
+    cli(code);
+
+    std::cout.rdbuf(buffer);
+    return output.str();
+}
+
+SCENARIO("Limits of commands", "[limits]") {
+
+    GIVEN(" a session with a memory limit below the current usage") {
+        CLI cli (std::make_shared<Session>());
+        cli.GetSession().SetMemoryLimit(1);
+
+        THEN(" evaluating a command exceeds the limit") {
+            REQUIRE_THROWS_AS(cli.Evaluate("Symmetrize(Arbitrary({a b c d e f}), {a b c d e f})"), Construction::MemoryLimitExceededException);
+        }
+
+        THEN(" the line reports the error and does not set the variable") {
+            auto output = RunAndCapture(cli, "x = Symmetrize(Arbitrary({a b c d e f}), {a b c d e f})");
+
+            REQUIRE(output.find("Error") != std::string::npos);
+            REQUIRE(!cli.GetSession().Contains("x"));
+        }
+
+        THEN(" the line works again without the limit") {
+            RunAndCapture(cli, "x = Symmetrize(Arbitrary({a b c d e f}), {a b c d e f})");
+            cli.GetSession().SetMemoryLimit(0);
+            RunAndCapture(cli, "x = Symmetrize(Arbitrary({a b c d e f}), {a b c d e f})");
+
+            REQUIRE(cli.GetSession().Contains("x"));
+        }
+    }
+
+    GIVEN(" a session with a timeout that is too short") {
+        CLI cli (std::make_shared<Session>());
+        cli.GetSession().SetTimeout(0.001);
+
+        THEN(" evaluating a long command exceeds the deadline") {
+            REQUIRE_THROWS_AS(cli.Evaluate("Symmetrize(Arbitrary({a b c d e f}), {a b c d e f})"), Construction::DeadlineExceededException);
+        }
+
+        THEN(" the line reports the error and keeps the session") {
+            cli.GetSession().SetTimeout(0);
+            RunAndCapture(cli, "x = Arbitrary({a b}):");
+            auto before = cli.GetSession().Get("x").ToString();
+
+            cli.GetSession().SetTimeout(0.001);
+            auto output = RunAndCapture(cli, "x = Symmetrize(Arbitrary({a b c d e f}), {a b c d e f})");
+
+            REQUIRE(output.find("Error") != std::string::npos);
+            REQUIRE(cli.GetSession().Get("x").ToString() == before);
+        }
+    }
+
+}
@@ -0,0 +1,124 @@
+#include <boost/filesystem/operations.hpp>
+
+#include <language/result_cache.hpp>
+
+using Construction::Language::ResultCache;
+using Construction::Language::Parser;
+
+/**
+    Returns the number of entries in the cache directory
+ */
+size_t CountEntries(const std::string& directory) {
+    size_t count = 0;
+
+    boost::system::error_code error;
+    for (boost::filesystem::directory_iterator it (directory, error), end; !error && it != end; ++it) {
+        count++;
+    }
+
+    return count;
+}
+
+SCENARIO("Result cache", "[result-cache]") {
+    std::string directory = "/tmp/construction-test-cache";
+    boost::filesystem::remove_all(directory);
+
+    GIVEN(" a cache that stores every result") {
+        ResultCache cache (directory, 0);
+
+        CLI cli (std::make_shared<Session>());
+        auto tensor = cli.Evaluate("Arbitrary({a b})");
+
+        THEN(" stored results are found again") {
+            cache.Store("Arbitrary({a b})", tensor, 1);
+
+            Expression result;
+            REQUIRE(cache.Lookup("Arbitrary({a b})", result));
+            REQUIRE(result.ToString() == tensor.ToString());
+        }
+
+        THEN(" other commands are not found") {
+            cache.Store("Arbitrary({a b})", tensor, 1);
+
+            Expression result;
+            REQUIRE(!cache.Lookup("Arbitrary({a c})", result));
+        }
+
+        THEN(" void results are not stored") {
+            cache.Store("Jobs()", Expression::Void(), 1);
+
+            REQUIRE(CountEntries(directory) == 0);
+        }
+
+        WHEN(" the CLI evaluates a command that is in the cache") {
+            auto key = cli.GetExpandedCommandString(Parser().Parse("Arbitrary({a b})"));
+            auto planted = cli.Evaluate("Arbitrary({b a})");
+
+            auto shared = std::make_shared<ResultCache>(directory, 0);
+            shared->Store(key, planted, 1);
+
+            CLI cached (std::make_shared<Session>());
+            cached.SetCache(shared);
+
+            THEN(" it takes the result from the cache") {
+                REQUIRE(cached.Evaluate("Arbitrary({a b})").ToString() == planted.ToString());
+            }
+        }
+
+        WHEN(" two sessions compute the same with other variable names") {
+            auto shared = std::make_shared<ResultCache>(directory, 0);
+
+            CLI first (std::make_shared<Session>());
+            first.SetCache(shared);
+            RunSilently(first, "x = Arbitrary({a b}):");
+            RunSilently(first, "Simplify(x)");
+
+            auto entries = CountEntries(directory);
+
+            CLI second (std::make_shared<Session>());
+            second.SetCache(shared);
+            RunSilently(second, "y = Arbitrary({a b}):");
+            RunSilently(second, "Simplify(y)");
+
+            THEN(" the commands have the same key") {
+                auto x = first.GetExpandedCommandString(Parser().Parse("Simplify(x)"));
+                auto y = second.GetExpandedCommandString(Parser().Parse("Simplify(y)"));
+
+                REQUIRE(x != "");
+                REQUIRE(x == y);
+            }
+
+            THEN(" the second session takes the results from the cache") {
+                REQUIRE(entries > 0);
+                REQUIRE(CountEntries(directory) == entries);
+                REQUIRE(second.GetSession().GetCurrent().ToString() == first.GetSession().GetCurrent().ToString());
+            }
+        }
+    }
+
+    GIVEN(" a cache with a minimum cost") {
+        ResultCache cache (directory, 10);
+
+        CLI cli (std::make_shared<Session>());
+        cache.Store("Arbitrary({a b})", cli.Evaluate("Arbitrary({a b})"), 1);
+
+        THEN(" cheap results are not stored") {
+            REQUIRE(CountEntries(directory) == 0);
+        }
+    }
+
+    GIVEN(" a cache that is too small for an entry") {
+        ResultCache cache (directory, 0, 1);
+
+        CLI cli (std::make_shared<Session>());
+        cache.Store("Arbitrary({a b})", cli.Evaluate("Arbitrary({a b})"), 1);
+
+        THEN(" the entry is removed right away") {
+            Expression result;
+            REQUIRE(!cache.Lookup("Arbitrary({a b})", result));
+            REQUIRE(CountEntries(directory) == 0);
+        }
+    }
+
+    boost::filesystem::remove_all(directory);
+}
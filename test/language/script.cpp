@@ -0,0 +1,81 @@
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+#include <boost/filesystem/operations.hpp>
+
+#include <language/cli.hpp>
+
+using Construction::Language::CLI;
+using Construction::Language::Session;
+
+/**
+    Runs the lines as a script on the CLI, without printing them
+ */
+void RunScript(CLI& cli, const std::string& code) {
+    auto filename = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+
+    {
+        std::ofstream file (filename);
+        file << code;
+    }
+
+    std::stringstream output;
+    auto buffer = std::cout.rdbuf(output.rdbuf());
+
+    cli.ExecuteScript(filename);
+
+    std::cout.rdbuf(buffer);
+    boost::filesystem::remove(filename);
+}
+
+SCENARIO("Scripts", "[script]") {
+
+    GIVEN(" a script whose independent lines run concurrently") {
+        CLI cli (std::make_shared<Session>());
+
+        RunScript(cli, "a = Arbitrary({a b}):\n"
+                       "b = Epsilon({a b c}):\n"
+                       "c = Add(a, a):\n"
+                       "d = Simplify(c):\n");
+
+        THEN(" the session is the same as if the lines ran one after another") {
+            REQUIRE(cli.GetSession().Contains("a"));
+            REQUIRE(cli.GetSession().Contains("d"));
+            REQUIRE(cli.GetSession().Get("b").As<Construction::Tensor::Tensor>().ToString() == "\\epsilon_{abc}");
+            REQUIRE(cli.GetSession().Get("d").As<Construction::Tensor::Tensor>().ToString() == cli.Evaluate("Simplify(Add(a, a))").As<Construction::Tensor::Tensor>().ToString());
+        }
+    }
+
+    GIVEN(" a script with a failing line") {
+        CLI cli (std::make_shared<Session>());
+
+        RunScript(cli, "a = Arbitrary({a b}):\n"
+                       "b = Arbitrary(a)\n"
+                       "c = Arbitrary({a b c d}):\n"
+                       "d = Epsilon({a b c})\n");
+
+        THEN(" the lines after it are still executed") {
+            REQUIRE(cli.GetSession().Contains("a"));
+            REQUIRE(cli.GetSession().Contains("c"));
+            REQUIRE(cli.GetSession().Contains("d"));
+        }
+    }
+
+    GIVEN(" a script that changes the preview between its lines") {
+        CLI cli (std::make_shared<Session>());
+
+        RunScript(cli, "a = Arbitrary({a b}):\n"
+                       "Preview(3)\n"
+                       "b = Add(a, a):\n");
+
+        THEN(" only the session command waits for the lines before") {
+            REQUIRE(Construction::Language::CommandManagement::Instance()->CreateCommand("Add")->Pure());
+            REQUIRE(!Construction::Language::CommandManagement::Instance()->CreateCommand("Preview")->Pure());
+
+            REQUIRE(cli.GetSession().GetPreview() == 3);
+            REQUIRE(cli.GetSession().Contains("b"));
+        }
+    }
+
+}
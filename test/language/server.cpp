@@ -0,0 +1,155 @@
+#ifdef CONSTRUCTION_WITH_SERVER
+
+#include <thread>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+
+#include <language/server.hpp>
+
+using Construction::Language::Server;
+using Construction::Language::SharedResults;
+
+/**
+    Connects to the server on the socket, retrying until it listens
+ */
+int ConnectTo(const std::string& path) {
+    struct sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+    for (int attempt=0; attempt<100; attempt++) {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (connect(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) == 0) return fd;
+
+        close(fd);
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+
+    return -1;
+}
+
+SCENARIO("Construction server", "[server]") {
+
+    GIVEN(" a server with shared results") {
+        auto shared = std::make_shared<SharedResults>();
+        Server server ("/tmp/construction-test.sock", nullptr, shared);
+
+        CLI cli (std::make_shared<Session>());
+        cli.SetSharedResults(shared);
+
+        WHEN(" the CLI and a request compute the same tensor") {
+            cli.Evaluate("Arbitrary({a b})");
+
+            construction::Request request;
+            auto a = request.mutable_tensor()->add_indices();
+            a->set_name("a");
+            a->set_printed("a");
+            auto b = request.mutable_tensor()->add_indices();
+            b->set_name("b");
+            b->set_printed("b");
+
+            auto response = server.Handle(cli, request);
+
+            THEN(" the request takes the result of the CLI") {
+                REQUIRE(!response.has_error());
+                REQUIRE(response.printed() == cli.Evaluate("Arbitrary({a b})").ToString());
+                REQUIRE(shared->GetStatistics().hits == 2);
+            }
+
+            THEN(" indices in another position are a different request") {
+                b->set_up(true);
+
+                auto other = server.Handle(cli, request);
+
+                REQUIRE(!other.has_error());
+                REQUIRE(shared->GetStatistics().hits == 1);
+            }
+        }
+
+        WHEN(" a background job finished") {
+            RunSilently(cli, "x = Arbitrary({a b}) &");
+            WaitForJobs(cli, "x");
+
+            cli.Evaluate("Arbitrary({a b c})");
+
+            construction::Request request;
+            request.mutable_jobs();
+
+            auto response = server.Handle(cli, request);
+
+            THEN(" the jobs request lists it") {
+                REQUIRE(response.jobs().jobs_size() == 1);
+                REQUIRE(response.jobs().jobs(0).variable() == "x");
+                REQUIRE(response.jobs().jobs(0).state() == "done");
+            }
+
+            THEN(" Jobs() does not return the result of the line before") {
+                construction::Request execute;
+                execute.mutable_execute()->set_command("Jobs()");
+
+                std::stringstream output;
+                auto buffer = std::cout.rdbuf(output.rdbuf());
+                auto listed = server.Handle(cli, execute);
+                std::cout.rdbuf(buffer);
+
+                REQUIRE(!listed.has_error());
+                REQUIRE(listed.printed() == "");
+            }
+        }
+    }
+
+    GIVEN(" a running server") {
+        std::string path = "/tmp/construction-test-framing.sock";
+        Server server (path);
+
+        std::thread thread ([&]() { server.Run(); });
+
+        int fd = ConnectTo(path);
+        REQUIRE(fd >= 0);
+
+        WHEN(" sending a framed request") {
+            construction::Request request;
+            request.mutable_execute()->set_command("Arbitrary({a b})");
+
+            std::string message;
+            request.SerializeToString(&message);
+
+            uint32_t size = htonl(static_cast<uint32_t>(message.size()));
+            send(fd, &size, sizeof(size), MSG_NOSIGNAL);
+            send(fd, message.data(), message.size(), MSG_NOSIGNAL);
+
+            THEN(" the response comes back framed") {
+                uint32_t responseSize;
+                REQUIRE(recv(fd, &responseSize, sizeof(responseSize), MSG_WAITALL) == sizeof(responseSize));
+
+                std::string buffer (ntohl(responseSize), '\0');
+                REQUIRE(recv(fd, &buffer[0], buffer.size(), MSG_WAITALL) == static_cast<ssize_t>(buffer.size()));
+
+                construction::Response response;
+                REQUIRE(response.ParseFromString(buffer));
+                REQUIRE(!response.has_error());
+                REQUIRE(response.tensors().tensors_size() > 0);
+            }
+        }
+
+        WHEN(" announcing a message above the maximum size") {
+            uint32_t size = htonl(Server::MaximumMessageSize + 1);
+            send(fd, &size, sizeof(size), MSG_NOSIGNAL);
+
+            THEN(" the client is disconnected") {
+                char c;
+                REQUIRE(recv(fd, &c, 1, 0) == 0);
+            }
+        }
+
+        close(fd);
+
+        server.Stop();
+        thread.join();
+    }
+
+}
+
+#endif
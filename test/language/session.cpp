@@ -0,0 +1,118 @@
+#include <cstdio>
+
+#include <language/session.hpp>
+
+/**
+    Returns the variable of the session as it is printed,
+    to compare the values of different sessions
+ */
+std::string Printed(const Session& session, const std::string& name) {
+    return session.Get(name).ToString();
+}
+
+/**
+    Loads the session from the file without printing its notebook
+ */
+void LoadSilently(Session& session, const std::string& filename) {
+    std::stringstream output;
+    auto buffer = std::cout.rdbuf(output.rdbuf());
+
+    try {
+        session.LoadFromFile(filename);
+    } catch (...) {
+        std::cout.rdbuf(buffer);
+        throw;
+    }
+
+    std::cout.rdbuf(buffer);
+}
+
+SCENARIO("Sessions", "[session]") {
+
+    GIVEN(" a session with a layered session over it") {
+        CLI cli (std::make_shared<Session>());
+        RunSilently(cli, "x = Arbitrary({a b}):");
+
+        auto& parent = cli.GetSession();
+        Session layer (&parent);
+
+        THEN(" the layer sees the variables of the parent") {
+            REQUIRE(layer.Contains("x"));
+            REQUIRE(Printed(layer, "x") == Printed(parent, "x"));
+            REQUIRE(layer.Size() == 0);
+        }
+
+        THEN(" variables set in the layer do not change the parent") {
+            layer.Set("x", cli.Evaluate("Arbitrary({a b c})"));
+            layer.Set("y", parent.Get("x"));
+
+            REQUIRE(Printed(layer, "x") != Printed(parent, "x"));
+            REQUIRE(layer.Contains("y"));
+            REQUIRE(!parent.Contains("y"));
+        }
+
+        THEN(" the layer shares the jobs and limits of the parent") {
+            parent.SetTimeout(5);
+            Session limited (&parent);
+
+            REQUIRE(&limited.GetJobs() == &parent.GetJobs());
+            REQUIRE(limited.GetTimeout() == 5);
+        }
+    }
+
+    GIVEN(" a session saved into a file") {
+        std::string filename = "/tmp/construction-test.session";
+
+        CLI cli (std::make_shared<Session>());
+        RunSilently(cli, "x = Arbitrary({a b}):");
+        RunSilently(cli, "y = Symmetrize(Arbitrary({a b c}), {a b c}):");
+
+        auto& saved = cli.GetSession();
+        saved.SaveToFile(filename);
+
+        WHEN(" loading it into another session") {
+            Session loaded;
+            LoadSilently(loaded, filename);
+
+            THEN(" the variables are read when they are accessed") {
+                REQUIRE(loaded.Size() == 2);
+                REQUIRE(loaded.Contains("x"));
+                REQUIRE(Printed(loaded, "x") == Printed(saved, "x"));
+                REQUIRE(Printed(loaded, "y") == Printed(saved, "y"));
+                REQUIRE(!loaded.Contains("z"));
+            }
+
+            THEN(" variables that were never read are kept when saving again") {
+                REQUIRE(Printed(loaded, "x") == Printed(saved, "x"));
+                loaded.SaveToFile(filename + ".copy");
+
+                Session copy;
+                LoadSilently(copy, filename + ".copy");
+
+                REQUIRE(copy.Size() == 2);
+                REQUIRE(Printed(copy, "x") == Printed(saved, "x"));
+                REQUIRE(Printed(copy, "y") == Printed(saved, "y"));
+
+                std::remove((filename + ".copy").c_str());
+            }
+
+            THEN(" setting a variable replaces the stored one") {
+                loaded.Set("y", saved.Get("x"));
+
+                REQUIRE(loaded.Size() == 2);
+                REQUIRE(Printed(loaded, "y") == Printed(saved, "x"));
+            }
+        }
+
+        std::remove(filename.c_str());
+    }
+
+    GIVEN(" a file that does not exist") {
+        Session session;
+
+        THEN(" loading it fails") {
+            REQUIRE_THROWS_AS(LoadSilently(session, "/tmp/construction-test-missing.session"), Construction::Language::CannotOpenSessionException);
+        }
+    }
+
+}
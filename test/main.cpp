@@ -1,7 +1,9 @@
 #define CATCH_CONFIG_MAIN
 #include <catch.hpp>
 
-//#include "common.cpp"
+#include "common.cpp"
 #include "tensor.cpp"
+#include "generator.cpp"
+#include "language.cpp"
 //#include "api.cpp"
 //#include "vector.cpp"
\ No newline at end of file
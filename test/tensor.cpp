@@ -3,6 +3,9 @@
 //#include "tensor/tensor.cpp"
 //#include "tensor/symmetrization.cpp"
 #include "tensor/substitution.cpp"
+#include "tensor/tensor_database.cpp"
+#include "tensor/encoding.cpp"
+#include "tensor/tensor_printing.cpp"
 
 //#include "tensor/index.cpp"
 /*#include "tensor/tensor.cpp"
@@ -0,0 +1,79 @@
+#include <sstream>
+
+#include <tensor/tensor.hpp>
+#include <tensor/expression.hpp>
+#include <tensor/encoding.hpp>
+
+using Construction::Tensor::Tensor;
+using Construction::Tensor::Scalar;
+using Construction::Tensor::Indices;
+using Construction::Tensor::Expression;
+using Construction::Tensor::AbstractExpression;
+using Construction::Tensor::Encoder;
+
+SCENARIO("Compact encoding", "[encoding]") {
+
+    GIVEN(" a sum of scaled epsilon gamma tensors") {
+        auto indices = Indices::GetRomanSeries(4, {1,3});
+
+        Indices permuted;
+        permuted.Insert(indices[0]);
+        permuted.Insert(indices[2]);
+        permuted.Insert(indices[1]);
+        permuted.Insert(indices[3]);
+
+        Tensor tensor = Scalar("e_1") * Tensor::EpsilonGamma(0, 2, indices) + Scalar(2,3) * Tensor::EpsilonGamma(0, 2, permuted);
+        Expression expression (tensor);
+
+        WHEN(" serializing the expression") {
+            std::stringstream ss;
+            expression.Serialize(ss);
+
+            THEN(" it can be read back") {
+                auto result = Expression::Deserialize(ss);
+
+                REQUIRE(result);
+                REQUIRE(result->IsTensor());
+                REQUIRE(result->ToString() == expression.ToString());
+            }
+
+            THEN(" it is smaller than the text based format") {
+                std::stringstream legacy;
+                tensor.Serialize(legacy);
+
+                REQUIRE(ss.str().size() * 2 < legacy.str().size());
+            }
+        }
+
+        WHEN(" reading the text based format of older versions") {
+            std::stringstream ss;
+
+            unsigned type = AbstractExpression::TENSOR;
+            ss.write(reinterpret_cast<const char*>(&type), sizeof(type));
+            tensor.Serialize(ss);
+
+            THEN(" the expression is the same") {
+                auto result = Expression::Deserialize(ss);
+
+                REQUIRE(result);
+                REQUIRE(result->ToString() == expression.ToString());
+            }
+        }
+    }
+
+    GIVEN(" scalars and substitutions") {
+        Scalar scalar = Scalar("x") * Scalar(3,4) + Scalar(0.5);
+
+        THEN(" they survive the encoding") {
+            std::stringstream ss;
+            Expression(scalar).Serialize(ss);
+
+            auto result = Expression::Deserialize(ss);
+
+            REQUIRE(result);
+            REQUIRE(result->IsScalar());
+            REQUIRE(result->ToString() == scalar.ToString());
+        }
+    }
+
+}
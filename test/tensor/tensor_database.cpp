@@ -0,0 +1,83 @@
+#include <cstdio>
+
+#include <tensor/tensor.hpp>
+#include <tensor/tensor_database.hpp>
+
+using Construction::Tensor::Tensor;
+using Construction::Tensor::Indices;
+using Construction::Tensor::TensorDatabase;
+using Construction::Tensor::TensorContainer;
+
+SCENARIO("Tensor database", "[tensor-database]") {
+
+    GIVEN(" a database with two entries on disk") {
+        TensorDatabase database;
+
+        database["gamma"].Insert(Tensor::Gamma(Indices::GetRomanSeries(2, {1,3})));
+        database["epsilon"].Insert(Tensor::EpsilonGamma(1, 1, Indices::GetRomanSeries(5, {1,3})));
+
+        database.SaveToFile("test.db");
+
+        WHEN(" opening the file") {
+            TensorDatabase opened;
+            opened.Open("test.db");
+
+            THEN(" the index knows all the entries") {
+                REQUIRE(opened.Size() == 2);
+                REQUIRE(opened.Contains("gamma"));
+                REQUIRE(opened.Contains("epsilon"));
+                REQUIRE(!opened.Contains("delta"));
+            }
+
+            THEN(" single entries can be read") {
+                const TensorDatabase& constOpened = opened;
+                REQUIRE(constOpened["epsilon"].ToString() == database["epsilon"].ToString());
+            }
+
+            THEN(" unread entries survive saving") {
+                opened["gamma"].Insert(Tensor::Gamma(Indices::GetRomanSeries(2, {1,3})));
+                opened.SaveToFile("test.db");
+
+                TensorDatabase loaded;
+                loaded.LoadFromFile("test.db");
+
+                REQUIRE(loaded["gamma"].Size() == 2);
+                REQUIRE(loaded["epsilon"].ToString() == database["epsilon"].ToString());
+            }
+        }
+
+        WHEN(" appending an entry") {
+            TensorDatabase opened;
+            opened.Open("test.db");
+
+            TensorContainer delta;
+            delta.Insert(Tensor::Gamma(Indices::GetRomanSeries(2, {1,3})));
+            opened.Append("delta", delta);
+
+            THEN(" the file has the new and the old entries") {
+                TensorDatabase loaded;
+                loaded.LoadFromFile("test.db");
+
+                REQUIRE(loaded.Size() == 3);
+                REQUIRE(loaded["delta"].ToString() == delta.ToString());
+                REQUIRE(loaded["epsilon"].ToString() == database["epsilon"].ToString());
+            }
+
+            THEN(" appending the same name replaces the entry") {
+                TensorContainer gamma;
+                gamma.Insert(Tensor::Gamma(Indices::GetRomanSeries(2, {1,3})));
+                gamma.Insert(Tensor::Gamma(Indices::GetRomanSeries(2, {1,3})));
+                opened.Append("gamma", gamma);
+
+                TensorDatabase loaded;
+                loaded.Open("test.db");
+
+                REQUIRE(loaded.Size() == 3);
+                REQUIRE(loaded["gamma"].Size() == 2);
+            }
+        }
+
+        std::remove("test.db");
+    }
+
+}
@@ -0,0 +1,50 @@
+#include <sstream>
+#include <ostream>
+#include <string>
+
+#include <tensor/tensor.hpp>
+#include <tensor/scalar.hpp>
+#include <tensor/index.hpp>
+
+using Construction::Tensor::Tensor;
+using Construction::Tensor::Indices;
+using Construction::Tensor::Scalar;
+
+SCENARIO("Printing tensors", "[tensor-printing]") {
+
+    auto gamma = Tensor::Gamma(Indices::GetRomanSeries(2,{1,3}));
+
+    GIVEN(" a sum with variables") {
+        auto c = Scalar::Variable("x") * gamma + Scalar::Variable("y") * gamma;
+
+        THEN(" only the first summands are written in a preview") {
+            std::stringstream ss;
+            REQUIRE(c.Write(ss, 1, "  "));
+            REQUIRE(ss.str() == "  x * \\gamma_{ab} + \n  ... (1 more summands)\n");
+        }
+
+        THEN(" all of them are written without a limit") {
+            std::stringstream ss;
+            ss << c;
+            REQUIRE(ss.str() == c.ToString());
+            REQUIRE(ss.str() == "x * \\gamma_{ab} + \ny * \\gamma_{ab}\n");
+        }
+    }
+
+    GIVEN(" a sum with another sum in it") {
+        auto c = Scalar::Variable("x") * gamma + (Scalar::Variable("y") * gamma + Scalar::Variable("z") * gamma);
+
+        THEN(" every line of the inner sum is indented as well") {
+            std::stringstream ss;
+            c.Write(ss, 0, "  ");
+            REQUIRE(ss.str() == "  x * \\gamma_{ab} + \n  y * \\gamma_{ab} + \n  z * \\gamma_{ab}\n\n");
+        }
+
+        THEN(" the text without indent is the same as ToString") {
+            std::stringstream ss;
+            c.Write(ss);
+            REQUIRE(ss.str() == c.ToString());
+        }
+    }
+
+}